@@ -6,6 +6,9 @@
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
+#include "timer_wheel.h"
+#include "scheduler.h"
+#include "trigger_journal.h"
 
 // Максимальные значения
 #define MAX_SYMBOL_LEN 16
@@ -14,7 +17,9 @@
 #define MAX_ALERTS_PREMIUM 1000
 #define MAX_MESSAGE_LEN 256
 #define MAX_URL_LEN 512
+#define MAX_EXPR_LEN 256
 #define API_UPDATE_INTERVAL 30
+#define ALERT_DB_PATH "alerts.db"
 
 // Типы алертов
 typedef enum {
@@ -24,7 +29,8 @@ typedef enum {
     ALERT_VOLUME_SPIKE = 3,
     ALERT_RSI_OVERSOLD = 4,
     ALERT_RSI_OVERBOUGHT = 5,
-    ALERT_PORTFOLIO_VALUE = 6
+    ALERT_PORTFOLIO_VALUE = 6,
+    ALERT_COMPOUND = 7
 } AlertType;
 
 // Статусы алертов
@@ -32,9 +38,25 @@ typedef enum {
     ALERT_STATUS_INACTIVE = 0,
     ALERT_STATUS_ACTIVE = 1,
     ALERT_STATUS_TRIGGERED = 2,
-    ALERT_STATUS_PAUSED = 3
+    ALERT_STATUS_PAUSED = 3,
+    ALERT_STATUS_SCHEDULED = 4,     // Ждет отложенной активации или разовой проверки
+    ALERT_STATUS_EXPIRED = 5        // Истек срок или разовая проверка не сработала;
+                                    // в отличие от INACTIVE (удален) не очищается
 } AlertStatus;
 
+// Режимы срабатывания алертов
+typedef enum {
+    ALERT_TRIGGER_LEVEL = 0,    // Срабатывает, пока условие выполняется
+    ALERT_TRIGGER_CROSS = 1     // Срабатывает только при пересечении уровня
+} AlertTriggerMode;
+
+// Сторона уровня, на которой алерт находился при последней проверке
+typedef enum {
+    ALERT_SIDE_UNKNOWN = -1,
+    ALERT_SIDE_OUTSIDE = 0,     // Условие не выполнено, алерт взведен
+    ALERT_SIDE_INSIDE = 1       // Условие выполнено, ждем выхода за полосу гистерезиса
+} AlertSide;
+
 // Уровни подписки пользователя
 typedef enum {
     USER_FREE = 0,
@@ -72,6 +94,17 @@ typedef struct {
     bool is_repeatable;
     int cooldown_minutes;
     UserTier required_tier;
+    char expression[MAX_EXPR_LEN];  // Составное условие (ALERT_COMPOUND)
+    int expr_program;               // Скомпилированный байткод, -1 если нет
+    AlertTriggerMode trigger_mode;
+    double hysteresis;              // Ширина полосы повторного взведения (CROSS)
+    AlertSide last_side;
+    int active_pos;                 // Позиция в наборе проверяемых алертов, -1 если нет
+    TimerNode cooldown_timer;       // Узел в колесе cooldown
+    time_t activate_at;             // Отложенная активация, 0 если нет
+    time_t expires_at;              // Срок действия, 0 если бессрочный
+    time_t check_at;                // Разовая проверка в заданное время, 0 если нет
+    bool state_dirty;               // last_triggered/trigger_count еще не сохранены
 } Alert;
 
 // Структура для управления алертами
@@ -80,6 +113,14 @@ typedef struct {
     int count;
     int capacity;
     time_t last_cleanup;
+    int* active_index;          // Индексы алертов, проверяемых на каждом тике
+    int active_count;
+    TimerWheel* cooldown_wheel; // Алерты в cooldown ждут здесь, а не в active_index
+    Scheduler* scheduler;       // Активация, истечение и разовые проверки по времени
+    int* dirty_index;           // Алерты с несохраненным состоянием срабатывания
+    int dirty_count;
+    int* id_index;              // id алерта -> позиция в alerts (открытая адресация, -1 - пусто)
+    int id_index_mask;
 } AlertManager;
 
 // Структура для рыночных данных
@@ -94,16 +135,26 @@ typedef struct {
 // Основные функции Alert Engine
 int alert_engine_init(void);
 void alert_engine_cleanup(void);
+void alert_engine_wakeup(void);
 
 // Управление алертами
 int alert_create(const char* user_id, const char* symbol, AlertType type, 
                 double target_value, UserTier user_tier);
+int alert_create_compound(const char* user_id, const char* expression, UserTier user_tier);
 int alert_delete(int alert_id, const char* user_id);
 int alert_pause(int alert_id, const char* user_id);
 int alert_resume(int alert_id, const char* user_id);
+int alert_set_trigger_mode(int alert_id, const char* user_id, 
+                          AlertTriggerMode mode, double hysteresis);
+int alert_schedule(int alert_id, const char* user_id, 
+                  time_t activate_at, time_t expires_at, time_t check_at);
 Alert* alert_get_by_id(int alert_id);
 Alert* alert_get_user_alerts(const char* user_id, int* count);
 
+// История срабатываний пользователя из журнала, от новых к старым
+int alert_trigger_history(const char* user_id, time_t from, time_t to,
+                          TriggerRecord* records, int max_records);
+
 // Проверка алертов
 int alert_check_all(void);
 int alert_check_symbol(const char* symbol);
@@ -114,13 +165,17 @@ int market_data_update(void);
 CryptoPrice* market_data_get_price(const char* symbol);
 int market_data_get_all(CryptoPrice** prices);
 
+// Портфели
+int alert_portfolio_set_holding(const char* user_id, const char* symbol, double quantity);
+
 // Вспомогательные функции
 double calculate_rsi(double* prices, int count, int period);
 bool is_user_tier_sufficient(UserTier required, UserTier actual);
 int get_max_alerts_for_tier(UserTier tier);
 void alert_log(const char* level, const char* message);
 
-// Уведомления
+// Уведомления; callback вызывается в потоке доставки с копией алерта
+// на момент срабатывания
 typedef void (*NotificationCallback)(Alert* alert, CryptoPrice* price);
 void alert_set_notification_callback(NotificationCallback callback);
 void alert_send_notification(Alert* alert, CryptoPrice* price);
@@ -0,0 +1,93 @@
+#ifndef ALERT_EXPR_H
+#define ALERT_EXPR_H
+
+#include <stdint.h>
+#include "alert_engine.h"
+
+#define MAX_EXPR_CODE 64
+#define MAX_EXPR_STACK 16
+#define EXPR_PROGRAMS_INITIAL 64  // Таблица программ удваивается при заполнении
+#define MAX_EXPR_OPERANDS 512
+#define MAX_EXPR_PREDICATES 2048
+
+// Поля рыночных данных, доступные в выражениях
+typedef enum {
+    EXPR_FIELD_PRICE = 0,
+    EXPR_FIELD_CHANGE_24H = 1,
+    EXPR_FIELD_CHANGE_PERCENT_24H = 2,
+    EXPR_FIELD_VOLUME_24H = 3,
+    EXPR_FIELD_MARKET_CAP = 4,
+    EXPR_FIELD_RSI14 = 5
+} ExprField;
+
+// Операторы сравнения
+typedef enum {
+    EXPR_CMP_GT = 0,
+    EXPR_CMP_GE = 1,
+    EXPR_CMP_LT = 2,
+    EXPR_CMP_LE = 3,
+    EXPR_CMP_EQ = 4,
+    EXPR_CMP_NE = 5
+} ExprCompare;
+
+// Инструкции байткода
+typedef enum {
+    EXPR_OP_PRED = 0,          // push predicates[arg]
+    EXPR_OP_NOT = 1,           // top = !top
+    EXPR_OP_JFALSE_KEEP = 2,   // top == false ? jump arg : pop
+    EXPR_OP_JTRUE_KEEP = 3,    // top == true ? jump arg : pop
+    EXPR_OP_END = 4
+} ExprOpcode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t reserved;
+    uint16_t arg;
+} ExprInstr;
+
+// Операнд (символ + поле), значение вычисляется один раз за тик
+typedef struct {
+    char symbol[MAX_SYMBOL_LEN];
+    ExprField field;
+    int refcount;
+    unsigned int epoch;
+    double value;
+    bool valid;
+} ExprOperand;
+
+// Сравнение операнда с константой, общее для всех программ
+typedef struct {
+    int operand;
+    ExprCompare cmp;
+    double constant;
+    int refcount;
+    unsigned int epoch;
+    bool result;
+} ExprPredicate;
+
+// Скомпилированное выражение
+typedef struct {
+    bool in_use;
+    int length;
+    ExprInstr code[MAX_EXPR_CODE];
+    char primary_symbol[MAX_SYMBOL_LEN];
+} ExprProgram;
+
+// Поиск рыночных данных по символу для текущего тика
+typedef CryptoPrice* (*ExprPriceLookup)(const char* symbol, void* ctx);
+
+// Компиляция и освобождение программ.
+// Все функции модуля вызываются под g_alert_mutex.
+int expr_compile(const char* source, const char* default_symbol,
+                 char* error, size_t error_size);
+void expr_free(int program_id);
+const char* expr_primary_symbol(int program_id);
+
+// Вычисление
+void expr_begin_tick(ExprPriceLookup lookup, void* ctx);
+int expr_eval(int program_id);
+
+// Утилиты
+const char* expr_normalize_symbol(const char* name, char* out, size_t out_size);
+
+#endif // ALERT_EXPR_H
@@ -0,0 +1,30 @@
+#ifndef ALERT_SNAPSHOT_H
+#define ALERT_SNAPSHOT_H
+
+#include <stddef.h>
+#include <time.h>
+#include "alert_engine.h"
+
+// Бинарный снимок хранилища алертов: заголовок и массив структур Alert.
+// Снимок лежит рядом с базой (<db_path>.snapshot) и помнит число шардов;
+// снимок другой версии, с другим размером записи или раскладкой шардов
+// отвергается.
+#define ALERT_SNAPSHOT_SUFFIX ".snapshot"
+#define ALERT_SNAPSHOT_INTERVAL 300
+#define ALERT_SNAPSHOT_VERSION 2
+
+// Снимок, отображенный в память (только чтение)
+typedef struct {
+    void* map;
+    size_t map_size;
+    const Alert* alerts;
+    int count;
+    time_t taken_at;        // Строки с updated_at >= taken_at догружаются из базы
+} AlertSnapshot;
+
+int alert_snapshot_write(const char* path, const Alert* alerts, int count, time_t taken_at,
+                         int shard_count);
+int alert_snapshot_open(const char* path, int shard_count, AlertSnapshot* snapshot);
+void alert_snapshot_close(AlertSnapshot* snapshot);
+
+#endif // ALERT_SNAPSHOT_H
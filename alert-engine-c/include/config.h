@@ -0,0 +1,10 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define ALERT_CONFIG_PATH "config/alert_engine.conf"
+
+// Загрузка INI-файла конфигурации; известные ключи раскладываются
+// по XConfig структурам модулей до alert_engine_init()
+int config_load(const char* path);
+
+#endif // CONFIG_H
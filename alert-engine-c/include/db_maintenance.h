@@ -0,0 +1,33 @@
+#ifndef DB_MAINTENANCE_H
+#define DB_MAINTENANCE_H
+
+// Фоновое обслуживание базы: онлайн-бэкап через sqlite3_backup, удаление
+// давно неактивных алертов и incremental vacuum для каждого шарда базы.
+// Поток работает через собственные соединения и не берет g_alert_mutex.
+#define DB_BACKUP_DIR "backups"
+#define DB_BACKUP_INTERVAL 3600
+#define DB_MAX_BACKUP_FILES 10
+#define DB_PURGE_INTERVAL 3600
+#define DB_INACTIVE_RETENTION (7 * 24 * 3600)
+#define DB_BACKUP_STEP_PAGES 256
+#define DB_PURGE_BATCH 1000
+#define DB_VACUUM_PAGES 512
+
+typedef struct {
+    char backup_dir[256];
+    int backup_interval;        // Секунды, 0 - бэкап отключен
+    int max_backup_files;
+    int purge_interval;         // Секунды, 0 - очистка отключена
+    int inactive_retention;     // Возраст неактивной строки перед удалением, секунды
+} DbMaintenanceConfig;
+
+int db_maintenance_start(void);
+void db_maintenance_stop(void);
+
+int db_maintenance_backup_now(void);
+int db_maintenance_purge_now(void);
+
+void db_maintenance_set_config(const DbMaintenanceConfig* config);
+DbMaintenanceConfig* db_maintenance_get_config(void);
+
+#endif // DB_MAINTENANCE_H
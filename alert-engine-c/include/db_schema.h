@@ -0,0 +1,12 @@
+#ifndef DB_SCHEMA_H
+#define DB_SCHEMA_H
+
+#include <sqlite3.h>
+
+// Версия схемы хранится в PRAGMA user_version; каждая миграция
+// применяется в своей транзакции вместе с увеличением версии.
+#define DB_SCHEMA_VERSION 3
+
+int db_schema_migrate(sqlite3* db);
+
+#endif // DB_SCHEMA_H
@@ -0,0 +1,24 @@
+#ifndef DB_SHARDS_H
+#define DB_SHARDS_H
+
+// Хранилище алертов из N файлов SQLite; пользователь закреплен за файлом
+// по хэшу user_id, у каждого файла свой поток записи. При одном шарде
+// используется db_path как есть, иначе <db_path без .db>-<номер>.db.
+// Число шардов нельзя менять после того, как в них записаны данные.
+#define DB_MAX_SHARDS 16
+
+typedef struct {
+    char db_path[256];
+    int shard_count;
+} DbShardConfig;
+
+int db_shards_init(void);
+
+int db_shard_count(void);
+const char* db_shard_path(int shard);
+int db_shard_for_user(const char* user_id);
+
+void db_shards_set_config(const DbShardConfig* config);
+DbShardConfig* db_shards_get_config(void);
+
+#endif // DB_SHARDS_H
@@ -102,7 +102,9 @@ void free_api_response(APIResponse* response);
 char* url_encode(const char* str);
 char* build_market_url(const char* symbols);
 
-// Технические индикаторы
+// Технические индикаторы (RSI по сохраненной истории цен, -1 если истории мало)
+#define RSI_MAX_PERIOD 50
+#define RSI_WARMUP_PERIODS 10
 double calculate_rsi_for_symbol(const char* symbol, int period);
 double* get_price_history(const char* symbol, int days);
 
@@ -0,0 +1,34 @@
+#ifndef MSGPACK_WRITER_H
+#define MSGPACK_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Потоковая запись MessagePack прямо из структур, без промежуточного дерева.
+// Ошибка выделения памяти запоминается в failed, дальнейшие записи игнорируются.
+#define MSGPACK_CONTENT_TYPE "application/msgpack"
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} MsgPackWriter;
+
+int msgpack_writer_init(MsgPackWriter* writer, size_t capacity);
+void msgpack_writer_free(MsgPackWriter* writer);
+
+// Передача буфера вызывающему (освобождается через free)
+unsigned char* msgpack_writer_detach(MsgPackWriter* writer, size_t* size);
+
+void msgpack_write_map(MsgPackWriter* writer, uint32_t count);
+void msgpack_write_array(MsgPackWriter* writer, uint32_t count);
+void msgpack_write_str(MsgPackWriter* writer, const char* str);
+void msgpack_write_str_len(MsgPackWriter* writer, const char* str, uint32_t length);
+void msgpack_write_int(MsgPackWriter* writer, int64_t value);
+void msgpack_write_double(MsgPackWriter* writer, double value);
+void msgpack_write_bool(MsgPackWriter* writer, bool value);
+void msgpack_write_nil(MsgPackWriter* writer);
+
+#endif // MSGPACK_WRITER_H
@@ -0,0 +1,59 @@
+#ifndef NOTIFY_QUEUE_H
+#define NOTIFY_QUEUE_H
+
+#include "alert_engine.h"
+#include <stdint.h>
+
+// Очередь уведомлений о срабатываниях: вычислитель кладет компактные записи
+// в кольцо без блокировок и выделений памяти (любое число производителей),
+// поток доставки собирает из них сообщения, вызывает callback и отправляет
+// в WebSocket, а также пишет журнал срабатываний. При переполнении кольца
+// записи идут в список переполнения под мьютексом, пока поток доставки его
+// не разберет; теряется запись только при нехватке памяти.
+//
+// Записи доставляются пачками: производитель закрывает пачку после тика
+// (notify_queue_end_batch), а при ненулевом окне дайджеста пачка копится
+// digest_window_ms от первой записи, объединяя несколько тиков.
+#define NOTIFY_QUEUE_SIZE 4096      // Степень двойки; также предел одной пачки
+#define NOTIFY_DEFAULT_DIGEST_MS 0
+#define NOTIFY_BATCH_TIMEOUT_MS 100 // Доставка незакрытой пачки без окна дайджеста
+
+typedef struct {
+    int digest_window_ms;           // 0 - пачка на каждый тик
+} NotifyQueueConfig;
+
+// Срабатывание в том виде, в каком оно было под мьютексами вычислителя
+typedef struct {
+    int alert_id;
+    AlertType type;
+    AlertTriggerMode trigger_mode;
+    double target_value;
+    int trigger_count;
+    time_t triggered_at;
+    char user_id[64];
+    char symbol[MAX_SYMBOL_LEN];
+    char message[MAX_MESSAGE_LEN];
+    CryptoPrice price;
+} TriggerNotification;
+
+// Вызывается в потоке доставки для каждой пачки; записи в порядке постановки
+typedef void (*NotifyDeliverCallback)(const TriggerNotification* notifications, int count);
+
+int notify_queue_start(NotifyDeliverCallback deliver);
+
+// Остановка после доставки всего, что уже в очереди
+void notify_queue_stop(void);
+
+// 0 - в очереди, -1 - поток доставки не запущен, -2 - потеряна (нет памяти)
+int notify_queue_push(const TriggerNotification* notification);
+
+// Конец пачки: все записи до него можно доставлять
+int notify_queue_end_batch(void);
+
+// Число уведомлений, потерянных из-за нехватки памяти при переполнении
+uint64_t notify_queue_dropped(void);
+
+void notify_queue_set_config(const NotifyQueueConfig* config);
+NotifyQueueConfig* notify_queue_get_config(void);
+
+#endif // NOTIFY_QUEUE_H
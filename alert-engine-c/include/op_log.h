@@ -0,0 +1,46 @@
+#ifndef OP_LOG_H
+#define OP_LOG_H
+
+#include <stdint.h>
+
+// Журнал операций (write-ahead): каждая запись получает монотонный номер,
+// буферизуется и фиксируется на диск групповым fdatasync. Сегменты
+// <dir>/<первый номер>.oplog удаляются, когда все их операции применены.
+// Каталог журнала - <db_path>.oplog рядом с базой (см. persistence_start).
+#define OP_LOG_SUFFIX ".oplog"
+#define OP_LOG_DEFAULT_WINDOW_MS 50
+#define OP_LOG_DEFAULT_SEGMENT_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+    int group_commit_ms;        // Задержка фиксации записей без ожидающих
+    int segment_size;           // Размер, после которого начинается новый сегмент
+} OpLogConfig;
+
+// Вызывается для каждой целой записи в порядке номеров
+typedef void (*OpLogReplayCallback)(uint64_t seq, uint32_t type, const void* payload,
+                                    uint32_t size, void* ctx);
+
+// Номера продолжаются после большего из последнего номера в журнале и min_seq
+int op_log_open(const char* dir, uint64_t min_seq);
+// Закрытие; сегменты, все записи которых имеют номер <= applied_seq,
+// удаляются вместе с активным (0 - сохранить все для повтора)
+void op_log_close(uint64_t applied_seq);
+
+int op_log_replay(OpLogReplayCallback callback, void* ctx);
+
+// Добавление записи: 0 и ее номер в *seq (0, если журнал не открыт),
+// -1 - запись не принята
+int op_log_append(uint32_t type, const void* payload, uint32_t size, uint64_t* seq);
+uint64_t op_log_last_seq(void);
+
+// Ожидание, пока записи до seq включительно не окажутся на диске;
+// -1, если запись seq не удалось записать (ее пачка отброшена)
+int op_log_sync(uint64_t seq);
+
+// Удаление закрытых сегментов, все записи которых имеют номер <= seq
+void op_log_truncate(uint64_t seq);
+
+void op_log_set_config(const OpLogConfig* config);
+OpLogConfig* op_log_get_config(void);
+
+#endif // OP_LOG_H
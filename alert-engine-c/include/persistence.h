@@ -0,0 +1,55 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "alert_engine.h"
+
+// Отложенная запись в SQLite: операции сначала попадают в журнал операций
+// (op_log), затем в очередь шарда; отдельный поток на каждый шард базы
+// применяет их пачками в одной транзакции и фиксирует номер журнала.
+#define PERSIST_DEFAULT_WINDOW_MS 50
+#define PERSIST_DEFAULT_MAX_BATCH 512
+
+// Состояние срабатывания алерта для пакетного сохранения
+typedef struct {
+    int alert_id;
+    time_t last_triggered;
+    int trigger_count;
+    int shard;              // db_shard_for_user() владельца алерта
+} TriggerStateRow;
+
+typedef struct {
+    int durability_window_ms;   // Максимальная задержка фиксации операции
+    int max_batch;              // Размер очереди, при котором поток будится досрочно
+} PersistenceConfig;
+
+int persistence_start(void);
+void persistence_stop(void);
+int persistence_flush(void);
+
+// Журнал операций: ожидание долговечности операции с номером seq
+// (из функций постановки) и удаление сегментов, уже примененных к базе
+int persistence_sync(uint64_t seq);
+void persistence_checkpoint(void);
+
+void persistence_set_config(const PersistenceConfig* config);
+PersistenceConfig* persistence_get_config(void);
+
+// Постановка операций в очередь (не блокируют вызывающий поток); user_id
+// выбирает шард, операции одного пользователя применяются по порядку.
+// seq (может быть NULL) получает номер операции в журнале.
+int persistence_save_alert(const Alert* alert, uint64_t* seq);
+int persistence_update_status(const char* user_id, int alert_id, AlertStatus status,
+                              uint64_t* seq);
+int persistence_update_trigger_mode(const char* user_id, int alert_id,
+                                    AlertTriggerMode mode, double hysteresis, uint64_t* seq);
+int persistence_update_schedule(const char* user_id, int alert_id, AlertStatus status,
+                                time_t activate_at, time_t expires_at, time_t check_at,
+                                uint64_t* seq);
+int persistence_upsert_holding(const char* user_id, const char* symbol, double quantity,
+                               uint64_t* seq);
+int persistence_update_trigger_state(const TriggerStateRow* rows, int count);
+
+#endif // PERSISTENCE_H
@@ -0,0 +1,67 @@
+#ifndef PORTFOLIO_H
+#define PORTFOLIO_H
+
+#include "alert_engine.h"
+
+#define MAX_PORTFOLIOS 10000
+#define PORTFOLIO_INITIAL_HOLDINGS 8
+#define PORTFOLIO_RESUM_INTERVAL 1024
+
+// Позиция в портфеле
+typedef struct {
+    char symbol[MAX_SYMBOL_LEN];
+    double quantity;
+    double last_price;      // Цена, по которой позиция учтена в total_value
+} PortfolioHolding;
+
+// Портфель пользователя
+typedef struct {
+    char user_id[64];
+    PortfolioHolding* holdings;
+    int holding_count;
+    int holding_capacity;
+    double total_value;     // Инкрементально поддерживаемая стоимость
+    int updates_since_resum;
+    time_t last_valued;
+} Portfolio;
+
+// Ссылка из индекса символов на позицию портфеля
+typedef struct {
+    int portfolio_index;
+    int holding_index;
+} PortfolioRef;
+
+// Запись индекса символ -> позиции
+typedef struct {
+    char symbol[MAX_SYMBOL_LEN];
+    PortfolioRef* refs;
+    int count;
+    int capacity;
+    double last_price;      // Последняя известная цена символа
+} PortfolioSymbolEntry;
+
+// Хранилище портфелей
+typedef struct {
+    Portfolio* portfolios;
+    int count;
+    int capacity;
+    int* user_index;                    // Open addressing: user_id -> индекс портфеля
+    int user_index_size;
+    PortfolioSymbolEntry* symbol_index; // Open addressing: symbol -> позиции
+    int symbol_index_size;
+} PortfolioManager;
+
+// Инициализация и завершение
+int portfolio_init(void);
+void portfolio_cleanup(void);
+
+// Управление позициями
+int portfolio_set_holding(const char* user_id, const char* symbol, double quantity);
+int portfolio_reserve_holding(const char* user_id, const char* symbol);
+int portfolio_get_holdings(const char* user_id, PortfolioHolding* holdings, int max_count);
+
+// Оценка стоимости
+int portfolio_on_price_update(const char* symbol, double price);
+bool portfolio_get_value(const char* user_id, double* value);
+
+#endif // PORTFOLIO_H
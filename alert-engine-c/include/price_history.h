@@ -0,0 +1,27 @@
+#ifndef PRICE_HISTORY_H
+#define PRICE_HISTORY_H
+
+#include <stdint.h>
+#include <time.h>
+
+// История цен: файл на символ из блоков по 4 КБ. Внутри блока время
+// кодируется delta-of-delta, цены - XOR с предыдущим значением (Gorilla).
+#define PRICE_HISTORY_SUFFIX ".history"      // Каталог <db_path>.history
+#define PRICE_HISTORY_BLOCK_SIZE 4096
+#define PRICE_HISTORY_MAX_SERIES 256
+
+typedef struct {
+    int64_t timestamp;
+    double price;
+} PricePoint;
+
+int price_history_open(const char* dir);
+void price_history_close(void);
+
+int price_history_append(const char* symbol, time_t timestamp, double price);
+
+// Последние max_points точек интервала [from, to] в порядке возрастания времени
+int price_history_read(const char* symbol, time_t from, time_t to,
+                       PricePoint* points, int max_points);
+
+#endif // PRICE_HISTORY_H
@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#define SCHEDULER_INITIAL_CAPACITY 64
+
+// Типы отложенных событий
+typedef enum {
+    SCHED_ALERT_ACTIVATE = 0,   // Отложенная активация алерта
+    SCHED_ALERT_EXPIRE = 1,     // Истечение срока действия алерта
+    SCHED_ALERT_CHECK = 2       // Разовая проверка условия в заданное время
+} ScheduledEventType;
+
+typedef struct {
+    time_t deadline;
+    ScheduledEventType type;
+    int alert_id;
+} ScheduledEvent;
+
+// Планировщик на двоичной min-куче по deadline
+typedef struct {
+    ScheduledEvent* heap;
+    int count;
+    int capacity;
+} Scheduler;
+
+int scheduler_init(Scheduler* scheduler);
+void scheduler_free(Scheduler* scheduler);
+
+int scheduler_push(Scheduler* scheduler, time_t deadline, ScheduledEventType type, int alert_id);
+bool scheduler_pop_due(Scheduler* scheduler, time_t now, ScheduledEvent* event);
+time_t scheduler_next_deadline(const Scheduler* scheduler);
+
+#endif // SCHEDULER_H
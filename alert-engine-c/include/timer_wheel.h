@@ -0,0 +1,43 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Иерархическое колесо таймеров с разрешением 1 секунда:
+// уровень 0 - 64 с, уровень 1 - ~68 мин, уровень 2 - ~3 суток.
+// Более дальние таймеры ставятся в последний уровень и перекладываются заново.
+#define TIMER_WHEEL_LEVELS 3
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Узел таймера, встраивается в структуру-владельца
+typedef struct timer_node {
+    struct timer_node* next;
+    struct timer_node* prev;
+    time_t expires;
+} TimerNode;
+
+typedef struct {
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Головы кольцевых списков
+    time_t current;
+    int pending_count;
+} TimerWheel;
+
+typedef void (*TimerCallback)(TimerNode* node, void* ctx);
+
+// Получение структуры-владельца по указателю на встроенный узел
+#define TIMER_NODE_OWNER(node, type, member) \
+    ((type*)((char*)(node) - offsetof(type, member)))
+
+void timer_wheel_init(TimerWheel* wheel, time_t now);
+void timer_node_init(TimerNode* node);
+bool timer_node_pending(const TimerNode* node);
+
+void timer_wheel_add(TimerWheel* wheel, TimerNode* node, time_t expires);
+void timer_wheel_remove(TimerWheel* wheel, TimerNode* node);
+int timer_wheel_advance(TimerWheel* wheel, time_t now, TimerCallback callback, void* ctx);
+
+#endif // TIMER_WHEEL_H
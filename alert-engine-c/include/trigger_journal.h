@@ -0,0 +1,44 @@
+#ifndef TRIGGER_JOURNAL_H
+#define TRIGGER_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Журнал срабатываний: append-only сегменты фиксированных 32-байтных записей,
+// отображенные в память. Сегмент закрывается при заполнении или по возрасту.
+#define TRIGGER_JOURNAL_SUFFIX ".journal"                // Каталог <db_path>.journal
+#define TRIGGER_JOURNAL_SEGMENT_RECORDS 65536       // 2 МБ данных на сегмент
+#define TRIGGER_JOURNAL_ROTATE_SECONDS 3600
+#define TRIGGER_JOURNAL_MAX_SEGMENTS 168            // Хранится около недели
+#define TRIGGER_JOURNAL_INITIAL_SYMBOLS 4096    // Словари удваиваются при заполнении
+#define TRIGGER_JOURNAL_INITIAL_USERS 65536
+
+// Запись о срабатывании
+typedef struct {
+    int64_t timestamp;
+    double price;
+    int32_t alert_id;
+    uint32_t symbol_id;     // Индекс в словаре символов журнала
+    uint32_t user_id;       // Индекс в словаре пользователей журнала
+    uint32_t flags;         // Тип алерта (биты 0-7) и режим срабатывания (биты 8-15)
+} TriggerRecord;
+
+#define TRIGGER_FLAGS(type, mode) ((uint32_t)(type) | ((uint32_t)(mode) << 8))
+#define TRIGGER_FLAGS_TYPE(flags) ((int)((flags) & 0xFF))
+#define TRIGGER_FLAGS_MODE(flags) ((int)(((flags) >> 8) & 0xFF))
+
+int trigger_journal_open(const char* dir);
+void trigger_journal_close(void);
+
+int trigger_journal_append(int alert_id, const char* symbol, const char* user_id,
+                           uint32_t flags, double price, time_t timestamp);
+
+// Записи в интервале [from, to] от новых к старым; user_id NULL - все пользователи
+int trigger_journal_scan(time_t from, time_t to, const char* user_id,
+                         TriggerRecord* records, int max_records);
+
+// Копия символа записи; -1 и пустая строка для неизвестного id
+int trigger_journal_symbol(uint32_t symbol_id, char* symbol, size_t size);
+
+#endif // TRIGGER_JOURNAL_H
@@ -10,6 +10,7 @@
     
     #define LWS_PRE 0
     #define LWS_WRITE_TEXT 0
+    #define LWS_WRITE_BINARY 1
 #else
     // Unix WebSocket
     #include <libwebsockets.h>
@@ -42,13 +43,32 @@
 #endif
 
 #include "alert_engine.h"
+#include "notify_queue.h"
+#include <pthread.h>
+#include <stdint.h>
 
 #define WS_PORT 8081
 #define MAX_WS_CONNECTIONS 1000
 #define WS_BUFFER_SIZE 4096
-
-// Протоколы WebSocket
+#define WS_SEND_QUEUE_SIZE 256      // Кадров в очереди соединения; переполнение закрывает соединение
+#define WS_SEND_HIGH_WATERMARK (128 * 1024) // Байт в очереди, выше которых обновления рынка откладываются
+#define WS_SEND_LOW_WATERMARK (32 * 1024)   // Ниже - отложенные символы получают последние снимки
+#define WS_SLOW_CONSUMER_TIMEOUT 30 // Секунд выше верхней отметки до отключения клиента
+#define WS_USER_INDEX_SIZE 4096     // Степень двойки, с запасом больше MAX_WS_CONNECTIONS
+#define WS_TOPIC_INDEX_SIZE 1024    // Степень двойки: число различных символов для подписки
+#define WS_MAX_SUBSCRIPTIONS 64     // Символов на одно соединение
+#define WS_COALESCE_MAX_SIZE (64 * 1024) // Предел кадра, собранного из нескольких сообщений
+
+// Протоколы WebSocket; подпротокол клиента выбирает кодировку исходящих сообщений
 #define WS_PROTOCOL_ALERTS "alerts-protocol"
+#define WS_PROTOCOL_ALERTS_MSGPACK "alerts-msgpack"
+
+typedef enum {
+    WS_ENCODING_JSON = 0,           // Текстовые кадры
+    WS_ENCODING_MSGPACK = 1         // Бинарные кадры MessagePack той же структуры
+} WSEncoding;
+
+#define WS_ENCODING_COUNT 2
 
 // Типы WebSocket сообщений
 typedef enum {
@@ -57,9 +77,33 @@ typedef enum {
     WS_MSG_ALERT_CREATED = 2,
     WS_MSG_ALERT_DELETED = 3,
     WS_MSG_CONNECTION_STATUS = 4,
-    WS_MSG_ERROR = 5
+    WS_MSG_ERROR = 5,
+    WS_MSG_MARKET_SNAPSHOT = 6,
+    WS_MSG_MARKET_DELTA = 7,
+    WS_MSG_ALERT_DIGEST = 8         // Несколько срабатываний одного пользователя
 } WebSocketMessageType;
 
+// Подписка соединения: слот темы и позиция в списке подписчиков темы
+typedef struct {
+    int topic;
+    int position;
+} WSSubscription;
+
+// Сериализованное сообщение, общее для всех очередей, в которые оно попало;
+// освобождается, когда последняя очередь отпускает ссылку
+typedef struct {
+    int refcount;
+    WSEncoding encoding;
+    int topic;                      // Тема обновления рынка или -1 для остальных сообщений
+    size_t length;
+    unsigned char buffer[];         // LWS_PRE байт под заголовок libwebsockets, затем данные
+} WSFrame;
+
+// Одно сообщение во всех кодировках, которые используют подключенные клиенты
+typedef struct {
+    WSFrame* frames[WS_ENCODING_COUNT];
+} WSFrameSet;
+
 // Структура WebSocket соединения
 typedef struct ws_connection {
     struct lws* wsi;
@@ -67,9 +111,59 @@ typedef struct ws_connection {
     bool is_authenticated;
     time_t connected_at;
     int message_count;
-    struct ws_connection* next;
+    WSEncoding encoding;
+
+    // Кольцевая очередь отправки; пишется любым потоком под мьютексом
+    // менеджера, читается потоком обслуживания по LWS_CALLBACK_SERVER_WRITEABLE
+    WSFrame* send_queue[WS_SEND_QUEUE_SIZE];
+    int send_head;
+    int send_count;
+    size_t queued_bytes;
+    int dropped_count;
+    bool write_requested;           // Поток обслуживания должен запросить запись
+
+    // Медленный клиент: выше верхней отметки обновления рынка не ставятся
+    // в очередь, а его подписки ждут снимка после спада ниже нижней
+    bool congested;
+    time_t congested_since;
+    bool close_requested;           // Поток обслуживания закроет соединение
+
+    int index;                      // Позиция в WSManager.connections
+    int user_index;                 // Позиция в списке соединений пользователя
+    int pending_index;              // Позиция в WSManager.pending_writes
+
+    WSSubscription subscriptions[WS_MAX_SUBSCRIPTIONS];
+    int subscription_count;
 } WSConnection;
 
+// Подписчик темы и номер версии, до которой он получил ее состояние
+// (0 - следующим должен получить полный снимок)
+typedef struct {
+    WSConnection* conn;
+    uint64_t seq;
+} WSSubscriber;
+
+// Тема рынка: подписчики символа и последняя разосланная цена.
+// Каждое изменение цены увеличивает seq; темы не удаляются,
+// их число ограничено числом символов.
+typedef struct {
+    char symbol[MAX_SYMBOL_LEN];    // Пустая строка - свободный слот
+    WSSubscriber* subscribers;
+    int count;
+    int capacity;
+    CryptoPrice last_sent;
+    bool has_last;
+    uint64_t seq;
+} WSTopicEntry;
+
+// Соединения одного пользователя
+typedef struct {
+    char user_id[64];               // Пустая строка - свободный слот
+    WSConnection** connections;
+    int count;
+    int capacity;
+} WSUserEntry;
+
 // Структура WebSocket сообщения
 typedef struct {
     WebSocketMessageType type;
@@ -80,10 +174,18 @@ typedef struct {
 
 // Менеджер WebSocket соединений
 typedef struct {
-    WSConnection* connections;
+    WSConnection** connections;     // Удаление переносит последнее соединение на место удаленного
     int connection_count;
+    WSUserEntry* user_index;        // Open addressing: user_id -> соединения пользователя
+    WSTopicEntry* topic_index;      // Open addressing: символ -> подписчики
+    WSConnection** pending_writes;  // Соединения с новыми кадрами, ждущие запроса записи
+    int pending_count;
+    int encoding_counts[WS_ENCODING_COUNT];
+    unsigned char* batch_buffer;    // LWS_PRE + WS_COALESCE_MAX_SIZE, только поток обслуживания
     struct lws_context* context;
     bool is_running;
+    pthread_t service_thread;
+    pthread_mutex_t mutex;          // Соединения, индексы и очереди отправки
 } WSManager;
 
 // Инициализация и завершение WebSocket сервера
@@ -93,20 +195,44 @@ int ws_server_start(void);
 void ws_server_stop(void);
 void ws_server_run(void);
 
-// Управление соединениями
-int ws_add_connection(struct lws* wsi, const char* user_id);
+// Управление соединениями (вызываются из потока обслуживания)
+int ws_add_connection(struct lws* wsi, const char* user_id, WSEncoding encoding);
 int ws_remove_connection(struct lws* wsi);
 WSConnection* ws_find_connection(struct lws* wsi);
-WSConnection* ws_find_user_connections(const char* user_id, int* count);
+// Результаты действительны, пока вызывающий держит мьютекс менеджера
+WSConnection** ws_find_user_connections(const char* user_id, int* count);
 
-// Отправка сообщений
+// Подписка на обновления цен символа; вызываются из потока обслуживания.
+// Подписчик получает снимок, затем изменения относительно предыдущей версии.
+int ws_subscribe(struct lws* wsi, const char* symbol);
+int ws_unsubscribe(struct lws* wsi, const char* symbol);
+int ws_resync(struct lws* wsi, const char* symbol);
+
+// Отправка сообщений: безопасны из любого потока, только ставят кадр в очередь
 int ws_send_to_user(const char* user_id, WSMessage* message);
 int ws_send_to_connection(WSConnection* conn, WSMessage* message);
 int ws_broadcast_message(WSMessage* message);
 
+// Готовые кадры в очереди пользователя (всех соединений при user_id == NULL):
+// соединение получает кадр своей кодировки. Каждая очередь берет свою
+// ссылку, вызывающий отпускает свои.
+WSFrame* ws_frame_create(const void* payload, size_t length, WSEncoding encoding);
+void ws_frame_release(WSFrame* frame);
+int ws_send_frames(const char* user_id, const WSFrameSet* set);
+
+// Срабатывания пользователя одним сообщением: alert_triggered для одного,
+// alert_digest для нескольких; кадры всех кодировок строятся из записей очереди
+int ws_send_alert_notifications(const char* user_id, const TriggerNotification* const* notifications,
+                                int count);
+
 // Создание сообщений
-WSMessage* ws_create_alert_triggered_message(Alert* alert, CryptoPrice* price);
+WSMessage* ws_create_alert_triggered_message(const TriggerNotification* notification);
+// Дайджест: data - массив элементов того же вида, что data у alert_triggered
+WSMessage* ws_create_alert_digest_message(const char* user_id);
+int ws_alert_digest_add(WSMessage* digest, const TriggerNotification* notification);
 WSMessage* ws_create_market_update_message(CryptoPrice* prices, int count);
+WSMessage* ws_create_market_snapshot_message(const CryptoPrice* price, uint64_t seq);
+WSMessage* ws_create_market_delta_message(const CryptoPrice* prev, const CryptoPrice* price, uint64_t seq);
 WSMessage* ws_create_error_message(const char* error_msg);
 WSMessage* ws_create_status_message(const char* status);
 
@@ -121,6 +247,8 @@ int ws_callback_alerts(struct lws *wsi, enum lws_callback_reasons reason,
 
 // Интеграция с Alert Engine
 void ws_on_alert_triggered(Alert* alert, CryptoPrice* price);
+
+// Рассылка изменившихся с прошлого тика цен подписчикам их символов
 void ws_on_market_data_updated(CryptoPrice* prices, int count);
 
 #endif // WEBSOCKET_SERVER_H
\ No newline at end of file
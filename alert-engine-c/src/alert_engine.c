@@ -2,27 +2,75 @@
 #include "../include/market_client.h"
 #include "../include/websocket_server.h"
 #include "../include/http_server.h"
+#include "../include/portfolio.h"
+#include "../include/alert_expr.h"
+#include "../include/persistence.h"
+#include "../include/alert_snapshot.h"
+#include "../include/price_history.h"
+#include "../include/db_maintenance.h"
+#include "../include/db_schema.h"
+#include "../include/db_shards.h"
+#include "../include/notify_queue.h"
 #include <sqlite3.h>
 #include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
+#include <math.h>
+
+// Колонки алерта в порядке, ожидаемом alert_read_row()
+#define SELECT_ALERT_COLUMNS \
+    "SELECT id, user_id, symbol, type, target_value, status, " \
+    "created_at, last_triggered, trigger_count, message, " \
+    "is_repeatable, cooldown_minutes, required_tier, expression, " \
+    "trigger_mode, hysteresis, activate_at, expires_at, check_at FROM alerts "
+
+// Попыток сменить статус, если его одновременно сменил поток мониторинга
+#define ALERT_COMMIT_RETRIES 3
 
 // Глобальные переменения
 static AlertManager* g_alert_manager = NULL;
 static MarketData* g_market_data = NULL;
-static sqlite3* g_database = NULL;
+static sqlite3* g_databases[DB_MAX_SHARDS] = {NULL};     // Схема и загрузка, по шарду
 static pthread_mutex_t g_alert_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t g_market_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Изменения от пользователя: проверка, запись в журнал, ожидание ее фиксации
+// и применение в памяти идут по одному; g_alert_mutex на время fdatasync
+// отпускается, чтобы не останавливать мониторинг
+static pthread_mutex_t g_mutation_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool g_engine_running = false;
 static pthread_t g_monitor_thread;
+static pthread_mutex_t g_monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_monitor_cond = PTHREAD_COND_INITIALIZER;
+static bool g_monitor_wakeup = false;
 static NotificationCallback g_notification_callback = NULL;
 
 // Внутренние функции
 static int init_database(void);
 static int load_alerts_from_db(void);
-static int save_alert_to_db(Alert* alert);
-static int delete_alert_from_db(int alert_id);
+static int load_portfolios_from_db(void);
+static int alert_write_snapshot(void);
+static void alert_data_path(char* path, size_t size, const char* suffix);
+static int alert_insert(const char* user_id, const char* symbol, AlertType type,
+                        double target_value, const char* expression, UserTier user_tier);
+static CryptoPrice* find_market_price(const char* symbol, void* ctx);
+static bool alert_should_fire(Alert* alert, CryptoPrice* price, bool condition);
+static void alert_activate(Alert* alert, time_t now);
+static void alert_deactivate(Alert* alert);
+static bool cooldown_park(Alert* alert, time_t now);
+static void cooldown_expired(TimerNode* node, void* ctx);
+static Alert* find_alert_by_id(int alert_id);
+static void alert_index_add(int alert_id, int index);
+static void alert_index_clear(void);
+static CryptoPrice* alert_resolve_price(Alert* alert, CryptoPrice* scratch, time_t now);
+static void alert_fire(Alert* alert, CryptoPrice* price, time_t now);
+static int trigger_state_collect(TriggerStateRow** rows);
+static void trigger_state_flush(TriggerStateRow* rows, int count);
+static void alert_schedule_events(Alert* alert);
+static int alert_run_scheduled(time_t now);
 static void* alert_monitor_thread(void* arg);
+static void alert_deliver_notifications(const TriggerNotification* notifications, int count);
+static int alert_commit_status(int alert_id, const char* user_id, int required,
+                               AlertStatus status);
 static void signal_handler(int sig);
 
 /**
@@ -42,6 +90,31 @@ int alert_engine_init(void) {
     g_alert_manager->count = 0;
     g_alert_manager->capacity = MAX_ALERTS_PREMIUM;
     g_alert_manager->last_cleanup = time(NULL);
+    g_alert_manager->active_index = malloc(sizeof(int) * MAX_ALERTS_PREMIUM);
+    g_alert_manager->active_count = 0;
+    g_alert_manager->cooldown_wheel = malloc(sizeof(TimerWheel));
+    g_alert_manager->scheduler = malloc(sizeof(Scheduler));
+    g_alert_manager->dirty_index = malloc(sizeof(int) * MAX_ALERTS_PREMIUM);
+    g_alert_manager->dirty_count = 0;
+    
+    // Таблица id не заполняется больше чем наполовину
+    int id_slots = 1;
+    while (id_slots < MAX_ALERTS_PREMIUM * 2) {
+        id_slots <<= 1;
+    }
+    g_alert_manager->id_index = malloc(sizeof(int) * (size_t)id_slots);
+    g_alert_manager->id_index_mask = id_slots - 1;
+    
+    if (!g_alert_manager->alerts || !g_alert_manager->active_index || 
+        !g_alert_manager->cooldown_wheel || !g_alert_manager->scheduler ||
+        !g_alert_manager->dirty_index || !g_alert_manager->id_index ||
+        scheduler_init(g_alert_manager->scheduler) != 0) {
+        alert_log("ERROR", "Failed to allocate memory for alert storage");
+        return -1;
+    }
+    alert_index_clear();
+    
+    timer_wheel_init(g_alert_manager->cooldown_wheel, time(NULL));
     
     g_market_data = malloc(sizeof(MarketData));
     if (!g_market_data) {
@@ -61,6 +134,36 @@ int alert_engine_init(void) {
         return -1;
     }
     
+    // Поток отложенной записи со своим соединением
+    if (persistence_start() != 0) {
+        alert_log("ERROR", "Failed to start persistence writer");
+        return -1;
+    }
+    
+    // Бэкап и компактизация базы идут в фоне через отдельное соединение
+    if (db_maintenance_start() != 0) {
+        alert_log("WARNING", "Database backups are disabled");
+    }
+    
+    // Журнал срабатываний не обязателен для работы движка
+    char data_dir[300];
+    alert_data_path(data_dir, sizeof(data_dir), TRIGGER_JOURNAL_SUFFIX);
+    if (trigger_journal_open(data_dir) != 0) {
+        alert_log("WARNING", "Trigger history will not be recorded");
+    }
+    
+    // История цен переживает перезапуск, индикаторы не прогреваются заново
+    alert_data_path(data_dir, sizeof(data_dir), PRICE_HISTORY_SUFFIX);
+    if (price_history_open(data_dir) != 0) {
+        alert_log("WARNING", "Price history will not be recorded");
+    }
+    
+    // Инициализация хранилища портфелей
+    if (portfolio_init() != 0) {
+        alert_log("ERROR", "Failed to initialize portfolio store");
+        return -1;
+    }
+    
     // Инициализация market client
     if (market_client_init() != 0) {
         alert_log("ERROR", "Failed to initialize market client");
@@ -73,17 +176,32 @@ int alert_engine_init(void) {
         return -1;
     }
     
+    if (ws_server_start() != 0) {
+        alert_log("ERROR", "Failed to start WebSocket server");
+        return -1;
+    }
+    
     // Инициализация HTTP сервера
     if (http_server_init(HTTP_PORT) != 0) {
         alert_log("ERROR", "Failed to initialize HTTP server");
         return -1;
     }
     
+    // Доставка уведомлений вне мьютексов вычислителя
+    if (notify_queue_start(alert_deliver_notifications) != 0) {
+        alert_log("ERROR", "Failed to start notification delivery");
+        return -1;
+    }
+    
     // Загрузка алертов из базы данных
     if (load_alerts_from_db() != 0) {
         alert_log("WARNING", "Failed to load alerts from database");
     }
     
+    if (load_portfolios_from_db() != 0) {
+        alert_log("WARNING", "Failed to load portfolios from database");
+    }
+    
     // Установка обработчиков сигналов
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -106,17 +224,46 @@ void alert_engine_cleanup(void) {
     alert_log("INFO", "Shutting down Alert Engine...");
     
     g_engine_running = false;
+    alert_engine_wakeup();
     
     // Ждем завершения потока мониторинга
     if (g_monitor_thread) {
         pthread_join(g_monitor_thread, NULL);
     }
     
+    // Доставка уже поставленных уведомлений, пока WebSocket еще работает
+    notify_queue_stop();
+    
+    // Фиксация всех отложенных записей до закрытия базы
+    if (g_alert_manager) {
+        TriggerStateRow* rows = NULL;
+        pthread_mutex_lock(&g_alert_mutex);
+        int count = trigger_state_collect(&rows);
+        pthread_mutex_unlock(&g_alert_mutex);
+        trigger_state_flush(rows, count);
+        alert_write_snapshot();
+    }
+    if (persistence_flush() != 0) {
+        alert_log("ERROR", "Not all alert changes were saved to database");
+    }
+    db_maintenance_stop();
+    persistence_stop();
+    trigger_journal_close();
+    price_history_close();
+    
     // Освобождение памяти
     if (g_alert_manager) {
         if (g_alert_manager->alerts) {
             free(g_alert_manager->alerts);
         }
+        free(g_alert_manager->active_index);
+        free(g_alert_manager->dirty_index);
+        free(g_alert_manager->id_index);
+        free(g_alert_manager->cooldown_wheel);
+        if (g_alert_manager->scheduler) {
+            scheduler_free(g_alert_manager->scheduler);
+            free(g_alert_manager->scheduler);
+        }
         free(g_alert_manager);
         g_alert_manager = NULL;
     }
@@ -130,11 +277,15 @@ void alert_engine_cleanup(void) {
     }
     
     // Закрытие базы данных
-    if (g_database) {
-        sqlite3_close(g_database);
-        g_database = NULL;
+    for (int i = 0; i < DB_MAX_SHARDS; i++) {
+        if (g_databases[i]) {
+            sqlite3_close(g_databases[i]);
+            g_databases[i] = NULL;
+        }
     }
     
+    portfolio_cleanup();
+    
     // Завершение market client
     market_client_cleanup();
     
@@ -152,11 +303,36 @@ void alert_engine_cleanup(void) {
  */
 int alert_create(const char* user_id, const char* symbol, AlertType type, 
                 double target_value, UserTier user_tier) {
-    if (!user_id || !symbol) {
+    if (!user_id || !symbol || type == ALERT_COMPOUND) {
         alert_log("ERROR", "Invalid parameters for alert creation");
         return -1;
     }
     
+    return alert_insert(user_id, symbol, type, target_value, NULL, user_tier);
+}
+
+/**
+ * Создание составного алерта ("BTC > 70000 AND RSI14 < 30")
+ *
+ * Выражение компилируется один раз при создании; поля без символа
+ * (RSI14, PRICE, ...) относятся к первому символу выражения.
+ */
+int alert_create_compound(const char* user_id, const char* expression, UserTier user_tier) {
+    if (!user_id || !expression || strlen(expression) >= MAX_EXPR_LEN) {
+        alert_log("ERROR", "Invalid parameters for compound alert creation");
+        return -1;
+    }
+    
+    return alert_insert(user_id, "", ALERT_COMPOUND, 0.0, expression, user_tier);
+}
+
+/**
+ * Общая часть создания алерта
+ */
+static int alert_insert(const char* user_id, const char* symbol, AlertType type,
+                        double target_value, const char* expression, UserTier user_tier) {
+    
+    pthread_mutex_lock(&g_mutation_mutex);
     pthread_mutex_lock(&g_alert_mutex);
     
     // Проверка лимитов для пользователя
@@ -171,6 +347,7 @@ int alert_create(const char* user_id, const char* symbol, AlertType type,
     int max_alerts = get_max_alerts_for_tier(user_tier);
     if (user_alert_count >= max_alerts) {
         pthread_mutex_unlock(&g_alert_mutex);
+        pthread_mutex_unlock(&g_mutation_mutex);
         alert_log("WARNING", "User alert limit exceeded");
         return -2; // Превышен лимит алертов
     }
@@ -178,12 +355,35 @@ int alert_create(const char* user_id, const char* symbol, AlertType type,
     // Проверка capacity
     if (g_alert_manager->count >= g_alert_manager->capacity) {
         pthread_mutex_unlock(&g_alert_mutex);
+        pthread_mutex_unlock(&g_mutation_mutex);
         alert_log("ERROR", "Alert manager capacity exceeded");
         return -3;
     }
     
-    // Создание нового алерта
-    Alert* alert = &g_alert_manager->alerts[g_alert_manager->count];
+    // Компиляция составного условия
+    int expr_program = -1;
+    char primary_symbol[MAX_SYMBOL_LEN] = "";
+    
+    if (expression) {
+        char error[128] = "";
+        expr_program = expr_compile(expression, NULL, error, sizeof(error));
+        if (expr_program < 0) {
+            pthread_mutex_unlock(&g_alert_mutex);
+            pthread_mutex_unlock(&g_mutation_mutex);
+            
+            char log_msg[256];
+            snprintf(log_msg, sizeof(log_msg), "Invalid alert expression: %s", error);
+            alert_log("WARNING", log_msg);
+            return -5;
+        }
+        strncpy(primary_symbol, expr_primary_symbol(expr_program), sizeof(primary_symbol) - 1);
+        symbol = primary_symbol;
+    }
+    
+    // Создание нового алерта; слот занимается только после фиксации журнала
+    Alert created;
+    Alert* alert = &created;
+    memset(alert, 0, sizeof(Alert));
     alert->id = g_alert_manager->count + 1 + (int)(time(NULL) % 1000);
     strncpy(alert->user_id, user_id, sizeof(alert->user_id) - 1);
     strncpy(alert->symbol, symbol, sizeof(alert->symbol) - 1);
@@ -198,36 +398,135 @@ int alert_create(const char* user_id, const char* symbol, AlertType type,
     alert->is_repeatable = true;
     alert->cooldown_minutes = 60; // По умолчанию 1 час cooldown
     alert->required_tier = user_tier;
+    alert->expr_program = expr_program;
+    alert->trigger_mode = ALERT_TRIGGER_LEVEL;
+    alert->hysteresis = 0.0;
+    alert->last_side = ALERT_SIDE_UNKNOWN;
+    alert->active_pos = -1;
+    timer_node_init(&alert->cooldown_timer);
+    if (expression) {
+        strncpy(alert->expression, expression, sizeof(alert->expression) - 1);
+    }
     
     // Формирование сообщения
-    snprintf(alert->message, sizeof(alert->message), 
-             "Alert: %s %s %.2f", 
-             symbol, 
-             (type == ALERT_PRICE_ABOVE) ? "above" : "below", 
-             target_value);
+    if (type == ALERT_COMPOUND) {
+        snprintf(alert->message, sizeof(alert->message), 
+                 "Alert: %s", expression);
+    } else if (type == ALERT_PORTFOLIO_VALUE) {
+        snprintf(alert->message, sizeof(alert->message), 
+                 "Alert: portfolio value above %.2f", target_value);
+    } else {
+        snprintf(alert->message, sizeof(alert->message), 
+                 "Alert: %s %s %.2f", 
+                 symbol, 
+                 (type == ALERT_PRICE_ABOVE) ? "above" : "below", 
+                 target_value);
+    }
     
-    g_alert_manager->count++;
+    pthread_mutex_unlock(&g_alert_mutex);
     
-    // Сохранение в базу данных
-    int result = save_alert_to_db(alert);
+    // Алерт появляется в памяти только после фиксации журнала на диске;
+    // слот и лимиты не меняются, пока удерживается g_mutation_mutex
+    uint64_t seq = 0;
+    int result = persistence_save_alert(alert, &seq);
+    if (result == 0) {
+        result = persistence_sync(seq);
+    }
     
+    pthread_mutex_lock(&g_alert_mutex);
+    if (result == 0) {
+        alert = &g_alert_manager->alerts[g_alert_manager->count++];
+        *alert = created;
+        alert_index_add(alert->id, g_alert_manager->count - 1);
+        alert_activate(alert, alert->created_at);
+    } else if (expr_program >= 0) {
+        expr_free(expr_program);
+    }
+    int alert_id = created.id;
     pthread_mutex_unlock(&g_alert_mutex);
+    pthread_mutex_unlock(&g_mutation_mutex);
     
     if (result == 0) {
         alert_log("INFO", "Alert created successfully");
         
+        // Новый алерт проверяется сразу, не дожидаясь следующего опроса рынка
+        alert_engine_wakeup();
+        
         // Уведомление через WebSocket
         WSMessage* ws_msg = ws_create_status_message("Alert created");
         ws_send_to_user(user_id, ws_msg);
         ws_free_message(ws_msg);
         
-        return alert->id;
+        return alert_id;
     } else {
         alert_log("ERROR", "Failed to save alert to database");
         return -4;
     }
 }
 
+/**
+ * Смена статуса по запросу пользователя (вызывается под g_mutation_mutex)
+ *
+ * Запись ставится в журнал под g_alert_mutex, ожидание ее фиксации идет без
+ * него, затем статус применяется в памяти. Если за это время статус сменил
+ * поток мониторинга, его запись в журнале позже нашей и побеждает в базе,
+ * поэтому смена повторяется с новой проверки. required < 0 - любой статус.
+ * 0 - применено, -2 - ошибка журнала, -3 - алерт не найден или не в required.
+ */
+static int alert_commit_status(int alert_id, const char* user_id, int required,
+                               AlertStatus status) {
+    for (int attempt = 0; attempt < ALERT_COMMIT_RETRIES; attempt++) {
+        pthread_mutex_lock(&g_alert_mutex);
+        
+        Alert* alert = NULL;
+        for (int i = 0; i < g_alert_manager->count; i++) {
+            Alert* candidate = &g_alert_manager->alerts[i];
+            if (candidate->id == alert_id && strcmp(candidate->user_id, user_id) == 0 &&
+                (required < 0 || candidate->status == (AlertStatus)required)) {
+                alert = candidate;
+                break;
+            }
+        }
+        if (!alert) {
+            pthread_mutex_unlock(&g_alert_mutex);
+            return -3;
+        }
+        
+        AlertStatus observed = alert->status;
+        uint64_t seq = 0;
+        int result = persistence_update_status(user_id, alert_id, status, &seq);
+        pthread_mutex_unlock(&g_alert_mutex);
+        
+        if (result != 0 || persistence_sync(seq) != 0) {
+            return -2;
+        }
+        
+        // Алерты не удаляются из массива, указатель остается действительным
+        pthread_mutex_lock(&g_alert_mutex);
+        bool applied = alert->status == observed;
+        if (applied) {
+            alert->status = status;
+            if (status == ALERT_STATUS_ACTIVE) {
+                alert->last_side = ALERT_SIDE_UNKNOWN;
+                alert_activate(alert, time(NULL));
+            } else {
+                alert_deactivate(alert);
+            }
+            if (status == ALERT_STATUS_INACTIVE && alert->expr_program >= 0) {
+                expr_free(alert->expr_program);
+                alert->expr_program = -1;
+            }
+        }
+        pthread_mutex_unlock(&g_alert_mutex);
+        
+        if (applied) {
+            return 0;
+        }
+    }
+    
+    return -2;
+}
+
 /**
  * Удаление алерта
  */
@@ -236,35 +535,160 @@ int alert_delete(int alert_id, const char* user_id) {
         return -1;
     }
     
-    pthread_mutex_lock(&g_alert_mutex);
+    pthread_mutex_lock(&g_mutation_mutex);
+    int result = alert_commit_status(alert_id, user_id, -1, ALERT_STATUS_INACTIVE);
+    pthread_mutex_unlock(&g_mutation_mutex);
     
-    for (int i = 0; i < g_alert_manager->count; i++) {
-        Alert* alert = &g_alert_manager->alerts[i];
-        if (alert->id == alert_id && strcmp(alert->user_id, user_id) == 0) {
-            alert->status = ALERT_STATUS_INACTIVE;
-            
-            int result = delete_alert_from_db(alert_id);
-            pthread_mutex_unlock(&g_alert_mutex);
-            
-            if (result == 0) {
-                alert_log("INFO", "Alert deleted successfully");
-                
-                // Уведомление через WebSocket
-                WSMessage* ws_msg = ws_create_status_message("Alert deleted");
-                ws_send_to_user(user_id, ws_msg);
-                ws_free_message(ws_msg);
-                
-                return 0;
-            } else {
-                alert_log("ERROR", "Failed to delete alert from database");
-                return -2;
-            }
-        }
+    if (result == -3) {
+        alert_log("WARNING", "Alert not found for deletion");
+        return -3;
+    }
+    if (result != 0) {
+        alert_log("ERROR", "Failed to delete alert from database");
+        return -2;
     }
     
-    pthread_mutex_unlock(&g_alert_mutex);
-    alert_log("WARNING", "Alert not found for deletion");
-    return -3;
+    alert_log("INFO", "Alert deleted successfully");
+    
+    // Уведомление через WebSocket
+    WSMessage* ws_msg = ws_create_status_message("Alert deleted");
+    ws_send_to_user(user_id, ws_msg);
+    ws_free_message(ws_msg);
+    
+    return 0;
+}
+
+/**
+ * Приостановка алерта
+ */
+int alert_pause(int alert_id, const char* user_id) {
+    if (!user_id) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&g_mutation_mutex);
+    int result = alert_commit_status(alert_id, user_id, ALERT_STATUS_ACTIVE, ALERT_STATUS_PAUSED);
+    pthread_mutex_unlock(&g_mutation_mutex);
+    
+    if (result == -3) {
+        alert_log("WARNING", "Alert not found for pause");
+        return -3;
+    }
+    if (result != 0) {
+        alert_log("ERROR", "Failed to pause alert in database");
+        return -2;
+    }
+    
+    WSMessage* ws_msg = ws_create_status_message("Alert paused");
+    ws_send_to_user(user_id, ws_msg);
+    ws_free_message(ws_msg);
+    
+    return 0;
+}
+
+/**
+ * Возобновление алерта
+ */
+int alert_resume(int alert_id, const char* user_id) {
+    if (!user_id) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&g_mutation_mutex);
+    int result = alert_commit_status(alert_id, user_id, ALERT_STATUS_PAUSED, ALERT_STATUS_ACTIVE);
+    pthread_mutex_unlock(&g_mutation_mutex);
+    
+    if (result == -3) {
+        alert_log("WARNING", "Alert not found for resume");
+        return -3;
+    }
+    if (result != 0) {
+        alert_log("ERROR", "Failed to resume alert in database");
+        return -2;
+    }
+    
+    WSMessage* ws_msg = ws_create_status_message("Alert resumed");
+    ws_send_to_user(user_id, ws_msg);
+    ws_free_message(ws_msg);
+    
+    return 0;
+}
+
+/**
+ * Добавление алерта в набор проверяемых (вызывается под g_alert_mutex)
+ */
+static void active_set_add(Alert* alert) {
+    if (alert->active_pos >= 0) {
+        return;
+    }
+    
+    alert->active_pos = g_alert_manager->active_count;
+    g_alert_manager->active_index[g_alert_manager->active_count++] = 
+        (int)(alert - g_alert_manager->alerts);
+}
+
+/**
+ * Удаление алерта из набора проверяемых, O(1) через swap с последним
+ */
+static void active_set_remove(Alert* alert) {
+    int pos = alert->active_pos;
+    if (pos < 0) {
+        return;
+    }
+    
+    int last = g_alert_manager->active_index[--g_alert_manager->active_count];
+    g_alert_manager->active_index[pos] = last;
+    g_alert_manager->alerts[last].active_pos = pos;
+    alert->active_pos = -1;
+}
+
+/**
+ * Парковка алерта в колесе cooldown
+ *
+ * Возвращает true, если алерт убран из набора проверяемых до истечения cooldown.
+ */
+static bool cooldown_park(Alert* alert, time_t now) {
+    if (alert->last_triggered <= 0 || alert->cooldown_minutes <= 0) {
+        return false;
+    }
+    
+    time_t expires = alert->last_triggered + (time_t)alert->cooldown_minutes * 60;
+    if (expires <= now) {
+        return false;
+    }
+    
+    active_set_remove(alert);
+    timer_wheel_add(g_alert_manager->cooldown_wheel, &alert->cooldown_timer, expires);
+    return true;
+}
+
+/**
+ * Истечение cooldown: алерт возвращается в набор проверяемых
+ */
+static void cooldown_expired(TimerNode* node, void* ctx) {
+    (void)ctx;
+    
+    Alert* alert = TIMER_NODE_OWNER(node, Alert, cooldown_timer);
+    if (alert->status == ALERT_STATUS_ACTIVE) {
+        active_set_add(alert);
+    }
+}
+
+/**
+ * Включение алерта в проверку (или в колесо, если он еще в cooldown)
+ */
+static void alert_activate(Alert* alert, time_t now) {
+    if (!cooldown_park(alert, now)) {
+        active_set_add(alert);
+    }
+}
+
+/**
+ * Исключение алерта из проверки и из колеса cooldown
+ */
+static void alert_deactivate(Alert* alert) {
+    active_set_remove(alert);
+    timer_wheel_remove(g_alert_manager->cooldown_wheel, &alert->cooldown_timer);
 }
 
 /**
@@ -281,57 +705,156 @@ int alert_check_all(void) {
     int triggered_count = 0;
     time_t current_time = time(NULL);
     
-    for (int i = 0; i < g_alert_manager->count; i++) {
-        Alert* alert = &g_alert_manager->alerts[i];
-        
-        if (alert->status != ALERT_STATUS_ACTIVE) {
-            continue;
-        }
-        
-        // Проверка cooldown
-        if (alert->last_triggered > 0) {
-            time_t cooldown_seconds = alert->cooldown_minutes * 60;
-            if (current_time - alert->last_triggered < cooldown_seconds) {
-                continue;
-            }
-        }
+    // Алерты с истекшим cooldown возвращаются в набор проверяемых
+    timer_wheel_advance(g_alert_manager->cooldown_wheel, current_time, cooldown_expired, NULL);
+    
+    // Новый тик: операнды составных условий вычисляются не более одного раза
+    expr_begin_tick(find_market_price, NULL);
+    
+    // Проверяются только активные алерты вне cooldown
+    for (int k = 0; k < g_alert_manager->active_count; k++) {
+        Alert* alert = &g_alert_manager->alerts[g_alert_manager->active_index[k]];
         
         // Поиск данных о цене
-        CryptoPrice* price = NULL;
-        for (int j = 0; j < g_market_data->count; j++) {
-            if (strcmp(g_market_data->prices[j].symbol, alert->symbol) == 0) {
-                price = &g_market_data->prices[j];
-                break;
-            }
-        }
+        CryptoPrice portfolio_price;
+        CryptoPrice* price = alert_resolve_price(alert, &portfolio_price, current_time);
         
         if (!price || !price->is_valid) {
             continue;
         }
         
-        // Проверка условия
-        if (alert_check_condition(alert, price)) {
-            alert->last_triggered = current_time;
-            alert->trigger_count++;
-            alert->current_value = price->current_price;
-            
-            // Отправка уведомления
-            alert_send_notification(alert, price);
-            
+        // Проверка условия (для CROSS - только на переходе через уровень)
+        bool condition = alert_check_condition(alert, price);
+        if (alert_should_fire(alert, price, condition)) {
+            alert_fire(alert, price, current_time);
             triggered_count++;
             
-            alert_log("INFO", "Alert triggered");
+            // Алерт уходит в cooldown; на позицию k встал еще не проверенный алерт
+            alert->last_checked = current_time;
+            if (cooldown_park(alert, current_time)) {
+                k--;
+            }
+            continue;
         }
         
         alert->last_checked = current_time;
     }
     
+    // Все срабатывания тика (и разовых проверок перед ним) - одной операцией
+    // записи, которая ставится в очередь уже без мьютексов
+    TriggerStateRow* rows = NULL;
+    int row_count = trigger_state_collect(&rows);
+    
     pthread_mutex_unlock(&g_market_mutex);
     pthread_mutex_unlock(&g_alert_mutex);
     
+    trigger_state_flush(rows, row_count);
+    
+    // Уведомления тика уходят одной пачкой
+    notify_queue_end_batch();
+    
     return triggered_count;
 }
 
+/**
+ * Данные, с которыми сравнивается алерт (вызывается под g_market_mutex)
+ */
+static CryptoPrice* alert_resolve_price(Alert* alert, CryptoPrice* scratch, time_t now) {
+    if (alert->type == ALERT_PORTFOLIO_VALUE) {
+        // Для портфельных алертов "ценой" служит стоимость портфеля
+        memset(scratch, 0, sizeof(CryptoPrice));
+        strncpy(scratch->symbol, alert->symbol, sizeof(scratch->symbol) - 1);
+        scratch->is_valid = portfolio_get_value(alert->user_id, &scratch->current_price);
+        scratch->last_updated = now;
+        return scratch;
+    }
+    
+    return find_market_price(alert->symbol, NULL);
+}
+
+/**
+ * Срабатывание алерта
+ */
+static void alert_fire(Alert* alert, CryptoPrice* price, time_t now) {
+    alert->last_triggered = now;
+    alert->trigger_count++;
+    alert->current_value = price->current_price;
+    
+    // Повторные срабатывания до сброса на диск не добавляют записей
+    if (!alert->state_dirty) {
+        alert->state_dirty = true;
+        g_alert_manager->dirty_index[g_alert_manager->dirty_count++] = 
+            (int)(alert - g_alert_manager->alerts);
+    }
+    
+    // Журнал срабатываний и лог пишет поток доставки
+    alert_send_notification(alert, price);
+}
+
+/**
+ * Снятие состояния срабатывания измененных алертов (вызывается под g_alert_mutex)
+ *
+ * Возвращает число строк в *rows; при нехватке памяти алерты остаются
+ * помеченными до следующего тика.
+ */
+static int trigger_state_collect(TriggerStateRow** rows) {
+    int count = g_alert_manager->dirty_count;
+    *rows = NULL;
+    if (count == 0) {
+        return 0;
+    }
+    
+    *rows = malloc(sizeof(TriggerStateRow) * (size_t)count);
+    if (!*rows) {
+        alert_log("ERROR", "Failed to allocate trigger state batch");
+        return 0;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        Alert* alert = &g_alert_manager->alerts[g_alert_manager->dirty_index[i]];
+        alert->state_dirty = false;
+        
+        (*rows)[i].alert_id = alert->id;
+        (*rows)[i].last_triggered = alert->last_triggered;
+        (*rows)[i].trigger_count = alert->trigger_count;
+        (*rows)[i].shard = db_shard_for_user(alert->user_id);
+    }
+    g_alert_manager->dirty_count = 0;
+    return count;
+}
+
+/**
+ * Постановка снятого состояния в очередь записи (вызывается без мьютексов)
+ *
+ * Строки содержат абсолютные значения, поэтому пачка, не попавшая в журнал
+ * операций, снова помечается и повторяется следующим тиком с текущими
+ * значениями.
+ */
+static void trigger_state_flush(TriggerStateRow* rows, int count) {
+    if (count == 0) {
+        return;
+    }
+    
+    if (persistence_update_trigger_state(rows, count) != 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), 
+                 "Failed to log trigger state of %d alerts, will retry", count);
+        alert_log("ERROR", log_msg);
+        
+        pthread_mutex_lock(&g_alert_mutex);
+        for (int i = 0; i < count; i++) {
+            Alert* alert = find_alert_by_id(rows[i].alert_id);
+            if (alert && !alert->state_dirty) {
+                alert->state_dirty = true;
+                g_alert_manager->dirty_index[g_alert_manager->dirty_count++] = 
+                    (int)(alert - g_alert_manager->alerts);
+            }
+        }
+        pthread_mutex_unlock(&g_alert_mutex);
+    }
+    free(rows);
+}
+
 /**
  * Проверка условия алерта
  */
@@ -360,19 +883,156 @@ bool alert_check_condition(Alert* alert, CryptoPrice* price) {
         case ALERT_RSI_OVERBOUGHT:
             return price->rsi_14 >= alert->target_value;
             
+        case ALERT_PORTFOLIO_VALUE:
+            // Стоимость портфеля уже подставлена в price (alert_resolve_price)
+            return price->current_price >= alert->target_value;
+            
+        case ALERT_COMPOUND:
+            return expr_eval(alert->expr_program) == 1;
+            
         default:
             return false;
     }
 }
 
 /**
- * Обновление рыночных данных
+ * Наблюдаемое значение, с которым сравнивается target_value
  */
-int market_data_update(void) {
-    if (!g_market_data) {
-        return -1;
+static bool alert_observed_value(Alert* alert, CryptoPrice* price, double* value) {
+    switch (alert->type) {
+        case ALERT_PRICE_ABOVE:
+        case ALERT_PRICE_BELOW:
+        case ALERT_PORTFOLIO_VALUE:
+            *value = price->current_price;
+            return true;
+        case ALERT_PRICE_CHANGE_PERCENT:
+            *value = fabs(price->price_change_percent_24h);
+            return true;
+        case ALERT_VOLUME_SPIKE:
+            *value = price->volume_24h;
+            return true;
+        case ALERT_RSI_OVERSOLD:
+        case ALERT_RSI_OVERBOUGHT:
+            *value = price->rsi_14;
+            return true;
+        default:
+            return false;
     }
-    
+}
+
+/**
+ * Вышло ли значение за полосу гистерезиса обратно (алерт можно взвести снова)
+ */
+static bool alert_is_rearmed(Alert* alert, CryptoPrice* price, bool condition) {
+    double value;
+    if (alert->hysteresis <= 0.0 || !alert_observed_value(alert, price, &value)) {
+        return !condition;
+    }
+    
+    switch (alert->type) {
+        case ALERT_PRICE_BELOW:
+        case ALERT_RSI_OVERSOLD:
+            return value > alert->target_value + alert->hysteresis;
+        default:
+            return value < alert->target_value - alert->hysteresis;
+    }
+}
+
+/**
+ * Решение о срабатывании с учетом режима и сохраненной стороны уровня
+ *
+ * В режиме CROSS алерт срабатывает только при переходе OUTSIDE -> INSIDE
+ * и взводится снова, лишь когда значение уходит за полосу гистерезиса,
+ * поэтому цена, стоящая выше цели, не генерирует уведомления каждый тик.
+ */
+static bool alert_should_fire(Alert* alert, CryptoPrice* price, bool condition) {
+    if (alert->trigger_mode != ALERT_TRIGGER_CROSS) {
+        return condition;
+    }
+    
+    AlertSide previous = alert->last_side;
+    
+    if (previous == ALERT_SIDE_INSIDE) {
+        if (alert_is_rearmed(alert, price, condition)) {
+            alert->last_side = ALERT_SIDE_OUTSIDE;
+        }
+        return false;
+    }
+    
+    alert->last_side = condition ? ALERT_SIDE_INSIDE : ALERT_SIDE_OUTSIDE;
+    
+    // Первая проверка только фиксирует сторону: пересечения еще не было
+    return condition && previous == ALERT_SIDE_OUTSIDE;
+}
+
+/**
+ * Изменение режима срабатывания алерта
+ */
+int alert_set_trigger_mode(int alert_id, const char* user_id, 
+                          AlertTriggerMode mode, double hysteresis) {
+    if (!user_id || hysteresis < 0.0 ||
+        (mode != ALERT_TRIGGER_LEVEL && mode != ALERT_TRIGGER_CROSS)) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&g_mutation_mutex);
+    pthread_mutex_lock(&g_alert_mutex);
+    
+    for (int i = 0; i < g_alert_manager->count; i++) {
+        Alert* alert = &g_alert_manager->alerts[i];
+        if (alert->id == alert_id && strcmp(alert->user_id, user_id) == 0 &&
+            alert->status != ALERT_STATUS_INACTIVE) {
+            uint64_t seq = 0;
+            int result = persistence_update_trigger_mode(user_id, alert->id, mode, hysteresis, &seq);
+            pthread_mutex_unlock(&g_alert_mutex);
+            
+            // Режим меняется в памяти только после фиксации журнала;
+            // поток мониторинга эти поля не меняет
+            if (result == 0) {
+                result = persistence_sync(seq);
+            }
+            if (result == 0) {
+                pthread_mutex_lock(&g_alert_mutex);
+                alert->trigger_mode = mode;
+                alert->hysteresis = hysteresis;
+                alert->last_side = ALERT_SIDE_UNKNOWN;
+                pthread_mutex_unlock(&g_alert_mutex);
+            }
+            pthread_mutex_unlock(&g_mutation_mutex);
+            
+            return result == 0 ? 0 : -2;
+        }
+    }
+    
+    pthread_mutex_unlock(&g_alert_mutex);
+    pthread_mutex_unlock(&g_mutation_mutex);
+    alert_log("WARNING", "Alert not found for trigger mode change");
+    return -3;
+}
+
+/**
+ * Поиск рыночных данных по символу (вызывается под g_market_mutex)
+ */
+static CryptoPrice* find_market_price(const char* symbol, void* ctx) {
+    (void)ctx;
+    
+    for (int i = 0; i < g_market_data->count; i++) {
+        if (strcmp(g_market_data->prices[i].symbol, symbol) == 0) {
+            return &g_market_data->prices[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Обновление рыночных данных
+ */
+int market_data_update(void) {
+    if (!g_market_data) {
+        return -1;
+    }
+    
     pthread_mutex_lock(&g_market_mutex);
     
     // Проверка времени последнего обновления
@@ -406,33 +1066,68 @@ int market_data_update(void) {
     // Выполняем запрос к API
     APIResponse* response = fetch_market_data(symbols_list);
     
-    pthread_mutex_lock(&g_market_mutex);
+    // Разбор, запись истории и RSI идут без g_market_mutex: проверка
+    // алертов и события планировщика не ждут диска и декодирования истории
+    CryptoPrice* parsed = NULL;
+    int parsed_count = 0;
     
     if (response && response->success) {
-        // Парсим ответ
-        int parsed_count = parse_market_data_response(response, g_market_data->prices, g_market_data->capacity);
+        parsed = malloc(sizeof(CryptoPrice) * (size_t)g_market_data->capacity);
+        if (parsed) {
+            parsed_count = parse_market_data_response(response, parsed, g_market_data->capacity);
+        }
         
-        if (parsed_count > 0) {
-            g_market_data->count = parsed_count;
-            g_market_data->last_update = current_time;
-            
-            alert_log("INFO", "Market data updated successfully");
+        for (int i = 0; i < parsed_count; i++) {
+            CryptoPrice* price = &parsed[i];
+            if (!price->is_valid) {
+                continue;
+            }
             
-            // Уведомление через WebSocket о обновлении данных
-            WSMessage* ws_msg = ws_create_market_update_message(g_market_data->prices, g_market_data->count);
-            ws_broadcast_message(ws_msg);
-            ws_free_message(ws_msg);
-        } else {
-            alert_log("ERROR", "Failed to parse market data response");
+            // История цен и RSI с учетом новой точки
+            price_history_append(price->symbol, price->last_updated, price->current_price);
+            double rsi = calculate_rsi_for_symbol(price->symbol, 14);
+            if (rsi >= 0.0) {
+                price->rsi_14 = rsi;
+            }
         }
+    }
+    
+    pthread_mutex_lock(&g_market_mutex);
+    
+    if (parsed_count > 0) {
+        memcpy(g_market_data->prices, parsed, sizeof(CryptoPrice) * (size_t)parsed_count);
+        g_market_data->count = parsed_count;
+        g_market_data->last_update = current_time;
+        
+        // Инкрементальная переоценка портфелей по изменившимся ценам
+        for (int i = 0; i < parsed_count; i++) {
+            CryptoPrice* price = &g_market_data->prices[i];
+            if (price->is_valid) {
+                portfolio_on_price_update(price->symbol, price->current_price);
+            }
+        }
+        
+        alert_log("INFO", "Market data updated successfully");
+    } else if (response && response->success) {
+        alert_log("ERROR", "Failed to parse market data response");
     } else {
         alert_log("ERROR", "Failed to fetch market data");
     }
     
-    g_market_data->is_updating = false;
+    pthread_mutex_unlock(&g_market_mutex);
+    
+    // Изменившиеся цены подписчикам их символов - из копии тика, без
+    // g_market_mutex; is_updating снимается после рассылки, чтобы версии
+    // тем не обгоняли друг друга
+    if (parsed_count > 0) {
+        ws_on_market_data_updated(parsed, parsed_count);
+    }
     
+    pthread_mutex_lock(&g_market_mutex);
+    g_market_data->is_updating = false;
     pthread_mutex_unlock(&g_market_mutex);
     
+    free(parsed);
     if (response) {
         free_api_response(response);
     }
@@ -446,20 +1141,61 @@ int market_data_update(void) {
 static void* alert_monitor_thread(void* arg) {
     alert_log("INFO", "Alert monitor thread started");
     
+    time_t next_market_poll = 0;
+    time_t next_snapshot = time(NULL) + ALERT_SNAPSHOT_INTERVAL;
+    
     while (g_engine_running) {
+        time_t now = time(NULL);
+        
         // Обновление рыночных данных
-        market_data_update();
+        if (now >= next_market_poll) {
+            market_data_update();
+            next_market_poll = now + API_UPDATE_INTERVAL;
+        }
+        
+        // События по времени: активация, истечение, разовые проверки
+        int scheduled = alert_run_scheduled(now);
         
         // Проверка алертов
         int triggered = alert_check_all();
-        if (triggered > 0) {
+        if (triggered + scheduled > 0) {
             char log_msg[256];
-            snprintf(log_msg, sizeof(log_msg), "Triggered %d alerts", triggered);
+            snprintf(log_msg, sizeof(log_msg), "Triggered %d alerts, %d scheduled events", 
+                     triggered, scheduled);
             alert_log("INFO", log_msg);
         }
         
-        // Пауза между проверками
-        sleep(API_UPDATE_INTERVAL);
+        // Периодический снимок ускоряет следующий запуск; заодно удаляются
+        // сегменты журнала операций, уже примененные к базе
+        if (now >= next_snapshot) {
+            alert_write_snapshot();
+            persistence_checkpoint();
+            next_snapshot = now + ALERT_SNAPSHOT_INTERVAL;
+        }
+        
+        // Сон до ближайшего deadline или до прихода новых данных
+        time_t wake_at = next_market_poll;
+        
+        pthread_mutex_lock(&g_alert_mutex);
+        time_t next_event = scheduler_next_deadline(g_alert_manager->scheduler);
+        pthread_mutex_unlock(&g_alert_mutex);
+        
+        if (next_event > 0 && next_event < wake_at) {
+            // Уже наступившим остается только событие, не записанное в журнал
+            // операций; повтор не чаще раза в секунду
+            wake_at = next_event > now ? next_event : now + 1;
+        }
+        
+        struct timespec deadline = { .tv_sec = wake_at, .tv_nsec = 0 };
+        
+        pthread_mutex_lock(&g_monitor_mutex);
+        while (g_engine_running && !g_monitor_wakeup && time(NULL) < wake_at) {
+            if (pthread_cond_timedwait(&g_monitor_cond, &g_monitor_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        g_monitor_wakeup = false;
+        pthread_mutex_unlock(&g_monitor_mutex);
     }
     
     alert_log("INFO", "Alert monitor thread stopped");
@@ -467,71 +1203,551 @@ static void* alert_monitor_thread(void* arg) {
 }
 
 /**
- * Инициализация базы данных
+ * Пробуждение потока мониторинга (новые данные или новый deadline)
  */
-static int init_database(void) {
-    int rc = sqlite3_open("alerts.db", &g_database);
+void alert_engine_wakeup(void) {
+    pthread_mutex_lock(&g_monitor_mutex);
+    g_monitor_wakeup = true;
+    pthread_cond_signal(&g_monitor_cond);
+    pthread_mutex_unlock(&g_monitor_mutex);
+}
+
+/**
+ * Назначение алерту событий по времени
+ *
+ * activate_at - отложенная активация, expires_at - срок действия,
+ * check_at - разовая проверка условия (алерт не проверяется на каждом тике).
+ * Нулевое значение отключает соответствующее событие.
+ */
+int alert_schedule(int alert_id, const char* user_id, 
+                  time_t activate_at, time_t expires_at, time_t check_at) {
+    if (!user_id || activate_at < 0 || expires_at < 0 || check_at < 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&g_mutation_mutex);
+    pthread_mutex_lock(&g_alert_mutex);
+    
+    Alert* alert = find_alert_by_id(alert_id);
+    if (!alert || strcmp(alert->user_id, user_id) != 0 || 
+        alert->status == ALERT_STATUS_INACTIVE) {
+        pthread_mutex_unlock(&g_alert_mutex);
+        pthread_mutex_unlock(&g_mutation_mutex);
+        alert_log("WARNING", "Alert not found for scheduling");
+        return -3;
+    }
+    
+    // Программа отработавшего разового алерта освобождена; компилируется заново
+    if (alert->type == ALERT_COMPOUND && alert->expr_program < 0) {
+        alert->expr_program = expr_compile(alert->expression, NULL, NULL, 0);
+        if (alert->expr_program < 0) {
+            pthread_mutex_unlock(&g_alert_mutex);
+            pthread_mutex_unlock(&g_mutation_mutex);
+            alert_log("WARNING", "Cannot reschedule compound alert with invalid expression");
+            return -1;
+        }
+    }
+    
+    // Ожидающий активации или разовой проверки алерт не участвует в тиках
+    time_t now = time(NULL);
+    AlertStatus observed = alert->status;
+    AlertStatus status = observed;
+    if ((activate_at > now || check_at > 0) && observed != ALERT_STATUS_PAUSED) {
+        status = ALERT_STATUS_SCHEDULED;
+    } else if (observed == ALERT_STATUS_SCHEDULED) {
+        status = ALERT_STATUS_ACTIVE;
+    }
+    
+    uint64_t seq = 0;
+    int result = persistence_update_schedule(user_id, alert->id, status, activate_at,
+                                             expires_at, check_at, &seq);
+    pthread_mutex_unlock(&g_alert_mutex);
+    
+    if (result == 0) {
+        result = persistence_sync(seq);
+    }
+    if (result != 0) {
+        pthread_mutex_unlock(&g_mutation_mutex);
+        return -2;
+    }
+    
+    // Сроки применяются после фиксации журнала; статус - только если его
+    // не сменил поток мониторинга, чья запись в журнале позже нашей
+    pthread_mutex_lock(&g_alert_mutex);
+    alert->activate_at = activate_at;
+    alert->expires_at = expires_at;
+    alert->check_at = check_at;
+    
+    if (alert->status == observed && status != observed) {
+        alert->status = status;
+        if (status == ALERT_STATUS_SCHEDULED) {
+            alert_deactivate(alert);
+        } else {
+            alert_activate(alert, now);
+        }
+    }
+    
+    alert_schedule_events(alert);
+    pthread_mutex_unlock(&g_alert_mutex);
+    pthread_mutex_unlock(&g_mutation_mutex);
+    
+    alert_engine_wakeup();
+    
+    return 0;
+}
+
+/**
+ * Поиск алерта по id (вызывается под g_alert_mutex)
+ */
+static Alert* find_alert_by_id(int alert_id) {
+    int mask = g_alert_manager->id_index_mask;
+    for (int slot = (int)(((uint32_t)alert_id * 2654435761u) & (uint32_t)mask); ; 
+         slot = (slot + 1) & mask) {
+        int index = g_alert_manager->id_index[slot];
+        if (index < 0) {
+            return NULL;
+        }
+        if (g_alert_manager->alerts[index].id == alert_id) {
+            return &g_alert_manager->alerts[index];
+        }
+    }
+}
+
+/**
+ * Добавление алерта в таблицу id (вызывается под g_alert_mutex). Алерты не
+ * удаляются из массива, поэтому записи таблицы тоже не удаляются.
+ */
+static void alert_index_add(int alert_id, int index) {
+    int mask = g_alert_manager->id_index_mask;
+    int slot = (int)(((uint32_t)alert_id * 2654435761u) & (uint32_t)mask);
+    while (g_alert_manager->id_index[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    g_alert_manager->id_index[slot] = index;
+}
+
+static void alert_index_clear(void) {
+    memset(g_alert_manager->id_index, 0xff, 
+           sizeof(int) * (size_t)(g_alert_manager->id_index_mask + 1));
+}
+
+/**
+ * Постановка событий алерта в планировщик
+ */
+static void alert_schedule_events(Alert* alert) {
+    if (alert->status == ALERT_STATUS_SCHEDULED && alert->activate_at > 0 && alert->check_at == 0) {
+        scheduler_push(g_alert_manager->scheduler, alert->activate_at, SCHED_ALERT_ACTIVATE, alert->id);
+    }
+    if (alert->status == ALERT_STATUS_SCHEDULED && alert->check_at > 0) {
+        scheduler_push(g_alert_manager->scheduler, alert->check_at, SCHED_ALERT_CHECK, alert->id);
+    }
+    if (alert->expires_at > 0) {
+        scheduler_push(g_alert_manager->scheduler, alert->expires_at, SCHED_ALERT_EXPIRE, alert->id);
+    }
+}
+
+/**
+ * Обработка наступивших событий планировщика
+ *
+ * События не отменяются при изменении алерта; устаревшие отбрасываются
+ * сравнением deadline с текущими полями алерта.
+ */
+static int alert_run_scheduled(time_t now) {
+    if (!g_alert_manager || !g_market_data) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&g_alert_mutex);
+    pthread_mutex_lock(&g_market_mutex);
+    
+    expr_begin_tick(find_market_price, NULL);
+    
+    int processed = 0;
+    int fired_count = 0;
+    ScheduledEvent event;
+    bool retry = false;
+    
+    while (scheduler_pop_due(g_alert_manager->scheduler, now, &event)) {
+        Alert* alert = find_alert_by_id(event.alert_id);
+        if (!alert || alert->status == ALERT_STATUS_INACTIVE) {
+            continue;
+        }
+        
+        // Сначала определяется итоговый статус, алерт пока не меняется
+        AlertStatus new_status;
+        CryptoPrice scratch;
+        CryptoPrice* price = NULL;
+        bool fired = false;
+        
+        switch (event.type) {
+            case SCHED_ALERT_ACTIVATE:
+                if (alert->status != ALERT_STATUS_SCHEDULED || alert->activate_at != event.deadline) {
+                    continue;
+                }
+                new_status = ALERT_STATUS_ACTIVE;
+                break;
+                
+            case SCHED_ALERT_EXPIRE:
+                // Отработавший или уже истекший алерт остается в своем статусе
+                if (alert->expires_at != event.deadline || 
+                    alert->status == ALERT_STATUS_TRIGGERED || 
+                    alert->status == ALERT_STATUS_EXPIRED) {
+                    continue;
+                }
+                new_status = ALERT_STATUS_EXPIRED;
+                break;
+                
+            case SCHED_ALERT_CHECK:
+                if (alert->status != ALERT_STATUS_SCHEDULED || alert->check_at != event.deadline) {
+                    continue;
+                }
+                price = alert_resolve_price(alert, &scratch, now);
+                fired = price && price->is_valid && alert_check_condition(alert, price);
+                new_status = fired ? ALERT_STATUS_TRIGGERED : ALERT_STATUS_EXPIRED;
+                break;
+                
+            default:
+                continue;
+        }
+        
+        // Изменение применяется только после записи в журнал операций;
+        // при ошибке событие возвращается в планировщик, а остальные
+        // наступившие события ждут следующего прохода
+        if (persistence_update_status(alert->user_id, alert->id, new_status, NULL) != 0) {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), 
+                     "Failed to log scheduled status change of alert %d, will retry", alert->id);
+            alert_log("ERROR", log_msg);
+            retry = true;
+            break;
+        }
+        
+        switch (event.type) {
+            case SCHED_ALERT_ACTIVATE:
+                alert->status = new_status;
+                alert->last_side = ALERT_SIDE_UNKNOWN;
+                alert_activate(alert, now);
+                break;
+                
+            case SCHED_ALERT_EXPIRE:
+                alert->status = new_status;
+                alert_deactivate(alert);
+                alert_log("INFO", "Alert expired");
+                break;
+                
+            case SCHED_ALERT_CHECK:
+                if (fired) {
+                    alert_fire(alert, price, now);
+                    fired_count++;
+                }
+                alert->last_checked = now;
+                alert->status = new_status;
+                break;
+        }
+        
+        // Истекший или отработавший разовую проверку алерт больше не вычисляется
+        if (alert->status != ALERT_STATUS_ACTIVE && alert->expr_program >= 0) {
+            expr_free(alert->expr_program);
+            alert->expr_program = -1;
+        }
+        processed++;
+    }
+    
+    if (retry) {
+        scheduler_push(g_alert_manager->scheduler, event.deadline, event.type, event.alert_id);
+    }
+    
+    pthread_mutex_unlock(&g_market_mutex);
+    pthread_mutex_unlock(&g_alert_mutex);
+    
+    // Разовые проверки не ждут конца тика alert_check_all
+    if (fired_count > 0) {
+        notify_queue_end_batch();
+    }
+    
+    return processed;
+}
+
+/**
+ * Открытие и миграция одного шарда базы
+ */
+static int init_shard_database(const char* path, sqlite3** out) {
+    sqlite3* db = NULL;
+    int rc = sqlite3_open(path, &db);
     if (rc) {
         alert_log("ERROR", "Cannot open database");
+        sqlite3_close(db);
+        return -1;
+    }
+    *out = db;
+    
+    // WAL: читатели не блокируют писателя, fsync только на checkpoint
+    sqlite3_busy_timeout(db, 5000);
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL", 0, 0, NULL);
+    sqlite3_exec(db, "PRAGMA synchronous=NORMAL", 0, 0, NULL);
+    sqlite3_exec(db, "PRAGMA cache_size=-8192", 0, 0, NULL);
+    sqlite3_exec(db, "PRAGMA temp_store=MEMORY", 0, 0, NULL);
+
+    // Incremental vacuum для фоновой компактизации; существующая база
+    // переводится в этот режим однократным VACUUM
+    sqlite3_stmt* vacuum_stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA auto_vacuum", -1, &vacuum_stmt, NULL) == SQLITE_OK) {
+        int auto_vacuum = 0;
+        if (sqlite3_step(vacuum_stmt) == SQLITE_ROW) {
+            auto_vacuum = sqlite3_column_int(vacuum_stmt, 0);
+        }
+        sqlite3_finalize(vacuum_stmt);
+
+        if (auto_vacuum != 2) {
+            sqlite3_exec(db, "PRAGMA auto_vacuum=INCREMENTAL", 0, 0, NULL);
+            if (sqlite3_exec(db, "VACUUM", 0, 0, NULL) != SQLITE_OK) {
+                alert_log("WARNING", "Failed to enable incremental vacuum");
+            }
+        }
+    }
+
+    // Таблицы и индексы создаются версионными миграциями
+    if (db_schema_migrate(db) != 0) {
         return -1;
     }
     
-    // Создание таблицы алертов
-    const char* create_table_sql = 
-        "CREATE TABLE IF NOT EXISTS alerts ("
-        "id INTEGER PRIMARY KEY,"
-        "user_id TEXT NOT NULL,"
-        "symbol TEXT NOT NULL,"
-        "type INTEGER NOT NULL,"
-        "target_value REAL NOT NULL,"
-        "status INTEGER NOT NULL,"
-        "created_at INTEGER NOT NULL,"
-        "last_triggered INTEGER,"
-        "trigger_count INTEGER DEFAULT 0,"
-        "message TEXT,"
-        "is_repeatable INTEGER DEFAULT 1,"
-        "cooldown_minutes INTEGER DEFAULT 60,"
-        "required_tier INTEGER DEFAULT 0"
-        ");";
-    
-    char* err_msg = 0;
-    rc = sqlite3_exec(g_database, create_table_sql, 0, 0, &err_msg);
-    if (rc != SQLITE_OK) {
-        alert_log("ERROR", "SQL error");
-        sqlite3_free(err_msg);
+    return 0;
+}
+
+/**
+ * Инициализация базы данных: пути шардов из конфигурации, затем каждый шард
+ */
+static int init_database(void) {
+    if (db_shards_init() != 0) {
         return -1;
     }
     
+    for (int i = 0; i < db_shard_count(); i++) {
+        if (init_shard_database(db_shard_path(i), &g_databases[i]) != 0) {
+            return -1;
+        }
+    }
+    
     return 0;
 }
 
 /**
  * Отправка уведомления
+ *
+ * Вызывается под мьютексами вычислителя, поэтому только копирует данные
+ * срабатывания в очередь; сообщения собирает поток доставки. До запуска
+ * очереди уведомление доставляется сразу.
  */
 void alert_send_notification(Alert* alert, CryptoPrice* price) {
     if (!alert || !price) {
         return;
     }
     
-    // Callback функция
-    if (g_notification_callback) {
-        g_notification_callback(alert, price);
+    TriggerNotification notification;
+    notification.alert_id = alert->id;
+    notification.type = alert->type;
+    notification.trigger_mode = alert->trigger_mode;
+    notification.target_value = alert->target_value;
+    notification.trigger_count = alert->trigger_count;
+    notification.triggered_at = alert->last_triggered;
+    memcpy(notification.user_id, alert->user_id, sizeof(notification.user_id));
+    memcpy(notification.symbol, alert->symbol, sizeof(notification.symbol));
+    memcpy(notification.message, alert->message, sizeof(notification.message));
+    notification.price = *price;
+    
+    if (notify_queue_push(&notification) == -1) {
+        alert_deliver_notifications(&notification, 1);
+    }
+}
+
+/**
+ * Копия алерта с полями срабатывания для callback и сообщения
+ */
+static void notification_to_alert(const TriggerNotification* notification, Alert* alert) {
+    memset(alert, 0, sizeof(Alert));
+    alert->id = notification->alert_id;
+    alert->type = notification->type;
+    alert->trigger_mode = notification->trigger_mode;
+    alert->target_value = notification->target_value;
+    alert->trigger_count = notification->trigger_count;
+    alert->last_triggered = notification->triggered_at;
+    alert->current_value = notification->price.current_price;
+    alert->expr_program = -1;
+    alert->active_pos = -1;
+    memcpy(alert->user_id, notification->user_id, sizeof(alert->user_id));
+    memcpy(alert->symbol, notification->symbol, sizeof(alert->symbol));
+    memcpy(alert->message, notification->message, sizeof(alert->message));
+}
+
+static const TriggerNotification* g_sort_notifications = NULL;
+
+/**
+ * Порядок пачки: по пользователю, внутри пользователя - по постановке
+ */
+static int compare_notification_index(const void* a, const void* b) {
+    int ia = *(const int*)a;
+    int ib = *(const int*)b;
+    int cmp = strcmp(g_sort_notifications[ia].user_id, g_sort_notifications[ib].user_id);
+    return cmp != 0 ? cmp : ia - ib;
+}
+
+/**
+ * Доставка пачки уведомлений (поток доставки)
+ *
+ * Callback, журнал срабатываний и лог - для каждого срабатывания в порядке очереди,
+ * а в WebSocket каждый пользователь получает одно сообщение: alert_triggered
+ * для единственного срабатывания или alert_digest для нескольких. Callback
+ * получает копию алерта с полями срабатывания, а не живой алерт менеджера.
+ */
+static void alert_deliver_notifications(const TriggerNotification* notifications, int count) {
+    Alert alert;
+    for (int i = 0; i < count; i++) {
+        const TriggerNotification* notification = &notifications[i];
+        CryptoPrice price = notification->price;
+        notification_to_alert(notification, &alert);
+        
+        // Callback функция
+        if (g_notification_callback) {
+            g_notification_callback(&alert, &price);
+        }
+        
+        trigger_journal_append(notification->alert_id, notification->symbol, 
+                               notification->user_id,
+                               TRIGGER_FLAGS(notification->type, notification->trigger_mode),
+                               notification->price.current_price, notification->triggered_at);
+        
+        // Логирование
+        char log_msg[512];
+        snprintf(log_msg, sizeof(log_msg), 
+                 "Alert triggered: %s %s %.2f (current: %.2f)", 
+                 alert.symbol, 
+                 (alert.type == ALERT_PRICE_ABOVE) ? "above" : "below",
+                 alert.target_value, 
+                 price.current_price);
+        alert_log("ALERT", log_msg);
+    }
+    
+    int* order = malloc(sizeof(int) * (size_t)count);
+    const TriggerNotification** group = malloc(sizeof(TriggerNotification*) * (size_t)count);
+    if (!order || !group) {
+        free(order);
+        free(group);
+        alert_log("ERROR", "Failed to allocate notification batch");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    // Сортируется только поток доставки
+    g_sort_notifications = notifications;
+    qsort(order, (size_t)count, sizeof(int), compare_notification_index);
+    
+    int start = 0;
+    while (start < count) {
+        const char* user_id = notifications[order[start]].user_id;
+        int end = start + 1;
+        while (end < count && strcmp(notifications[order[end]].user_id, user_id) == 0) {
+            end++;
+        }
+        
+        for (int k = start; k < end; k++) {
+            group[k - start] = &notifications[order[k]];
+        }
+        
+        // WebSocket уведомление
+        ws_send_alert_notifications(user_id, group, end - start);
+        start = end;
+    }
+    
+    free(group);
+    free(order);
+}
+
+/**
+ * Изменение позиции в портфеле пользователя
+ */
+int alert_portfolio_set_holding(const char* user_id, const char* symbol, double quantity) {
+    if (!user_id || !symbol || quantity < 0.0) {
+        alert_log("ERROR", "Invalid parameters for portfolio holding");
+        return -1;
     }
     
-    // WebSocket уведомление
-    WSMessage* ws_msg = ws_create_alert_triggered_message(alert, price);
-    ws_send_to_user(alert->user_id, ws_msg);
-    ws_free_message(ws_msg);
+    pthread_mutex_lock(&g_mutation_mutex);
+    
+    // Позиция создается заранее (пустой она не влияет на стоимость), поэтому
+    // после фиксации журнала установка количества не может не удаться
+    int result = portfolio_reserve_holding(user_id, symbol);
+    if (result != 0) {
+        pthread_mutex_unlock(&g_mutation_mutex);
+        return result;
+    }
+    
+    uint64_t seq = 0;
+    result = persistence_upsert_holding(user_id, symbol, quantity, &seq);
+    if (result == 0) {
+        result = persistence_sync(seq);
+    }
+    if (result == 0) {
+        portfolio_set_holding(user_id, symbol, quantity);
+    }
     
-    // Логирование
-    char log_msg[512];
-    snprintf(log_msg, sizeof(log_msg), 
-             "Alert triggered: %s %s %.2f (current: %.2f)", 
-             alert->symbol, 
-             (alert->type == ALERT_PRICE_ABOVE) ? "above" : "below",
-             alert->target_value, 
-             price->current_price);
-    alert_log("ALERT", log_msg);
+    pthread_mutex_unlock(&g_mutation_mutex);
+    
+    return result == 0 ? 0 : -4;
+}
+
+/**
+ * История срабатываний пользователя
+ *
+ * Журнал хранит точный id пользователя, поэтому история доступна
+ * и для удаленных алертов.
+ */
+int alert_trigger_history(const char* user_id, time_t from, time_t to,
+                          TriggerRecord* records, int max_records) {
+    if (!user_id || !records || max_records <= 0 || from > to) {
+        return -1;
+    }
+    
+    return trigger_journal_scan(from, to, user_id, records, max_records);
+}
+
+/**
+ * RSI по Уайлдеру для ряда цен в порядке возрастания времени
+ *
+ * Возвращает -1, если точек не больше периода.
+ */
+double calculate_rsi(double* prices, int count, int period) {
+    if (!prices || period <= 0 || count <= period) {
+        return -1.0;
+    }
+    
+    double avg_gain = 0.0;
+    double avg_loss = 0.0;
+    for (int i = 1; i <= period; i++) {
+        double change = prices[i] - prices[i - 1];
+        if (change > 0) {
+            avg_gain += change;
+        } else {
+            avg_loss -= change;
+        }
+    }
+    avg_gain /= period;
+    avg_loss /= period;
+    
+    for (int i = period + 1; i < count; i++) {
+        double change = prices[i] - prices[i - 1];
+        double gain = change > 0 ? change : 0.0;
+        double loss = change < 0 ? -change : 0.0;
+        avg_gain = (avg_gain * (period - 1) + gain) / period;
+        avg_loss = (avg_loss * (period - 1) + loss) / period;
+    }
+    
+    if (avg_loss == 0.0) {
+        return avg_gain == 0.0 ? 50.0 : 100.0;
+    }
+    
+    double rs = avg_gain / avg_loss;
+    return 100.0 - 100.0 / (1.0 + rs);
 }
 
 /**
@@ -583,141 +1799,275 @@ int get_max_alerts_for_tier(UserTier tier) {
 }
 
 /**
- * Загрузка алертов из базы данных
+ * Чтение сохраняемых полей алерта из строки SELECT_ALERT_COLUMNS
  */
-static int load_alerts_from_db(void) {
-    if (!g_database || !g_alert_manager) {
+static void alert_read_row(sqlite3_stmt* stmt, Alert* alert) {
+    memset(alert, 0, sizeof(Alert));
+    
+    alert->id = sqlite3_column_int(stmt, 0);
+    strncpy(alert->user_id, (const char*)sqlite3_column_text(stmt, 1), sizeof(alert->user_id) - 1);
+    strncpy(alert->symbol, (const char*)sqlite3_column_text(stmt, 2), sizeof(alert->symbol) - 1);
+    alert->type = (AlertType)sqlite3_column_int(stmt, 3);
+    alert->target_value = sqlite3_column_double(stmt, 4);
+    alert->status = (AlertStatus)sqlite3_column_int(stmt, 5);
+    alert->created_at = sqlite3_column_int64(stmt, 6);
+    alert->last_triggered = sqlite3_column_int64(stmt, 7);
+    alert->trigger_count = sqlite3_column_int(stmt, 8);
+    
+    const char* message = (const char*)sqlite3_column_text(stmt, 9);
+    if (message) {
+        strncpy(alert->message, message, sizeof(alert->message) - 1);
+    }
+    
+    alert->is_repeatable = sqlite3_column_int(stmt, 10) != 0;
+    alert->cooldown_minutes = sqlite3_column_int(stmt, 11);
+    alert->required_tier = (UserTier)sqlite3_column_int(stmt, 12);
+    alert->trigger_mode = (AlertTriggerMode)sqlite3_column_int(stmt, 14);
+    alert->hysteresis = sqlite3_column_double(stmt, 15);
+    alert->activate_at = sqlite3_column_int64(stmt, 16);
+    alert->expires_at = sqlite3_column_int64(stmt, 17);
+    alert->check_at = sqlite3_column_int64(stmt, 18);
+    
+    const char* expression = (const char*)sqlite3_column_text(stmt, 13);
+    if (expression) {
+        strncpy(alert->expression, expression, sizeof(alert->expression) - 1);
+    }
+}
+
+/**
+ * Сброс runtime полей загруженного алерта и компиляция его выражения
+ *
+ * Алерт с некорректным выражением остается в хранилище неактивным.
+ */
+static void alert_reset_runtime(Alert* alert) {
+    alert->current_value = 0.0;
+    alert->last_checked = 0;
+    alert->expr_program = -1;
+    alert->last_side = ALERT_SIDE_UNKNOWN;
+    alert->active_pos = -1;
+    alert->state_dirty = false;
+    timer_node_init(&alert->cooldown_timer);
+    
+    if (alert->type == ALERT_COMPOUND && alert->status != ALERT_STATUS_INACTIVE &&
+        alert->status != ALERT_STATUS_TRIGGERED && alert->status != ALERT_STATUS_EXPIRED) {
+        alert->expr_program = expr_compile(alert->expression, NULL, NULL, 0);
+        if (alert->expr_program < 0) {
+            alert_log("WARNING", "Disabling compound alert with invalid expression");
+            alert->status = ALERT_STATUS_INACTIVE;
+        }
+    }
+}
+
+/**
+ * Путь данных движка (снимок, журнал срабатываний, история цен): рядом
+ * с базой, чтобы другая база или другой рабочий каталог не подхватили чужие
+ */
+static void alert_data_path(char* path, size_t size, const char* suffix) {
+    snprintf(path, size, "%s%s", db_shards_get_config()->db_path, suffix);
+}
+
+/**
+ * Загрузка снимка хранилища; возвращает время снимка или -1
+ */
+static time_t load_alerts_from_snapshot(void) {
+    char path[300];
+    alert_data_path(path, sizeof(path), ALERT_SNAPSHOT_SUFFIX);
+    
+    AlertSnapshot snapshot;
+    if (alert_snapshot_open(path, db_shard_count(), &snapshot) != 0) {
         return -1;
     }
     
-    const char* select_sql = "SELECT id, user_id, symbol, type, target_value, status, "
-                            "created_at, last_triggered, trigger_count, message, "
-                            "is_repeatable, cooldown_minutes, required_tier FROM alerts "
-                            "WHERE status != ?";
+    if (snapshot.count > g_alert_manager->capacity) {
+        alert_snapshot_close(&snapshot);
+        return -1;
+    }
+    
+    memcpy(g_alert_manager->alerts, snapshot.alerts, sizeof(Alert) * (size_t)snapshot.count);
+    g_alert_manager->count = snapshot.count;
+    time_t taken_at = snapshot.taken_at;
+    alert_snapshot_close(&snapshot);
+    
+    for (int i = 0; i < g_alert_manager->count; i++) {
+        alert_reset_runtime(&g_alert_manager->alerts[i]);
+        alert_index_add(g_alert_manager->alerts[i].id, i);
+    }
     
+    return taken_at;
+}
+
+/**
+ * Загрузка строк одного шарда: изменения после снимка либо все живые алерты
+ */
+static int load_alerts_from_shard(sqlite3* db, time_t snapshot_time) {
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(g_database, select_sql, -1, &stmt, NULL);
+    const char* select_sql = snapshot_time >= 0 ?
+        SELECT_ALERT_COLUMNS "WHERE updated_at >= ?" :
+        SELECT_ALERT_COLUMNS "WHERE status != ?";
+    
+    int rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
         alert_log("ERROR", "Failed to prepare SELECT statement");
         return -1;
     }
     
-    sqlite3_bind_int(stmt, 1, ALERT_STATUS_INACTIVE);
+    if (snapshot_time >= 0) {
+        sqlite3_bind_int64(stmt, 1, snapshot_time);
+    } else {
+        // Живых строк почти все, полный проход дешевле поиска по индексу
+        sqlite3_bind_int(stmt, 1, ALERT_STATUS_INACTIVE);
+    }
+    
+    int replayed = 0;
+    Alert row;
     
-    int loaded_count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && loaded_count < g_alert_manager->capacity) {
-        Alert* alert = &g_alert_manager->alerts[loaded_count];
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        alert_read_row(stmt, &row);
         
-        alert->id = sqlite3_column_int(stmt, 0);
-        strncpy(alert->user_id, (const char*)sqlite3_column_text(stmt, 1), sizeof(alert->user_id) - 1);
-        strncpy(alert->symbol, (const char*)sqlite3_column_text(stmt, 2), sizeof(alert->symbol) - 1);
-        alert->type = (AlertType)sqlite3_column_int(stmt, 3);
-        alert->target_value = sqlite3_column_double(stmt, 4);
-        alert->status = (AlertStatus)sqlite3_column_int(stmt, 5);
-        alert->created_at = sqlite3_column_int64(stmt, 6);
-        alert->last_triggered = sqlite3_column_int64(stmt, 7);
-        alert->trigger_count = sqlite3_column_int(stmt, 8);
-        
-        const char* message = (const char*)sqlite3_column_text(stmt, 9);
-        if (message) {
-            strncpy(alert->message, message, sizeof(alert->message) - 1);
+        // Строка, измененная после снимка, заменяет его версию алерта
+        Alert* alert = snapshot_time >= 0 ? find_alert_by_id(row.id) : NULL;
+        if (alert) {
+            if (alert->expr_program >= 0) {
+                expr_free(alert->expr_program);
+            }
+        } else if (row.status == ALERT_STATUS_INACTIVE) {
+            continue;
+        } else if (g_alert_manager->count < g_alert_manager->capacity) {
+            alert = &g_alert_manager->alerts[g_alert_manager->count++];
+            alert_index_add(row.id, g_alert_manager->count - 1);
+        } else {
+            break;
         }
         
-        alert->is_repeatable = sqlite3_column_int(stmt, 10) != 0;
-        alert->cooldown_minutes = sqlite3_column_int(stmt, 11);
-        alert->required_tier = (UserTier)sqlite3_column_int(stmt, 12);
-        
-        // Обнуляем runtime поля
-        alert->current_value = 0.0;
-        alert->last_checked = 0;
-        
-        loaded_count++;
+        *alert = row;
+        alert_reset_runtime(alert);
+        replayed++;
     }
     
     sqlite3_finalize(stmt);
-    g_alert_manager->count = loaded_count;
+    return replayed;
+}
+
+/**
+ * Загрузка алертов: снимок плюс строки, измененные после него,
+ * либо полная загрузка из базы, если снимка нет или он поврежден
+ */
+static int load_alerts_from_db(void) {
+    if (!g_databases[0] || !g_alert_manager) {
+        return -1;
+    }
+    
+    g_alert_manager->count = 0;
+    alert_index_clear();
+    time_t snapshot_time = load_alerts_from_snapshot();
+    int snapshot_count = g_alert_manager->count;
+    int replayed = 0;
+    
+    for (int i = 0; i < db_shard_count(); i++) {
+        int loaded = load_alerts_from_shard(g_databases[i], snapshot_time);
+        if (loaded < 0) {
+            return -1;
+        }
+        replayed += loaded;
+    }
+    
+    // Построение набора проверяемых алертов и колеса cooldown
+    time_t now = time(NULL);
+    g_alert_manager->active_count = 0;
+    for (int i = 0; i < g_alert_manager->count; i++) {
+        Alert* alert = &g_alert_manager->alerts[i];
+        if (alert->status == ALERT_STATUS_ACTIVE) {
+            alert_activate(alert, now);
+        }
+        alert_schedule_events(alert);
+    }
     
     char log_msg[128];
-    snprintf(log_msg, sizeof(log_msg), "Loaded %d alerts from database", loaded_count);
+    if (snapshot_time >= 0) {
+        snprintf(log_msg, sizeof(log_msg), 
+                 "Loaded %d alerts from snapshot, replayed %d changed rows", 
+                 snapshot_count, replayed);
+    } else {
+        snprintf(log_msg, sizeof(log_msg), "Loaded %d alerts from database", replayed);
+    }
     alert_log("INFO", log_msg);
     
     return 0;
 }
 
 /**
- * Сохранение алерта в базу данных
+ * Запись снимка хранилища алертов
+ *
+ * Под g_alert_mutex делается только копия массива; CRC и запись на диск
+ * выполняются без блокировки.
  */
-static int save_alert_to_db(Alert* alert) {
-    if (!g_database || !alert) {
+static int alert_write_snapshot(void) {
+    if (!g_alert_manager) {
         return -1;
     }
     
-    const char* insert_sql = "INSERT INTO alerts (id, user_id, symbol, type, target_value, "
-                            "status, created_at, last_triggered, trigger_count, message, "
-                            "is_repeatable, cooldown_minutes, required_tier) "
-                            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    pthread_mutex_lock(&g_alert_mutex);
     
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(g_database, insert_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        alert_log("ERROR", "Failed to prepare INSERT statement");
+    Alert* copy = malloc(sizeof(Alert) * (size_t)(g_alert_manager->count > 0 ? g_alert_manager->count : 1));
+    if (!copy) {
+        pthread_mutex_unlock(&g_alert_mutex);
         return -1;
     }
     
-    sqlite3_bind_int(stmt, 1, alert->id);
-    sqlite3_bind_text(stmt, 2, alert->user_id, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, alert->symbol, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 4, alert->type);
-    sqlite3_bind_double(stmt, 5, alert->target_value);
-    sqlite3_bind_int(stmt, 6, alert->status);
-    sqlite3_bind_int64(stmt, 7, alert->created_at);
-    sqlite3_bind_int64(stmt, 8, alert->last_triggered);
-    sqlite3_bind_int(stmt, 9, alert->trigger_count);
-    sqlite3_bind_text(stmt, 10, alert->message, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 11, alert->is_repeatable ? 1 : 0);
-    sqlite3_bind_int(stmt, 12, alert->cooldown_minutes);
-    sqlite3_bind_int(stmt, 13, alert->required_tier);
+    int count = 0;
+    for (int i = 0; i < g_alert_manager->count; i++) {
+        if (g_alert_manager->alerts[i].status != ALERT_STATUS_INACTIVE) {
+            copy[count++] = g_alert_manager->alerts[i];
+        }
+    }
+    time_t taken_at = time(NULL);
     
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(&g_alert_mutex);
     
-    if (rc == SQLITE_DONE) {
-        alert_log("INFO", "Alert saved to database");
-        return 0;
-    } else {
-        alert_log("ERROR", "Failed to save alert to database");
-        return -1;
-    }
+    char path[300];
+    alert_data_path(path, sizeof(path), ALERT_SNAPSHOT_SUFFIX);
+    
+    int result = alert_snapshot_write(path, copy, count, taken_at, db_shard_count());
+    free(copy);
+    
+    return result;
 }
 
 /**
- * Удаление алерта из базы данных
+ * Загрузка позиций портфелей из всех шардов базы
  */
-static int delete_alert_from_db(int alert_id) {
-    if (!g_database) {
+static int load_portfolios_from_db(void) {
+    if (!g_databases[0]) {
         return -1;
     }
     
-    const char* delete_sql = "UPDATE alerts SET status = ? WHERE id = ?";
+    const char* select_sql = "SELECT user_id, symbol, quantity FROM portfolio_holdings";
+    int loaded_count = 0;
     
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(g_database, delete_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        alert_log("ERROR", "Failed to prepare DELETE statement");
-        return -1;
+    for (int i = 0; i < db_shard_count(); i++) {
+        sqlite3_stmt* stmt;
+        int rc = sqlite3_prepare_v2(g_databases[i], select_sql, -1, &stmt, NULL);
+        if (rc != SQLITE_OK) {
+            alert_log("ERROR", "Failed to prepare SELECT holdings statement");
+            return -1;
+        }
+        
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* user_id = (const char*)sqlite3_column_text(stmt, 0);
+            const char* symbol = (const char*)sqlite3_column_text(stmt, 1);
+            
+            if (user_id && symbol &&
+                portfolio_set_holding(user_id, symbol, sqlite3_column_double(stmt, 2)) == 0) {
+                loaded_count++;
+            }
+        }
+        
+        sqlite3_finalize(stmt);
     }
     
-    sqlite3_bind_int(stmt, 1, ALERT_STATUS_INACTIVE);
-    sqlite3_bind_int(stmt, 2, alert_id);
-    
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Loaded %d portfolio holdings from database", loaded_count);
+    alert_log("INFO", log_msg);
     
-    if (rc == SQLITE_DONE) {
-        alert_log("INFO", "Alert deleted from database");
-        return 0;
-    } else {
-        alert_log("ERROR", "Failed to delete alert from database");
-        return -1;
-    }
-}
\ No newline at end of file
+    return 0;
+}
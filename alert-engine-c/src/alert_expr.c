@@ -0,0 +1,685 @@
+#include "../include/alert_expr.h"
+#include "../include/alert_engine.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Тикеры -> идентификаторы CoinGecko
+static const struct {
+    const char* ticker;
+    const char* id;
+} g_ticker_aliases[] = {
+    {"BTC", "bitcoin"}, {"ETH", "ethereum"}, {"BNB", "binancecoin"},
+    {"ADA", "cardano"}, {"SOL", "solana"}, {"LINK", "chainlink"},
+    {"DOT", "polkadot"}, {"AVAX", "avalanche-2"}, {"MATIC", "polygon"},
+    {"ATOM", "cosmos"}, {"ALGO", "algorand"}, {"VET", "vechain"},
+    {"XLM", "stellar"}, {"XMR", "monero"}, {"TRX", "tron"},
+    {"UNI", "uniswap"}, {"LTC", "litecoin"}, {"ETC", "ethereum-classic"},
+    {"FIL", "filecoin"}, {"EOS", "eos"}, {"AAVE", "aave"}
+};
+
+// Поля, которые можно указать без символа (относятся к символу алерта)
+static const struct {
+    const char* name;
+    ExprField field;
+} g_field_names[] = {
+    {"PRICE", EXPR_FIELD_PRICE}, {"CHANGE24H", EXPR_FIELD_CHANGE_24H},
+    {"CHANGE", EXPR_FIELD_CHANGE_PERCENT_24H}, {"CHANGE_PCT", EXPR_FIELD_CHANGE_PERCENT_24H},
+    {"VOLUME", EXPR_FIELD_VOLUME_24H}, {"MCAP", EXPR_FIELD_MARKET_CAP},
+    {"MARKET_CAP", EXPR_FIELD_MARKET_CAP}, {"RSI", EXPR_FIELD_RSI14},
+    {"RSI14", EXPR_FIELD_RSI14}
+};
+
+// Таблицы операндов, предикатов и программ. Программ столько же, сколько
+// составных алертов, поэтому их таблица растет по мере компиляции
+static ExprProgram* g_programs = NULL;
+static int g_program_capacity = 0;
+static int g_program_free_hint = 0;     // Ниже нет свободных слотов
+static ExprOperand g_operands[MAX_EXPR_OPERANDS];
+static ExprPredicate g_predicates[MAX_EXPR_PREDICATES];
+static unsigned int g_epoch = 1;
+static ExprPriceLookup g_lookup = NULL;
+static void* g_lookup_ctx = NULL;
+
+// Токены
+typedef enum {
+    TOK_END,
+    TOK_IDENT,
+    TOK_NUMBER,
+    TOK_CMP,
+    TOK_AND,
+    TOK_OR,
+    TOK_NOT,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_ERROR
+} TokenType;
+
+// Состояние компилятора
+typedef struct {
+    const char* source;
+    const char* pos;
+    TokenType tok;
+    char ident[MAX_SYMBOL_LEN * 2];
+    double number;
+    ExprCompare cmp;
+
+    ExprProgram* program;
+    const char* default_symbol;
+    int depth;
+    int max_depth;
+    char* error;
+    size_t error_size;
+    bool failed;
+} ExprCompiler;
+
+/**
+ * Ошибка компиляции
+ */
+static void compile_error(ExprCompiler* c, const char* message) {
+    if (!c->failed && c->error && c->error_size > 0) {
+        snprintf(c->error, c->error_size, "%s at offset %d", message,
+                 (int)(c->pos - c->source));
+    }
+    c->failed = true;
+}
+
+/**
+ * Чтение следующего токена
+ */
+static void next_token(ExprCompiler* c) {
+    while (isspace((unsigned char)*c->pos)) {
+        c->pos++;
+    }
+
+    const char* p = c->pos;
+    if (*p == '\0') {
+        c->tok = TOK_END;
+        return;
+    }
+
+    if (*p == '(') { c->pos++; c->tok = TOK_LPAREN; return; }
+    if (*p == ')') { c->pos++; c->tok = TOK_RPAREN; return; }
+
+    if (p[0] == '&' && p[1] == '&') { c->pos += 2; c->tok = TOK_AND; return; }
+    if (p[0] == '|' && p[1] == '|') { c->pos += 2; c->tok = TOK_OR; return; }
+
+    if (*p == '>' || *p == '<' || *p == '=' || *p == '!') {
+        bool has_eq = p[1] == '=';
+        c->tok = TOK_CMP;
+        switch (*p) {
+            case '>': c->cmp = has_eq ? EXPR_CMP_GE : EXPR_CMP_GT; break;
+            case '<': c->cmp = has_eq ? EXPR_CMP_LE : EXPR_CMP_LT; break;
+            case '=': c->cmp = EXPR_CMP_EQ; break;
+            default:
+                if (!has_eq) {
+                    c->pos++;
+                    c->tok = TOK_NOT;
+                    return;
+                }
+                c->cmp = EXPR_CMP_NE;
+                break;
+        }
+        c->pos += has_eq ? 2 : 1;
+        return;
+    }
+
+    if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+        char* end;
+        c->number = strtod(p, &end);
+        c->pos = end;
+        c->tok = TOK_NUMBER;
+        return;
+    }
+
+    if (isalpha((unsigned char)*p) || *p == '_') {
+        size_t len = 0;
+        while (isalnum((unsigned char)p[len]) || p[len] == '_' || p[len] == '-' || p[len] == '.') {
+            len++;
+        }
+        if (len >= sizeof(c->ident)) {
+            c->tok = TOK_ERROR;
+            return;
+        }
+        memcpy(c->ident, p, len);
+        c->ident[len] = '\0';
+        c->pos += len;
+
+        if (strcasecmp(c->ident, "AND") == 0) {
+            c->tok = TOK_AND;
+        } else if (strcasecmp(c->ident, "OR") == 0) {
+            c->tok = TOK_OR;
+        } else if (strcasecmp(c->ident, "NOT") == 0) {
+            c->tok = TOK_NOT;
+        } else {
+            c->tok = TOK_IDENT;
+        }
+        return;
+    }
+
+    c->tok = TOK_ERROR;
+}
+
+/**
+ * Добавление инструкции в программу
+ */
+static int emit(ExprCompiler* c, ExprOpcode op, int arg) {
+    if (c->program->length >= MAX_EXPR_CODE) {
+        compile_error(c, "Expression is too long");
+        return -1;
+    }
+    ExprInstr* instr = &c->program->code[c->program->length];
+    instr->op = (uint8_t)op;
+    instr->reserved = 0;
+    instr->arg = (uint16_t)arg;
+    return c->program->length++;
+}
+
+static void push_depth(ExprCompiler* c, int delta) {
+    c->depth += delta;
+    if (c->depth > c->max_depth) {
+        c->max_depth = c->depth;
+    }
+    if (c->depth > MAX_EXPR_STACK) {
+        compile_error(c, "Expression is nested too deeply");
+    }
+}
+
+/**
+ * Поиск поля по имени
+ */
+static bool lookup_field(const char* name, ExprField* field) {
+    for (size_t i = 0; i < sizeof(g_field_names) / sizeof(g_field_names[0]); i++) {
+        if (strcasecmp(g_field_names[i].name, name) == 0) {
+            *field = g_field_names[i].field;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Интернирование операнда (одинаковые операнды разделяются всеми программами)
+ */
+static int intern_operand(const char* symbol, ExprField field) {
+    int free_slot = -1;
+    for (int i = 0; i < MAX_EXPR_OPERANDS; i++) {
+        ExprOperand* operand = &g_operands[i];
+        if (operand->refcount == 0) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+            continue;
+        }
+        if (operand->field == field && strcmp(operand->symbol, symbol) == 0) {
+            operand->refcount++;
+            return i;
+        }
+    }
+
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    ExprOperand* operand = &g_operands[free_slot];
+    memset(operand, 0, sizeof(ExprOperand));
+    snprintf(operand->symbol, sizeof(operand->symbol), "%s", symbol);
+    operand->field = field;
+    operand->refcount = 1;
+    return free_slot;
+}
+
+/**
+ * Интернирование предиката (общие подвыражения вычисляются раз за тик)
+ */
+static int intern_predicate(int operand, ExprCompare cmp, double constant) {
+    int free_slot = -1;
+    for (int i = 0; i < MAX_EXPR_PREDICATES; i++) {
+        ExprPredicate* predicate = &g_predicates[i];
+        if (predicate->refcount == 0) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+            continue;
+        }
+        if (predicate->operand == operand && predicate->cmp == cmp &&
+            predicate->constant == constant) {
+            predicate->refcount++;
+            g_operands[operand].refcount--;
+            return i;
+        }
+    }
+
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    ExprPredicate* predicate = &g_predicates[free_slot];
+    memset(predicate, 0, sizeof(ExprPredicate));
+    predicate->operand = operand;
+    predicate->cmp = cmp;
+    predicate->constant = constant;
+    predicate->refcount = 1;
+    return free_slot;
+}
+
+static void release_predicate(int index) {
+    ExprPredicate* predicate = &g_predicates[index];
+    if (predicate->refcount > 0 && --predicate->refcount == 0) {
+        g_operands[predicate->operand].refcount--;
+    }
+}
+
+/**
+ * Разбор операнда: поле, символ или символ.поле
+ */
+static int parse_operand(ExprCompiler* c, const char* ident) {
+    char symbol[MAX_SYMBOL_LEN];
+    ExprField field = EXPR_FIELD_PRICE;
+    const char* dot = strchr(ident, '.');
+
+    if (dot) {
+        char name[MAX_SYMBOL_LEN];
+        size_t len = (size_t)(dot - ident);
+        if (len >= sizeof(name)) {
+            compile_error(c, "Symbol name is too long");
+            return -1;
+        }
+        memcpy(name, ident, len);
+        name[len] = '\0';
+        if (!lookup_field(dot + 1, &field)) {
+            compile_error(c, "Unknown field");
+            return -1;
+        }
+        expr_normalize_symbol(name, symbol, sizeof(symbol));
+    } else if (lookup_field(ident, &field)) {
+        // Поле без символа относится к символу по умолчанию или к первому символу выражения
+        const char* base = (c->default_symbol && c->default_symbol[0] != '\0')
+                           ? c->default_symbol : c->program->primary_symbol;
+        if (base[0] == '\0') {
+            compile_error(c, "Field used without a symbol");
+            return -1;
+        }
+        strncpy(symbol, base, sizeof(symbol) - 1);
+        symbol[sizeof(symbol) - 1] = '\0';
+    } else {
+        expr_normalize_symbol(ident, symbol, sizeof(symbol));
+    }
+
+    if (c->program->primary_symbol[0] == '\0') {
+        snprintf(c->program->primary_symbol, sizeof(c->program->primary_symbol), "%s", symbol);
+    }
+
+    int operand = intern_operand(symbol, field);
+    if (operand < 0) {
+        compile_error(c, "Too many distinct operands");
+    }
+    return operand;
+}
+
+/**
+ * Сравнение: operand cmp number | number cmp operand
+ */
+static void parse_comparison(ExprCompiler* c) {
+    static const ExprCompare flipped[] = {
+        EXPR_CMP_LT, EXPR_CMP_LE, EXPR_CMP_GT, EXPR_CMP_GE, EXPR_CMP_EQ, EXPR_CMP_NE
+    };
+
+    char ident[sizeof(c->ident)];
+    double constant;
+    ExprCompare cmp;
+
+    if (c->tok == TOK_IDENT) {
+        strcpy(ident, c->ident);
+        next_token(c);
+        if (c->tok != TOK_CMP) {
+            compile_error(c, "Expected comparison operator");
+            return;
+        }
+        cmp = c->cmp;
+        next_token(c);
+        if (c->tok != TOK_NUMBER) {
+            compile_error(c, "Expected number");
+            return;
+        }
+        constant = c->number;
+    } else if (c->tok == TOK_NUMBER) {
+        constant = c->number;
+        next_token(c);
+        if (c->tok != TOK_CMP) {
+            compile_error(c, "Expected comparison operator");
+            return;
+        }
+        cmp = flipped[c->cmp];
+        next_token(c);
+        if (c->tok != TOK_IDENT) {
+            compile_error(c, "Expected symbol or field");
+            return;
+        }
+        strcpy(ident, c->ident);
+    } else {
+        compile_error(c, "Expected comparison");
+        return;
+    }
+    next_token(c);
+
+    int operand = parse_operand(c, ident);
+    if (operand < 0) {
+        return;
+    }
+
+    int predicate = intern_predicate(operand, cmp, constant);
+    if (predicate < 0) {
+        g_operands[operand].refcount--;
+        compile_error(c, "Too many distinct conditions");
+        return;
+    }
+
+    if (emit(c, EXPR_OP_PRED, predicate) < 0) {
+        release_predicate(predicate);
+        return;
+    }
+    push_depth(c, 1);
+}
+
+static void parse_or(ExprCompiler* c);
+
+static void parse_unary(ExprCompiler* c) {
+    if (c->failed) {
+        return;
+    }
+
+    if (c->tok == TOK_NOT) {
+        next_token(c);
+        parse_unary(c);
+        emit(c, EXPR_OP_NOT, 0);
+    } else if (c->tok == TOK_LPAREN) {
+        next_token(c);
+        parse_or(c);
+        if (c->tok != TOK_RPAREN) {
+            compile_error(c, "Expected ')'");
+            return;
+        }
+        next_token(c);
+    } else {
+        parse_comparison(c);
+    }
+}
+
+static void parse_and(ExprCompiler* c) {
+    parse_unary(c);
+    while (!c->failed && c->tok == TOK_AND) {
+        next_token(c);
+        int jump = emit(c, EXPR_OP_JFALSE_KEEP, 0);
+        push_depth(c, -1);
+        parse_unary(c);
+        if (jump >= 0) {
+            c->program->code[jump].arg = (uint16_t)c->program->length;
+        }
+    }
+}
+
+static void parse_or(ExprCompiler* c) {
+    parse_and(c);
+    while (!c->failed && c->tok == TOK_OR) {
+        next_token(c);
+        int jump = emit(c, EXPR_OP_JTRUE_KEEP, 0);
+        push_depth(c, -1);
+        parse_and(c);
+        if (jump >= 0) {
+            c->program->code[jump].arg = (uint16_t)c->program->length;
+        }
+    }
+}
+
+/**
+ * Компиляция выражения вида "BTC > 70000 AND RSI14 < 30" в байткод
+ *
+ * Возвращает идентификатор программы или отрицательный код ошибки.
+ */
+int expr_compile(const char* source, const char* default_symbol,
+                 char* error, size_t error_size) {
+    if (!source) {
+        return -1;
+    }
+
+    int program_id = -1;
+    for (int i = g_program_free_hint; i < g_program_capacity; i++) {
+        if (!g_programs[i].in_use) {
+            program_id = i;
+            break;
+        }
+    }
+    if (program_id < 0) {
+        int capacity = g_program_capacity > 0 ? g_program_capacity * 2 : EXPR_PROGRAMS_INITIAL;
+        ExprProgram* programs = realloc(g_programs, sizeof(ExprProgram) * (size_t)capacity);
+        if (!programs) {
+            if (error && error_size > 0) {
+                snprintf(error, error_size, "Too many compiled expressions");
+            }
+            return -2;
+        }
+        memset(programs + g_program_capacity, 0, 
+               sizeof(ExprProgram) * (size_t)(capacity - g_program_capacity));
+        program_id = g_program_capacity;
+        g_programs = programs;
+        g_program_capacity = capacity;
+    }
+    g_program_free_hint = program_id + 1;
+
+    ExprProgram* program = &g_programs[program_id];
+    memset(program, 0, sizeof(ExprProgram));
+
+    ExprCompiler compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.source = source;
+    compiler.pos = source;
+    compiler.program = program;
+    compiler.default_symbol = default_symbol;
+    compiler.error = error;
+    compiler.error_size = error_size;
+
+    next_token(&compiler);
+    parse_or(&compiler);
+
+    if (!compiler.failed && compiler.tok != TOK_END) {
+        compile_error(&compiler, "Unexpected token");
+    }
+
+    if (!compiler.failed) {
+        emit(&compiler, EXPR_OP_END, 0);
+    }
+
+    if (compiler.failed) {
+        for (int i = 0; i < program->length; i++) {
+            if (program->code[i].op == EXPR_OP_PRED) {
+                release_predicate(program->code[i].arg);
+            }
+        }
+        memset(program, 0, sizeof(ExprProgram));
+        g_program_free_hint = program_id;
+        return -3;
+    }
+
+    program->in_use = true;
+    return program_id;
+}
+
+/**
+ * Освобождение программы и ее предикатов
+ */
+void expr_free(int program_id) {
+    if (program_id < 0 || program_id >= g_program_capacity || !g_programs[program_id].in_use) {
+        return;
+    }
+
+    ExprProgram* program = &g_programs[program_id];
+    for (int i = 0; i < program->length; i++) {
+        if (program->code[i].op == EXPR_OP_PRED) {
+            release_predicate(program->code[i].arg);
+        }
+    }
+
+    memset(program, 0, sizeof(ExprProgram));
+    if (program_id < g_program_free_hint) {
+        g_program_free_hint = program_id;
+    }
+}
+
+/**
+ * Первый символ, упомянутый в выражении
+ */
+const char* expr_primary_symbol(int program_id) {
+    if (program_id < 0 || program_id >= g_program_capacity || !g_programs[program_id].in_use) {
+        return NULL;
+    }
+    return g_programs[program_id].primary_symbol;
+}
+
+/**
+ * Начало нового тика: кэшированные значения операндов и предикатов устаревают
+ */
+void expr_begin_tick(ExprPriceLookup lookup, void* ctx) {
+    g_lookup = lookup;
+    g_lookup_ctx = ctx;
+
+    if (++g_epoch == 0) {
+        g_epoch = 1;
+    }
+}
+
+/**
+ * Значение операнда в текущем тике
+ */
+static bool resolve_operand(ExprOperand* operand) {
+    if (operand->epoch == g_epoch) {
+        return operand->valid;
+    }
+
+    operand->epoch = g_epoch;
+    operand->valid = false;
+
+    CryptoPrice* price = g_lookup ? g_lookup(operand->symbol, g_lookup_ctx) : NULL;
+    if (!price || !price->is_valid) {
+        return false;
+    }
+
+    switch (operand->field) {
+        case EXPR_FIELD_PRICE:              operand->value = price->current_price; break;
+        case EXPR_FIELD_CHANGE_24H:         operand->value = price->price_change_24h; break;
+        case EXPR_FIELD_CHANGE_PERCENT_24H: operand->value = price->price_change_percent_24h; break;
+        case EXPR_FIELD_VOLUME_24H:         operand->value = price->volume_24h; break;
+        case EXPR_FIELD_MARKET_CAP:         operand->value = price->market_cap; break;
+        case EXPR_FIELD_RSI14:              operand->value = price->rsi_14; break;
+        default:
+            return false;
+    }
+
+    operand->valid = true;
+    return true;
+}
+
+/**
+ * Значение предиката в текущем тике
+ */
+static bool eval_predicate(ExprPredicate* predicate) {
+    if (predicate->epoch == g_epoch) {
+        return predicate->result;
+    }
+
+    predicate->epoch = g_epoch;
+    predicate->result = false;
+
+    ExprOperand* operand = &g_operands[predicate->operand];
+    if (!resolve_operand(operand)) {
+        return false;
+    }
+
+    double value = operand->value;
+    switch (predicate->cmp) {
+        case EXPR_CMP_GT: predicate->result = value > predicate->constant; break;
+        case EXPR_CMP_GE: predicate->result = value >= predicate->constant; break;
+        case EXPR_CMP_LT: predicate->result = value < predicate->constant; break;
+        case EXPR_CMP_LE: predicate->result = value <= predicate->constant; break;
+        case EXPR_CMP_EQ: predicate->result = value == predicate->constant; break;
+        case EXPR_CMP_NE: predicate->result = value != predicate->constant; break;
+    }
+
+    return predicate->result;
+}
+
+/**
+ * Интерпретатор байткода
+ *
+ * Возвращает 1 если условие выполнено, 0 если нет, -1 при ошибке.
+ */
+int expr_eval(int program_id) {
+    if (program_id < 0 || program_id >= g_program_capacity || !g_programs[program_id].in_use) {
+        return -1;
+    }
+
+    const ExprInstr* code = g_programs[program_id].code;
+    bool stack[MAX_EXPR_STACK + 1];
+    int sp = 0;
+    int pc = 0;
+
+    for (;;) {
+        const ExprInstr* instr = &code[pc++];
+        switch (instr->op) {
+            case EXPR_OP_PRED:
+                stack[sp++] = eval_predicate(&g_predicates[instr->arg]);
+                break;
+
+            case EXPR_OP_NOT:
+                stack[sp - 1] = !stack[sp - 1];
+                break;
+
+            case EXPR_OP_JFALSE_KEEP:
+                if (!stack[sp - 1]) {
+                    pc = instr->arg;
+                } else {
+                    sp--;
+                }
+                break;
+
+            case EXPR_OP_JTRUE_KEEP:
+                if (stack[sp - 1]) {
+                    pc = instr->arg;
+                } else {
+                    sp--;
+                }
+                break;
+
+            case EXPR_OP_END:
+                return (sp > 0 && stack[sp - 1]) ? 1 : 0;
+
+            default:
+                return -1;
+        }
+    }
+}
+
+/**
+ * Приведение тикера или имени к идентификатору символа рыночных данных
+ */
+const char* expr_normalize_symbol(const char* name, char* out, size_t out_size) {
+    if (!name || !out || out_size == 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(g_ticker_aliases) / sizeof(g_ticker_aliases[0]); i++) {
+        if (strcasecmp(g_ticker_aliases[i].ticker, name) == 0) {
+            strncpy(out, g_ticker_aliases[i].id, out_size - 1);
+            out[out_size - 1] = '\0';
+            return out;
+        }
+    }
+
+    size_t i = 0;
+    for (; name[i] && i < out_size - 1; i++) {
+        out[i] = (char)tolower((unsigned char)name[i]);
+    }
+    out[i] = '\0';
+    return out;
+}
@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/alert_snapshot.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALERT_SNAPSHOT_MAGIC 0x504E5341u   // "ASNP"
+
+// Заголовок файла снимка
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+    int64_t taken_at;
+    uint32_t crc32;         // CRC-32 массива записей
+    uint32_t shard_count;   // Раскладка базы, по которой сделан снимок
+} SnapshotHeader;
+
+/**
+ * CRC-32 (IEEE 802.3), таблица строится при первом вызове
+ */
+static uint32_t snapshot_crc32(const void* data, size_t size) {
+    static uint32_t table[256];
+    static int table_ready = 0;
+
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    const unsigned char* bytes = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+#ifdef _WIN32
+// Windows заглушки: запуск всегда идет через полную загрузку из базы
+int alert_snapshot_write(const char* path, const Alert* alerts, int count, time_t taken_at,
+                         int shard_count) {
+    (void)path; (void)alerts; (void)count; (void)taken_at; (void)shard_count;
+    (void)snapshot_crc32;
+    return -1;
+}
+
+int alert_snapshot_open(const char* path, int shard_count, AlertSnapshot* snapshot) {
+    (void)path; (void)shard_count; (void)snapshot;
+    return -1;
+}
+
+void alert_snapshot_close(AlertSnapshot* snapshot) {
+    (void)snapshot;
+}
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written <= 0) {
+            return -1;
+        }
+        ptr += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Запись снимка: временный файл, fsync и атомарная замена через rename
+ */
+int alert_snapshot_write(const char* path, const Alert* alerts, int count, time_t taken_at,
+                         int shard_count) {
+    if (!path || (!alerts && count > 0) || count < 0 || shard_count < 1) {
+        return -1;
+    }
+
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        alert_log("ERROR", "Cannot create alert snapshot file");
+        return -1;
+    }
+
+    size_t payload_size = sizeof(Alert) * (size_t)count;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ALERT_SNAPSHOT_MAGIC;
+    header.version = ALERT_SNAPSHOT_VERSION;
+    header.record_size = sizeof(Alert);
+    header.count = (uint32_t)count;
+    header.taken_at = (int64_t)taken_at;
+    header.crc32 = snapshot_crc32(alerts, payload_size);
+    header.shard_count = (uint32_t)shard_count;
+
+    if (write_all(fd, &header, sizeof(header)) != 0 ||
+        write_all(fd, alerts, payload_size) != 0 ||
+        fsync(fd) != 0) {
+        alert_log("ERROR", "Failed to write alert snapshot");
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmp_path, path) != 0) {
+        alert_log("ERROR", "Failed to replace alert snapshot");
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Отображение снимка в память с проверкой версии, раскладки шардов, размера и CRC
+ */
+int alert_snapshot_open(const char* path, int shard_count, AlertSnapshot* snapshot) {
+    if (!path || !snapshot) {
+        return -1;
+    }
+    memset(snapshot, 0, sizeof(AlertSnapshot));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const SnapshotHeader* header = map;
+    const Alert* alerts = (const Alert*)((const char*)map + sizeof(SnapshotHeader));
+    size_t payload_size = (size_t)header->count * sizeof(Alert);
+
+    if (header->magic != ALERT_SNAPSHOT_MAGIC ||
+        header->version != ALERT_SNAPSHOT_VERSION ||
+        header->record_size != sizeof(Alert) ||
+        size != sizeof(SnapshotHeader) + payload_size) {
+        alert_log("WARNING", "Alert snapshot has incompatible format, ignoring");
+        munmap(map, size);
+        return -1;
+    }
+
+    if (header->shard_count != (uint32_t)shard_count) {
+        alert_log("WARNING", "Alert snapshot was taken with another shard layout, ignoring");
+        munmap(map, size);
+        return -1;
+    }
+
+    if (snapshot_crc32(alerts, payload_size) != header->crc32) {
+        alert_log("WARNING", "Alert snapshot checksum mismatch, ignoring");
+        munmap(map, size);
+        return -1;
+    }
+
+    snapshot->map = map;
+    snapshot->map_size = size;
+    snapshot->alerts = alerts;
+    snapshot->count = (int)header->count;
+    snapshot->taken_at = (time_t)header->taken_at;
+    return 0;
+}
+
+void alert_snapshot_close(AlertSnapshot* snapshot) {
+    if (snapshot && snapshot->map) {
+        munmap(snapshot->map, snapshot->map_size);
+        memset(snapshot, 0, sizeof(AlertSnapshot));
+    }
+}
+
+#endif
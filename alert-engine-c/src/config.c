@@ -0,0 +1,140 @@
+#include "../include/config.h"
+#include "../include/alert_engine.h"
+#include "../include/db_shards.h"
+#include "../include/db_maintenance.h"
+#include "../include/persistence.h"
+#include "../include/op_log.h"
+#include "../include/notify_queue.h"
+#include <ctype.h>
+
+/**
+ * Удаление пробелов в начале и конце строки (на месте)
+ */
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return str;
+}
+
+static void copy_value(char* dest, size_t size, const char* value) {
+    strncpy(dest, value, size - 1);
+    dest[size - 1] = '\0';
+}
+
+/**
+ * Применение ключа секции [database]; возвращает -1 для неизвестного ключа
+ */
+static int apply_database_key(const char* key, const char* value) {
+    DbShardConfig* shards = db_shards_get_config();
+    DbMaintenanceConfig* maintenance = db_maintenance_get_config();
+    PersistenceConfig* persistence = persistence_get_config();
+    OpLogConfig* op_log = op_log_get_config();
+
+    if (strcmp(key, "db_path") == 0) {
+        copy_value(shards->db_path, sizeof(shards->db_path), value);
+    } else if (strcmp(key, "shard_count") == 0) {
+        shards->shard_count = atoi(value);
+    } else if (strcmp(key, "durability_window_ms") == 0) {
+        persistence->durability_window_ms = atoi(value);
+    } else if (strcmp(key, "oplog_group_commit_ms") == 0) {
+        op_log->group_commit_ms = atoi(value);
+    } else if (strcmp(key, "backup_dir") == 0) {
+        copy_value(maintenance->backup_dir, sizeof(maintenance->backup_dir), value);
+    } else if (strcmp(key, "backup_interval") == 0) {
+        maintenance->backup_interval = atoi(value);
+    } else if (strcmp(key, "max_backup_files") == 0) {
+        maintenance->max_backup_files = atoi(value);
+    } else if (strcmp(key, "purge_interval") == 0) {
+        maintenance->purge_interval = atoi(value);
+    } else if (strcmp(key, "inactive_retention_days") == 0) {
+        maintenance->inactive_retention = atoi(value) * 24 * 3600;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Применение ключа секции [alerts]; остальные ключи секции движок пока
+ * не использует, поэтому -1 для них не считается ошибкой
+ */
+static int apply_alerts_key(const char* key, const char* value) {
+    NotifyQueueConfig* notify = notify_queue_get_config();
+
+    if (strcmp(key, "notification_digest_ms") == 0) {
+        notify->digest_window_ms = atoi(value);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Загрузка конфигурации
+ *
+ * Формат: секции [name], строки key = value, комментарии с # или ;.
+ * Ключи секций, которые движок пока не использует, пропускаются.
+ */
+int config_load(const char* path) {
+    if (!path) {
+        return -1;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    char line[512];
+    char section[64] = "";
+    int line_number = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* text = trim(line);
+
+        if (*text == '\0' || *text == '#' || *text == ';') {
+            continue;
+        }
+
+        if (*text == '[') {
+            char* close = strchr(text, ']');
+            if (close) {
+                *close = '\0';
+                copy_value(section, sizeof(section), trim(text + 1));
+            }
+            continue;
+        }
+
+        char* eq = strchr(text, '=');
+        if (!eq) {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "Config line %d is not key = value", line_number);
+            alert_log("WARNING", log_msg);
+            continue;
+        }
+        *eq = '\0';
+        char* key = trim(text);
+        char* value = trim(eq + 1);
+
+        if (strcmp(section, "database") == 0 && apply_database_key(key, value) != 0) {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "Unknown database config key: %s", key);
+            alert_log("WARNING", log_msg);
+        } else if (strcmp(section, "alerts") == 0) {
+            apply_alerts_key(key, value);
+        }
+    }
+
+    fclose(file);
+
+    char log_msg[300];
+    snprintf(log_msg, sizeof(log_msg), "Configuration loaded from %s", path);
+    alert_log("INFO", log_msg);
+    return 0;
+}
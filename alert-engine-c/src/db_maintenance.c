@@ -0,0 +1,398 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/db_maintenance.h"
+#include "../include/alert_engine.h"
+#include "../include/db_shards.h"
+#include <stdlib.h>
+#include <string.h>
+
+static DbMaintenanceConfig db_maintenance_config = {
+    .backup_dir = DB_BACKUP_DIR,
+    .backup_interval = DB_BACKUP_INTERVAL,
+    .max_backup_files = DB_MAX_BACKUP_FILES,
+    .purge_interval = DB_PURGE_INTERVAL,
+    .inactive_retention = DB_INACTIVE_RETENTION
+};
+
+void db_maintenance_set_config(const DbMaintenanceConfig* config) {
+    if (config) {
+        db_maintenance_config = *config;
+    }
+}
+
+DbMaintenanceConfig* db_maintenance_get_config(void) {
+    return &db_maintenance_config;
+}
+
+#ifdef _WIN32
+// Windows заглушки: обслуживание базы выполняется вручную
+int db_maintenance_start(void) {
+    return -1;
+}
+
+void db_maintenance_stop(void) {
+}
+
+int db_maintenance_backup_now(void) {
+    return -1;
+}
+
+int db_maintenance_purge_now(void) {
+    return -1;
+}
+#else
+
+#include <sqlite3.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DB_BACKUP_SUFFIX ".db"
+#define DB_BACKUP_STAMP_LEN 15      // YYYYmmdd-HHMMSS
+
+static sqlite3* g_maintenance_dbs[DB_MAX_SHARDS];
+static int g_maintenance_count = 0;
+static pthread_t g_maintenance_thread;
+static bool g_maintenance_running = false;
+static bool g_maintenance_stop = false;
+static pthread_mutex_t g_maintenance_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_maintenance_cond = PTHREAD_COND_INITIALIZER;
+// Ручной запуск и фоновый поток делят соединения
+static pthread_mutex_t g_maintenance_db_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * Удаление самых старых бэкапов шарда сверх max_backup_files.
+ * Имена содержат время создания, поэтому лексикографический порядок хронологический.
+ */
+static void rotate_backups(const char* dir, const char* prefix, int max_files) {
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        return;
+    }
+
+    char** names = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t prefix_len = strlen(prefix);
+    size_t suffix_len = strlen(DB_BACKUP_SUFFIX);
+
+    // Длина имени отделяет бэкапы шарда alerts-1 от бэкапов базы alerts
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len != prefix_len + DB_BACKUP_STAMP_LEN + suffix_len ||
+            strncmp(entry->d_name, prefix, prefix_len) != 0 ||
+            strcmp(entry->d_name + len - suffix_len, DB_BACKUP_SUFFIX) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 16;
+            char** grown = realloc(names, sizeof(char*) * (size_t)new_capacity);
+            if (!grown) {
+                break;
+            }
+            names = grown;
+            capacity = new_capacity;
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count]) {
+            count++;
+        }
+    }
+    closedir(handle);
+
+    if (count > 1) {
+        qsort(names, (size_t)count, sizeof(char*), compare_names);
+    }
+
+    char path[512];
+    for (int i = 0; i < count; i++) {
+        if (i < count - max_files) {
+            snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+            if (unlink(path) == 0) {
+                alert_log("INFO", "Old database backup removed");
+            }
+        }
+        free(names[i]);
+    }
+    free(names);
+}
+
+/**
+ * Онлайн-бэкап порциями по DB_BACKUP_STEP_PAGES страниц.
+ * Копия идет внутри одной читающей транзакции: в режиме WAL она не мешает
+ * потоку записи, а бэкап не перезапускается от его изменений.
+ */
+static int run_backup(int shard) {
+    const DbMaintenanceConfig* config = &db_maintenance_config;
+    sqlite3* source = g_maintenance_dbs[shard];
+
+    // Префикс бэкапа - имя файла шарда без каталога и расширения
+    char prefix[128];
+    const char* shard_path = db_shard_path(shard);
+    const char* base = strrchr(shard_path, '/');
+    base = base ? base + 1 : shard_path;
+    const char* ext = strrchr(base, '.');
+    int base_len = ext ? (int)(ext - base) : (int)strlen(base);
+    snprintf(prefix, sizeof(prefix), "%.*s-", base_len, base);
+
+    mkdir(config->backup_dir, 0755);
+
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_now);
+
+    char path[512];
+    char tmp_path[520];
+    snprintf(path, sizeof(path), "%s/%s%s" DB_BACKUP_SUFFIX,
+             config->backup_dir, prefix, stamp);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    unlink(tmp_path);
+
+    sqlite3* backup_db = NULL;
+    if (sqlite3_open(tmp_path, &backup_db) != SQLITE_OK) {
+        alert_log("ERROR", "Cannot create database backup file");
+        sqlite3_close(backup_db);
+        return -1;
+    }
+
+    sqlite3_backup* backup = sqlite3_backup_init(backup_db, "main", source, "main");
+    if (!backup) {
+        alert_log("ERROR", "Failed to start database backup");
+        sqlite3_close(backup_db);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    sqlite3_exec(source, "BEGIN", 0, 0, NULL);
+    sqlite3_exec(source, "SELECT count(*) FROM sqlite_master", 0, 0, NULL);
+
+    int rc;
+    do {
+        rc = sqlite3_backup_step(backup, DB_BACKUP_STEP_PAGES);
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            // Пауза между порциями ограничивает нагрузку на диск
+            sqlite3_sleep(5);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    sqlite3_backup_finish(backup);
+    sqlite3_exec(source, "COMMIT", 0, 0, NULL);
+
+    int close_rc = sqlite3_close(backup_db);
+    if (rc != SQLITE_DONE || close_rc != SQLITE_OK) {
+        alert_log("ERROR", "Database backup failed");
+        unlink(tmp_path);
+        return -1;
+    }
+
+    // Незавершенный бэкап никогда не попадает под ротацию
+    if (rename(tmp_path, path) != 0) {
+        alert_log("ERROR", "Failed to finalize database backup");
+        unlink(tmp_path);
+        return -1;
+    }
+
+    alert_log("INFO", "Database backup completed");
+    rotate_backups(config->backup_dir, prefix, config->max_backup_files);
+    return 0;
+}
+
+/**
+ * Удаление неактивных алертов старше inactive_retention короткими транзакциями,
+ * затем возврат свободных страниц и пассивный checkpoint
+ */
+static int run_purge(int shard) {
+    sqlite3* db = g_maintenance_dbs[shard];
+    const char* delete_sql =
+        "DELETE FROM alerts WHERE id IN ("
+        "SELECT id FROM alerts WHERE status = ? AND updated_at < ? LIMIT ?)";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, delete_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        alert_log("ERROR", "Failed to prepare purge statement");
+        return -1;
+    }
+
+    sqlite3_int64 cutoff = (sqlite3_int64)time(NULL) - db_maintenance_config.inactive_retention;
+    int purged = 0;
+    int changes;
+
+    do {
+        sqlite3_bind_int(stmt, 1, ALERT_STATUS_INACTIVE);
+        sqlite3_bind_int64(stmt, 2, cutoff);
+        sqlite3_bind_int(stmt, 3, DB_PURGE_BATCH);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            alert_log("ERROR", "Failed to purge inactive alerts");
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+        changes = sqlite3_changes(db);
+        purged += changes;
+        sqlite3_reset(stmt);
+
+        // Поток записи успевает взять блокировку между пачками
+        if (changes == DB_PURGE_BATCH) {
+            sqlite3_sleep(5);
+        }
+    } while (changes == DB_PURGE_BATCH);
+
+    sqlite3_finalize(stmt);
+
+    if (purged > 0) {
+        char message[128];
+        snprintf(message, sizeof(message), "Purged %d inactive alerts", purged);
+        alert_log("INFO", message);
+    }
+
+    char vacuum_sql[64];
+    snprintf(vacuum_sql, sizeof(vacuum_sql), "PRAGMA incremental_vacuum(%d)", DB_VACUUM_PAGES);
+    sqlite3_exec(db, vacuum_sql, 0, 0, NULL);
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(PASSIVE)", 0, 0, NULL);
+
+    return purged;
+}
+
+int db_maintenance_backup_now(void) {
+    if (!g_maintenance_running) {
+        return -1;
+    }
+    int result = 0;
+    pthread_mutex_lock(&g_maintenance_db_mutex);
+    for (int i = 0; i < g_maintenance_count; i++) {
+        if (run_backup(i) != 0) {
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&g_maintenance_db_mutex);
+    return result;
+}
+
+int db_maintenance_purge_now(void) {
+    if (!g_maintenance_running) {
+        return -1;
+    }
+    int result = 0;
+    pthread_mutex_lock(&g_maintenance_db_mutex);
+    for (int i = 0; i < g_maintenance_count; i++) {
+        int purged = run_purge(i);
+        if (purged < 0 || result < 0) {
+            result = -1;
+        } else {
+            result += purged;
+        }
+    }
+    pthread_mutex_unlock(&g_maintenance_db_mutex);
+    return result;
+}
+
+/**
+ * Поток обслуживания: просыпается раз в секунду или по сигналу остановки
+ */
+static void* db_maintenance_thread(void* arg) {
+    (void)arg;
+
+    time_t now = time(NULL);
+    time_t next_backup = now + db_maintenance_config.backup_interval;
+    time_t next_purge = now + db_maintenance_config.purge_interval;
+
+    pthread_mutex_lock(&g_maintenance_mutex);
+    while (!g_maintenance_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&g_maintenance_cond, &g_maintenance_mutex, &deadline);
+        if (g_maintenance_stop) {
+            break;
+        }
+        pthread_mutex_unlock(&g_maintenance_mutex);
+
+        const DbMaintenanceConfig* config = &db_maintenance_config;
+        now = time(NULL);
+
+        if (config->backup_interval > 0 && now >= next_backup) {
+            db_maintenance_backup_now();
+            next_backup = time(NULL) + config->backup_interval;
+        }
+
+        if (config->purge_interval > 0 && now >= next_purge) {
+            db_maintenance_purge_now();
+            next_purge = time(NULL) + config->purge_interval;
+        }
+
+        pthread_mutex_lock(&g_maintenance_mutex);
+    }
+    pthread_mutex_unlock(&g_maintenance_mutex);
+
+    return NULL;
+}
+
+static void close_connections(void) {
+    for (int i = 0; i < g_maintenance_count; i++) {
+        sqlite3_close(g_maintenance_dbs[i]);
+        g_maintenance_dbs[i] = NULL;
+    }
+    g_maintenance_count = 0;
+}
+
+/**
+ * Запуск потока обслуживания с собственными соединениями к шардам базы
+ */
+int db_maintenance_start(void) {
+    if (g_maintenance_running || db_shard_count() < 1) {
+        return -1;
+    }
+
+    for (int i = 0; i < db_shard_count(); i++) {
+        int rc = sqlite3_open(db_shard_path(i), &g_maintenance_dbs[i]);
+        g_maintenance_count = i + 1;
+        if (rc != SQLITE_OK) {
+            alert_log("ERROR", "Cannot open database for maintenance");
+            close_connections();
+            return -1;
+        }
+        sqlite3_busy_timeout(g_maintenance_dbs[i], 5000);
+    }
+
+    g_maintenance_stop = false;
+    if (pthread_create(&g_maintenance_thread, NULL, db_maintenance_thread, NULL) != 0) {
+        alert_log("ERROR", "Failed to start database maintenance thread");
+        close_connections();
+        return -1;
+    }
+
+    g_maintenance_running = true;
+    alert_log("INFO", "Database maintenance started");
+    return 0;
+}
+
+/**
+ * Остановка потока; начатый бэкап доводится до конца
+ */
+void db_maintenance_stop(void) {
+    if (!g_maintenance_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_maintenance_mutex);
+    g_maintenance_stop = true;
+    pthread_cond_signal(&g_maintenance_cond);
+    pthread_mutex_unlock(&g_maintenance_mutex);
+
+    pthread_join(g_maintenance_thread, NULL);
+    g_maintenance_running = false;
+
+    close_connections();
+
+    alert_log("INFO", "Database maintenance stopped");
+}
+
+#endif
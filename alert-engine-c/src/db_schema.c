@@ -0,0 +1,157 @@
+#include "../include/db_schema.h"
+#include "../include/alert_engine.h"
+
+typedef struct {
+    int version;
+    const char* description;
+    const char* sql;
+} SchemaMigration;
+
+// Миграции применяются строго по возрастанию версии; уже выпущенные не меняются
+static const SchemaMigration g_migrations[] = {
+    { 1, "initial schema",
+      "CREATE TABLE IF NOT EXISTS alerts ("
+      "id INTEGER PRIMARY KEY,"
+      "user_id TEXT NOT NULL,"
+      "symbol TEXT NOT NULL,"
+      "type INTEGER NOT NULL,"
+      "target_value REAL NOT NULL,"
+      "status INTEGER NOT NULL,"
+      "created_at INTEGER NOT NULL,"
+      "last_triggered INTEGER,"
+      "trigger_count INTEGER DEFAULT 0,"
+      "message TEXT,"
+      "is_repeatable INTEGER DEFAULT 1,"
+      "cooldown_minutes INTEGER DEFAULT 60,"
+      "required_tier INTEGER DEFAULT 0,"
+      "expression TEXT,"
+      "trigger_mode INTEGER DEFAULT 0,"
+      "hysteresis REAL DEFAULT 0,"
+      "activate_at INTEGER DEFAULT 0,"
+      "expires_at INTEGER DEFAULT 0,"
+      "check_at INTEGER DEFAULT 0,"
+      "updated_at INTEGER DEFAULT 0"
+      ");"
+      "CREATE INDEX IF NOT EXISTS idx_alerts_updated_at ON alerts(updated_at);"
+      "CREATE TABLE IF NOT EXISTS portfolio_holdings ("
+      "user_id TEXT NOT NULL,"
+      "symbol TEXT NOT NULL,"
+      "quantity REAL NOT NULL,"
+      "PRIMARY KEY (user_id, symbol)"
+      ");" },
+
+    // По статусу ищет только очистка удаленных алертов:
+    // SEARCH alerts USING COVERING INDEX idx_alerts_status_updated
+    // (status=? AND updated_at<?). Загрузка при старте читает почти все
+    // строки и дешевле полным проходом, а выборок по user_id нет
+    { 2, "purge index",
+      "CREATE INDEX IF NOT EXISTS idx_alerts_status_updated ON alerts(status, updated_at);" },
+
+    // Последний номер журнала операций, примененный к этой базе
+    { 3, "operation log state",
+      "CREATE TABLE IF NOT EXISTS oplog_state ("
+      "id INTEGER PRIMARY KEY CHECK (id = 0),"
+      "applied_seq INTEGER NOT NULL"
+      ");"
+      "INSERT OR IGNORE INTO oplog_state (id, applied_seq) VALUES (0, 0);" }
+};
+
+// Колонки, которые базы без версии получали через ALTER при каждом запуске
+static const char* g_legacy_columns[] = {
+    "expression TEXT",
+    "trigger_mode INTEGER DEFAULT 0",
+    "hysteresis REAL DEFAULT 0",
+    "activate_at INTEGER DEFAULT 0",
+    "expires_at INTEGER DEFAULT 0",
+    "check_at INTEGER DEFAULT 0",
+    "updated_at INTEGER DEFAULT 0"
+};
+
+static int query_int(sqlite3* db, const char* sql, int* value) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    int rc = sqlite3_step(stmt);
+    *value = rc == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE ? 0 : -1;
+}
+
+/**
+ * Доведение базы без версии до уровня первой миграции: таблица alerts
+ * могла быть создана любой из прошлых версий, недостающие колонки
+ * добавляются, ошибка "duplicate column" ожидаема
+ */
+static void adopt_legacy_schema(sqlite3* db) {
+    char sql[128];
+    for (size_t i = 0; i < sizeof(g_legacy_columns) / sizeof(g_legacy_columns[0]); i++) {
+        snprintf(sql, sizeof(sql), "ALTER TABLE alerts ADD COLUMN %s", g_legacy_columns[i]);
+        sqlite3_exec(db, sql, 0, 0, NULL);
+    }
+}
+
+/**
+ * Применение недостающих миграций по PRAGMA user_version
+ */
+int db_schema_migrate(sqlite3* db) {
+    if (!db) {
+        return -1;
+    }
+
+    int version = 0;
+    if (query_int(db, "PRAGMA user_version", &version) != 0) {
+        alert_log("ERROR", "Failed to read schema version");
+        return -1;
+    }
+
+    if (version > DB_SCHEMA_VERSION) {
+        alert_log("ERROR", "Database schema is newer than this build");
+        return -2;
+    }
+
+    if (version == 0) {
+        int legacy_tables = 0;
+        query_int(db, "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'alerts'",
+                  &legacy_tables);
+        if (legacy_tables > 0) {
+            adopt_legacy_schema(db);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(g_migrations) / sizeof(g_migrations[0]); i++) {
+        const SchemaMigration* migration = &g_migrations[i];
+        if (migration->version <= version) {
+            continue;
+        }
+
+        char version_sql[64];
+        snprintf(version_sql, sizeof(version_sql), "PRAGMA user_version = %d", migration->version);
+
+        if (sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, NULL) != SQLITE_OK) {
+            alert_log("ERROR", "Failed to start schema migration");
+            return -1;
+        }
+
+        if (sqlite3_exec(db, migration->sql, 0, 0, NULL) != SQLITE_OK ||
+            sqlite3_exec(db, version_sql, 0, 0, NULL) != SQLITE_OK ||
+            sqlite3_exec(db, "COMMIT", 0, 0, NULL) != SQLITE_OK) {
+            char message[256];
+            snprintf(message, sizeof(message), "Schema migration %d (%s) failed: %s",
+                     migration->version, migration->description, sqlite3_errmsg(db));
+            alert_log("ERROR", message);
+            sqlite3_exec(db, "ROLLBACK", 0, 0, NULL);
+            return -1;
+        }
+
+        char message[128];
+        snprintf(message, sizeof(message), "Schema migrated to version %d (%s)",
+                 migration->version, migration->description);
+        alert_log("INFO", message);
+        version = migration->version;
+    }
+
+    // Статистика для планировщика запросов по новым индексам
+    sqlite3_exec(db, "PRAGMA optimize", 0, 0, NULL);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "../include/db_shards.h"
+#include "../include/alert_engine.h"
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_dir(path) mkdir(path, 0755)
+#endif
+
+static DbShardConfig db_shard_config = {
+    .db_path = ALERT_DB_PATH,
+    .shard_count = 1
+};
+
+static char g_shard_paths[DB_MAX_SHARDS][300];
+static int g_shard_count = 0;
+
+/**
+ * FNV-1a хэш строки
+ */
+static uint32_t shard_hash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Создание каталога базы, если путь его содержит
+ */
+static void ensure_parent_dir(const char* path) {
+    char dir[256];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+
+    char* slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        make_dir(dir);
+    }
+}
+
+static bool file_exists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+static const char* skip_current_dir(const char* path) {
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    return path;
+}
+
+/**
+ * База прежних версий: до чтения [database] движок всегда работал
+ * с ALERT_DB_PATH. Если db_path указывает на другой, еще не созданный файл,
+ * база одного шарда переносится туда вместе с WAL, иначе выводится
+ * предупреждение, чтобы движок не стартовал молча с пустым хранилищем.
+ */
+static void adopt_legacy_database(const DbShardConfig* config) {
+    if (strcmp(skip_current_dir(config->db_path), skip_current_dir(ALERT_DB_PATH)) == 0 ||
+        !file_exists(ALERT_DB_PATH)) {
+        return;
+    }
+
+    char message[512];
+    if (config->shard_count > 1) {
+        snprintf(message, sizeof(message),
+                 "Legacy database %s is not used by sharded storage at %s; "
+                 "its alerts must be imported manually", ALERT_DB_PATH, config->db_path);
+        alert_log("WARNING", message);
+        return;
+    }
+    if (file_exists(config->db_path)) {
+        snprintf(message, sizeof(message),
+                 "Legacy database %s is not used, db_path is %s; move it there "
+                 "or set db_path = %s to keep using it",
+                 ALERT_DB_PATH, config->db_path, ALERT_DB_PATH);
+        alert_log("WARNING", message);
+        return;
+    }
+
+    if (rename(ALERT_DB_PATH, config->db_path) != 0) {
+        snprintf(message, sizeof(message),
+                 "Failed to move legacy database %s to %s; move it manually "
+                 "or set db_path = %s", ALERT_DB_PATH, config->db_path, ALERT_DB_PATH);
+        alert_log("WARNING", message);
+        return;
+    }
+
+    static const char* suffixes[] = { "-wal", "-shm" };
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        char from[300];
+        char to[300];
+        snprintf(from, sizeof(from), "%s%s", ALERT_DB_PATH, suffixes[i]);
+        snprintf(to, sizeof(to), "%s%s", config->db_path, suffixes[i]);
+        if (file_exists(from)) {
+            rename(from, to);
+        }
+    }
+
+    snprintf(message, sizeof(message), "Moved legacy database %s to %s",
+             ALERT_DB_PATH, config->db_path);
+    alert_log("INFO", message);
+}
+
+/**
+ * Построение путей шардов по текущей конфигурации
+ */
+int db_shards_init(void) {
+    const DbShardConfig* config = &db_shard_config;
+
+    if (config->db_path[0] == '\0' ||
+        config->shard_count < 1 || config->shard_count > DB_MAX_SHARDS) {
+        alert_log("ERROR", "Invalid database shard configuration");
+        return -1;
+    }
+
+    ensure_parent_dir(config->db_path);
+    adopt_legacy_database(config);
+
+    if (config->shard_count == 1) {
+        snprintf(g_shard_paths[0], sizeof(g_shard_paths[0]), "%s", config->db_path);
+        g_shard_count = 1;
+        return 0;
+    }
+
+    size_t stem_len = strlen(config->db_path);
+    const char* ext = strrchr(config->db_path, '.');
+    const char* slash = strrchr(config->db_path, '/');
+    if (ext && (!slash || ext > slash)) {
+        stem_len = (size_t)(ext - config->db_path);
+    } else {
+        ext = "";
+    }
+
+    for (int i = 0; i < config->shard_count; i++) {
+        snprintf(g_shard_paths[i], sizeof(g_shard_paths[i]), "%.*s-%d%s",
+                 (int)stem_len, config->db_path, i, ext);
+    }
+    g_shard_count = config->shard_count;
+
+    char message[128];
+    snprintf(message, sizeof(message), "Alert storage sharded across %d databases", g_shard_count);
+    alert_log("INFO", message);
+    return 0;
+}
+
+int db_shard_count(void) {
+    return g_shard_count;
+}
+
+const char* db_shard_path(int shard) {
+    if (shard < 0 || shard >= g_shard_count) {
+        return NULL;
+    }
+    return g_shard_paths[shard];
+}
+
+int db_shard_for_user(const char* user_id) {
+    if (!user_id || g_shard_count <= 1) {
+        return 0;
+    }
+    return (int)(shard_hash(user_id) % (uint32_t)g_shard_count);
+}
+
+void db_shards_set_config(const DbShardConfig* config) {
+    if (config) {
+        db_shard_config = *config;
+    }
+}
+
+DbShardConfig* db_shards_get_config(void) {
+    return &db_shard_config;
+}
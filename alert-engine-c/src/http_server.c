@@ -1,5 +1,7 @@
 #include "../include/http_server.h"
 #include "../include/alert_engine.h"
+#include "../include/price_history.h"
+#include "../include/msgpack_writer.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -41,6 +43,222 @@ int MHD_add_response_header(struct MHD_Response* response, const char* header, c
 static struct MHD_Daemon* g_http_daemon = NULL;
 static bool g_http_running = false;
 
+#define TRIGGER_HISTORY_DEFAULT_LIMIT 100
+#define TRIGGER_HISTORY_MAX_LIMIT 1000
+#define PRICE_HISTORY_DEFAULT_LIMIT 500
+#define PRICE_HISTORY_MAX_LIMIT 10000
+
+#ifndef _WIN32
+/**
+ * Клиент просит MessagePack заголовком Accept; иначе ответ в JSON
+ */
+static bool accepts_msgpack(struct MHD_Connection* connection) {
+    const char* accept = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept");
+    return accept && (strstr(accept, MSGPACK_CONTENT_TYPE) || strstr(accept, "application/x-msgpack"));
+}
+
+/**
+ * Тело ответа: JSON освобождается через cJSON_free, MessagePack через free
+ */
+static void free_body(char* body, bool msgpack) {
+    if (msgpack) {
+        free(body);
+    } else {
+        cJSON_free(body);
+    }
+}
+
+/**
+ * История срабатываний в MessagePack, те же поля, что и в JSON
+ */
+static char* trigger_history_msgpack(const char* user_id, const TriggerRecord* records,
+                                     int count, size_t* length) {
+    MsgPackWriter writer;
+    if (msgpack_writer_init(&writer, 64 + (size_t)count * 96) != 0) {
+        return NULL;
+    }
+
+    msgpack_write_map(&writer, 3);
+    msgpack_write_str(&writer, "user_id");
+    msgpack_write_str(&writer, user_id);
+    msgpack_write_str(&writer, "count");
+    msgpack_write_int(&writer, count);
+    msgpack_write_str(&writer, "triggers");
+    msgpack_write_array(&writer, (uint32_t)count);
+
+    for (int i = 0; i < count; i++) {
+        char symbol[MAX_SYMBOL_LEN];
+        trigger_journal_symbol(records[i].symbol_id, symbol, sizeof(symbol));
+        
+        msgpack_write_map(&writer, 6);
+        msgpack_write_str(&writer, "alert_id");
+        msgpack_write_int(&writer, records[i].alert_id);
+        msgpack_write_str(&writer, "symbol");
+        msgpack_write_str(&writer, symbol);
+        msgpack_write_str(&writer, "price");
+        msgpack_write_double(&writer, records[i].price);
+        msgpack_write_str(&writer, "timestamp");
+        msgpack_write_int(&writer, (int64_t)records[i].timestamp);
+        msgpack_write_str(&writer, "type");
+        msgpack_write_int(&writer, TRIGGER_FLAGS_TYPE(records[i].flags));
+        msgpack_write_str(&writer, "trigger_mode");
+        msgpack_write_int(&writer, TRIGGER_FLAGS_MODE(records[i].flags));
+    }
+
+    return (char*)msgpack_writer_detach(&writer, length);
+}
+
+/**
+ * История цен в MessagePack: пары [timestamp, price] без промежуточного дерева
+ */
+static char* price_history_msgpack(const char* symbol, const PricePoint* points,
+                                   int count, size_t* length) {
+    MsgPackWriter writer;
+    if (msgpack_writer_init(&writer, 64 + (size_t)count * 20) != 0) {
+        return NULL;
+    }
+
+    msgpack_write_map(&writer, 3);
+    msgpack_write_str(&writer, "symbol");
+    msgpack_write_str(&writer, symbol);
+    msgpack_write_str(&writer, "count");
+    msgpack_write_int(&writer, count);
+    msgpack_write_str(&writer, "points");
+    msgpack_write_array(&writer, (uint32_t)count);
+
+    for (int i = 0; i < count; i++) {
+        msgpack_write_array(&writer, 2);
+        msgpack_write_int(&writer, points[i].timestamp);
+        msgpack_write_double(&writer, points[i].price);
+    }
+
+    return (char*)msgpack_writer_detach(&writer, length);
+}
+
+/**
+ * GET /api/triggers?user_id=...&from=...&to=...&limit=...
+ *
+ * История срабатываний из журнала, от новых к старым. Возвращает тело
+ * в JSON или MessagePack (см. free_body) или NULL при неверных параметрах.
+ */
+static char* handle_trigger_history(struct MHD_Connection* connection, bool msgpack, size_t* length) {
+    const char* user_id = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "user_id");
+    const char* from_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "from");
+    const char* to_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "to");
+    const char* limit_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    
+    if (!user_id || !*user_id) {
+        return NULL;
+    }
+    
+    time_t from = from_arg ? (time_t)atoll(from_arg) : 0;
+    time_t to = to_arg ? (time_t)atoll(to_arg) : time(NULL);
+    int limit = limit_arg ? atoi(limit_arg) : TRIGGER_HISTORY_DEFAULT_LIMIT;
+    if (limit <= 0 || limit > TRIGGER_HISTORY_MAX_LIMIT) {
+        limit = TRIGGER_HISTORY_MAX_LIMIT;
+    }
+    
+    TriggerRecord* records = malloc(sizeof(TriggerRecord) * (size_t)limit);
+    if (!records) {
+        return NULL;
+    }
+    
+    int count = alert_trigger_history(user_id, from, to, records, limit);
+    if (count < 0) {
+        free(records);
+        return NULL;
+    }
+    
+    if (msgpack) {
+        char* body = trigger_history_msgpack(user_id, records, count, length);
+        free(records);
+        return body;
+    }
+    
+    cJSON* root = cJSON_CreateObject();
+    cJSON* triggers = cJSON_CreateArray();
+    cJSON_AddStringToObject(root, "user_id", user_id);
+    cJSON_AddNumberToObject(root, "count", count);
+    
+    for (int i = 0; i < count; i++) {
+        char symbol[MAX_SYMBOL_LEN];
+        trigger_journal_symbol(records[i].symbol_id, symbol, sizeof(symbol));
+        
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "alert_id", records[i].alert_id);
+        cJSON_AddStringToObject(item, "symbol", symbol);
+        cJSON_AddNumberToObject(item, "price", records[i].price);
+        cJSON_AddNumberToObject(item, "timestamp", (double)records[i].timestamp);
+        cJSON_AddNumberToObject(item, "type", TRIGGER_FLAGS_TYPE(records[i].flags));
+        cJSON_AddNumberToObject(item, "trigger_mode", TRIGGER_FLAGS_MODE(records[i].flags));
+        cJSON_AddItemToArray(triggers, item);
+    }
+    cJSON_AddItemToObject(root, "triggers", triggers);
+    
+    char* json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    free(records);
+    *length = json ? strlen(json) : 0;
+    return json;
+}
+
+/**
+ * GET /api/history?symbol=...&from=...&to=...&limit=...
+ *
+ * Последние limit точек истории цен символа в порядке возрастания времени,
+ * массив пар [timestamp, price]. NULL при неверных параметрах.
+ */
+static char* handle_price_history(struct MHD_Connection* connection, bool msgpack, size_t* length) {
+    const char* symbol = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "symbol");
+    const char* from_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "from");
+    const char* to_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "to");
+    const char* limit_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    
+    if (!symbol || !*symbol) {
+        return NULL;
+    }
+    
+    time_t from = from_arg ? (time_t)atoll(from_arg) : 0;
+    time_t to = to_arg ? (time_t)atoll(to_arg) : time(NULL);
+    int limit = limit_arg ? atoi(limit_arg) : PRICE_HISTORY_DEFAULT_LIMIT;
+    if (limit <= 0 || limit > PRICE_HISTORY_MAX_LIMIT) {
+        limit = PRICE_HISTORY_MAX_LIMIT;
+    }
+    
+    PricePoint* points = malloc(sizeof(PricePoint) * (size_t)limit);
+    if (!points) {
+        return NULL;
+    }
+    
+    int count = price_history_read(symbol, from, to, points, limit);
+    
+    if (msgpack) {
+        char* body = price_history_msgpack(symbol, points, count, length);
+        free(points);
+        return body;
+    }
+    
+    cJSON* root = cJSON_CreateObject();
+    cJSON* series = cJSON_CreateArray();
+    cJSON_AddStringToObject(root, "symbol", symbol);
+    cJSON_AddNumberToObject(root, "count", count);
+    
+    for (int i = 0; i < count; i++) {
+        cJSON* pair = cJSON_CreateArray();
+        cJSON_AddItemToArray(pair, cJSON_CreateNumber((double)points[i].timestamp));
+        cJSON_AddItemToArray(pair, cJSON_CreateNumber(points[i].price));
+        cJSON_AddItemToArray(series, pair);
+    }
+    cJSON_AddItemToObject(root, "points", series);
+    
+    char* json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    free(points);
+    *length = json ? strlen(json) : 0;
+    return json;
+}
+#endif
+
 /**
  * Ответ на HTTP запрос
  */
@@ -61,6 +279,9 @@ static int answer_to_connection(void *cls, struct MHD_Connection *connection,
 #else
     struct MHD_Response *response;
     int ret;
+    const char* content_type = "application/json";
+    bool msgpack = accepts_msgpack(connection);
+    size_t length = 0;
 
     // CORS headers
     const char* cors_headers = 
@@ -86,6 +307,44 @@ static int answer_to_connection(void *cls, struct MHD_Connection *connection,
         response = MHD_create_response_from_buffer(strlen(health_response), 
                                                  (void*)health_response, 
                                                  MHD_RESPMEM_MUST_COPY);
+    } else if (strcmp(url, "/api/triggers") == 0) {
+        char* history = handle_trigger_history(connection, msgpack, &length);
+        if (!history) {
+            const char* bad_request = "{\"error\":\"user_id is required\",\"status\":400}";
+            response = MHD_create_response_from_buffer(strlen(bad_request), 
+                                                     (void*)bad_request, 
+                                                     MHD_RESPMEM_MUST_COPY);
+            MHD_add_response_header(response, "Content-Type", "application/json");
+            ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
+            MHD_destroy_response(response);
+            return ret;
+        }
+        response = MHD_create_response_from_buffer(length, 
+                                                 (void*)history, 
+                                                 MHD_RESPMEM_MUST_COPY);
+        free_body(history, msgpack);
+        if (msgpack) {
+            content_type = MSGPACK_CONTENT_TYPE;
+        }
+    } else if (strcmp(url, "/api/history") == 0) {
+        char* history = handle_price_history(connection, msgpack, &length);
+        if (!history) {
+            const char* bad_request = "{\"error\":\"symbol is required\",\"status\":400}";
+            response = MHD_create_response_from_buffer(strlen(bad_request), 
+                                                     (void*)bad_request, 
+                                                     MHD_RESPMEM_MUST_COPY);
+            MHD_add_response_header(response, "Content-Type", "application/json");
+            ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
+            MHD_destroy_response(response);
+            return ret;
+        }
+        response = MHD_create_response_from_buffer(length, 
+                                                 (void*)history, 
+                                                 MHD_RESPMEM_MUST_COPY);
+        free_body(history, msgpack);
+        if (msgpack) {
+            content_type = MSGPACK_CONTENT_TYPE;
+        }
     } else if (strncmp(url, "/api/alerts", 11) == 0) {
         // Alerts API placeholder
         char alerts_response[256];
@@ -106,7 +365,7 @@ static int answer_to_connection(void *cls, struct MHD_Connection *connection,
         return ret;
     }
 
-    MHD_add_response_header(response, "Content-Type", "application/json");
+    MHD_add_response_header(response, "Content-Type", content_type);
     MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
     ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
     MHD_destroy_response(response);
@@ -1,4 +1,5 @@
 #include "include/alert_engine.h"
+#include "include/config.h"
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
@@ -10,9 +11,22 @@ void signal_handler(int sig) {
     running = false;
 }
 
-int main(void) {
+int main(int argc, char* argv[]) {
     printf("Starting Alert Engine C Server...\n");
     
+    // Путь к конфигурации: -c <file>, иначе файл по умолчанию, если он есть
+    const char* config_path = NULL;
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            config_path = argv[i + 1];
+        }
+    }
+    
+    if (config_load(config_path ? config_path : ALERT_CONFIG_PATH) != 0 && config_path) {
+        printf("Failed to load configuration from %s\n", config_path);
+        return 1;
+    }
+    
     // Установка обработчиков сигналов
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -10,6 +10,7 @@
 #endif
 
 #include "../include/market_client.h"
+#include "../include/price_history.h"
 #include "../include/alert_engine.h"
 #include <time.h>
 #include <math.h>
@@ -489,7 +490,7 @@ int parse_market_data_response(APIResponse* response, CryptoPrice* prices, int m
         }
         
         price->last_updated = time(NULL);
-        price->rsi_14 = calculate_rsi_for_symbol(price->symbol, 14);
+        price->rsi_14 = 50.0; // Нейтральное значение до пересчета по истории
         price->is_valid = true;
         
         count++;
@@ -610,14 +611,24 @@ char* url_encode(const char* str) {
  * Расчет RSI для символа
  */
 double calculate_rsi_for_symbol(const char* symbol, int period) {
-    // Упрощенная реализация RSI
-    // В реальной реализации нужно получать исторические данные
+    if (!symbol || period <= 0 || period > RSI_MAX_PERIOD) {
+        return -1.0;
+    }
+    
+    // Сглаживание Уайлдера сходится за несколько периодов
+    PricePoint points[RSI_MAX_PERIOD * RSI_WARMUP_PERIODS + 1];
+    int max_points = period * RSI_WARMUP_PERIODS + 1;
+    int count = price_history_read(symbol, 0, time(NULL), points, max_points);
+    if (count <= period) {
+        return -1.0;
+    }
     
-    // Для демонстрации возвращаем случайное значение RSI
-    srand(time(NULL) + (int)symbol[0]);
-    double rsi = 30.0 + (rand() % 40); // RSI между 30 и 70
+    double prices[RSI_MAX_PERIOD * RSI_WARMUP_PERIODS + 1];
+    for (int i = 0; i < count; i++) {
+        prices[i] = points[i].price;
+    }
     
-    return rsi;
+    return calculate_rsi(prices, count, period);
 }
 
 /**
@@ -0,0 +1,154 @@
+#include "../include/msgpack_writer.h"
+#include <stdlib.h>
+#include <string.h>
+
+int msgpack_writer_init(MsgPackWriter* writer, size_t capacity) {
+    writer->data = malloc(capacity ? capacity : 64);
+    writer->size = 0;
+    writer->capacity = capacity ? capacity : 64;
+    writer->failed = writer->data == NULL;
+    return writer->failed ? -1 : 0;
+}
+
+void msgpack_writer_free(MsgPackWriter* writer) {
+    free(writer->data);
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+}
+
+unsigned char* msgpack_writer_detach(MsgPackWriter* writer, size_t* size) {
+    if (writer->failed) {
+        msgpack_writer_free(writer);
+        return NULL;
+    }
+
+    unsigned char* data = writer->data;
+    *size = writer->size;
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+    return data;
+}
+
+static unsigned char* reserve(MsgPackWriter* writer, size_t length) {
+    if (writer->failed) {
+        return NULL;
+    }
+
+    if (writer->size + length > writer->capacity) {
+        size_t capacity = writer->capacity * 2;
+        while (capacity < writer->size + length) {
+            capacity *= 2;
+        }
+        unsigned char* grown = realloc(writer->data, capacity);
+        if (!grown) {
+            writer->failed = true;
+            return NULL;
+        }
+        writer->data = grown;
+        writer->capacity = capacity;
+    }
+
+    unsigned char* out = writer->data + writer->size;
+    writer->size += length;
+    return out;
+}
+
+/**
+ * Маркер и значение в big-endian (порядок байт MessagePack)
+ */
+static void write_tagged(MsgPackWriter* writer, unsigned char tag, uint64_t value, int bytes) {
+    unsigned char* out = reserve(writer, 1 + (size_t)bytes);
+    if (!out) {
+        return;
+    }
+    out[0] = tag;
+    for (int i = 0; i < bytes; i++) {
+        out[1 + i] = (unsigned char)(value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+static void write_header(MsgPackWriter* writer, uint32_t count, unsigned char fix_tag,
+                         uint32_t fix_limit, unsigned char tag16, unsigned char tag32) {
+    if (count < fix_limit) {
+        write_tagged(writer, (unsigned char)(fix_tag | count), 0, 0);
+    } else if (count <= 0xFFFF) {
+        write_tagged(writer, tag16, count, 2);
+    } else {
+        write_tagged(writer, tag32, count, 4);
+    }
+}
+
+void msgpack_write_map(MsgPackWriter* writer, uint32_t count) {
+    write_header(writer, count, 0x80, 16, 0xde, 0xdf);
+}
+
+void msgpack_write_array(MsgPackWriter* writer, uint32_t count) {
+    write_header(writer, count, 0x90, 16, 0xdc, 0xdd);
+}
+
+void msgpack_write_str_len(MsgPackWriter* writer, const char* str, uint32_t length) {
+    if (length < 32) {
+        write_tagged(writer, (unsigned char)(0xa0 | length), 0, 0);
+    } else if (length <= 0xFF) {
+        write_tagged(writer, 0xd9, length, 1);
+    } else if (length <= 0xFFFF) {
+        write_tagged(writer, 0xda, length, 2);
+    } else {
+        write_tagged(writer, 0xdb, length, 4);
+    }
+
+    unsigned char* out = reserve(writer, length);
+    if (out) {
+        memcpy(out, str, length);
+    }
+}
+
+void msgpack_write_str(MsgPackWriter* writer, const char* str) {
+    msgpack_write_str_len(writer, str ? str : "", str ? (uint32_t)strlen(str) : 0);
+}
+
+/**
+ * Целое в самой короткой форме
+ */
+void msgpack_write_int(MsgPackWriter* writer, int64_t value) {
+    if (value >= 0) {
+        uint64_t u = (uint64_t)value;
+        if (u < 128) {
+            write_tagged(writer, (unsigned char)u, 0, 0);
+        } else if (u <= 0xFF) {
+            write_tagged(writer, 0xcc, u, 1);
+        } else if (u <= 0xFFFF) {
+            write_tagged(writer, 0xcd, u, 2);
+        } else if (u <= 0xFFFFFFFFu) {
+            write_tagged(writer, 0xce, u, 4);
+        } else {
+            write_tagged(writer, 0xcf, u, 8);
+        }
+    } else if (value >= -32) {
+        write_tagged(writer, (unsigned char)(int8_t)value, 0, 0);
+    } else if (value >= INT8_MIN) {
+        write_tagged(writer, 0xd0, (uint64_t)value & 0xFF, 1);
+    } else if (value >= INT16_MIN) {
+        write_tagged(writer, 0xd1, (uint64_t)value & 0xFFFF, 2);
+    } else if (value >= INT32_MIN) {
+        write_tagged(writer, 0xd2, (uint64_t)value & 0xFFFFFFFFu, 4);
+    } else {
+        write_tagged(writer, 0xd3, (uint64_t)value, 8);
+    }
+}
+
+void msgpack_write_double(MsgPackWriter* writer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_tagged(writer, 0xcb, bits, 8);
+}
+
+void msgpack_write_bool(MsgPackWriter* writer, bool value) {
+    write_tagged(writer, value ? 0xc3 : 0xc2, 0, 0);
+}
+
+void msgpack_write_nil(MsgPackWriter* writer) {
+    write_tagged(writer, 0xc0, 0, 0);
+}
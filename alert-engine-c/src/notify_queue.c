@@ -0,0 +1,418 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/notify_queue.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Ограниченная очередь с номером в каждой ячейке (схема Вьюкова):
+// ячейка свободна для позиции pos, когда ее sequence == pos, и заполнена,
+// когда sequence == pos + 1. Производители занимают позицию CAS на tail,
+// единственный потребитель читает head без атомарных операций над ним.
+typedef struct {
+    size_t sequence;
+    bool batch_end;                 // Отметка конца пачки вместо записи
+    TriggerNotification notification;
+} NotifyCell;
+
+// Запись, не поместившаяся в кольцо. Пока список не пуст, производители
+// пишут только в него, а потребитель забирает его целиком, когда кольцо
+// опустело, поэтому порядок записей сохраняется.
+typedef struct NotifyOverflow {
+    struct NotifyOverflow* next;
+    bool batch_end;
+    TriggerNotification notification;
+} NotifyOverflow;
+
+typedef struct {
+    NotifyCell* cells;
+    size_t tail;                    // Следующая позиция производителей
+    size_t head;                    // Следующая позиция потребителя (только поток доставки)
+    uint64_t dropped;
+    uint64_t overflowed;
+
+    // Переполнение кольца
+    NotifyOverflow* overflow_head;  // Под overflow_mutex
+    NotifyOverflow* overflow_tail;
+    bool overflow_active;           // Список не пуст; пишется под overflow_mutex
+    NotifyOverflow* pending;        // Забранный список (только поток доставки)
+    pthread_mutex_t overflow_mutex;
+
+    // Накопленная пачка (только поток доставки)
+    TriggerNotification* batch;
+    int batch_count;
+    bool batch_closed;
+    int64_t batch_started_ms;
+
+    NotifyDeliverCallback deliver;
+    bool running;
+    bool stop;
+    bool sleeping;                  // Поток доставки ждет на cond
+    pthread_t thread;
+    pthread_mutex_t mutex;          // Только для сна и пробуждения потока доставки
+    pthread_cond_t cond;
+} NotifyQueue;
+
+static NotifyQueue g_queue = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .overflow_mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static NotifyQueueConfig notify_config = {
+    .digest_window_ms = NOTIFY_DEFAULT_DIGEST_MS
+};
+
+void notify_queue_set_config(const NotifyQueueConfig* config) {
+    if (config) {
+        notify_config = *config;
+    }
+}
+
+NotifyQueueConfig* notify_queue_get_config(void) {
+    return &notify_config;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void batch_add(bool batch_end, const TriggerNotification* notification) {
+    if (batch_end) {
+        g_queue.batch_closed = g_queue.batch_count > 0;
+    } else {
+        if (g_queue.batch_count == 0) {
+            g_queue.batch_started_ms = monotonic_ms();
+        }
+        g_queue.batch[g_queue.batch_count++] = *notification;
+    }
+}
+
+static bool ring_ready(void) {
+    NotifyCell* cell = &g_queue.cells[g_queue.head & (NOTIFY_QUEUE_SIZE - 1)];
+    return __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) == g_queue.head + 1;
+}
+
+/**
+ * Перенос следующей записи в пачку (только поток доставки);
+ * false, если очередь пуста. Забранный список переполнения идет раньше
+ * кольца: все, что в кольце сейчас, поставлено уже после него.
+ */
+static bool notify_queue_pop(void) {
+    if (!g_queue.pending && !ring_ready()) {
+        if (!__atomic_load_n(&g_queue.overflow_active, __ATOMIC_SEQ_CST)) {
+            return false;
+        }
+        pthread_mutex_lock(&g_queue.overflow_mutex);
+        g_queue.pending = g_queue.overflow_head;
+        g_queue.overflow_head = NULL;
+        g_queue.overflow_tail = NULL;
+        __atomic_store_n(&g_queue.overflow_active, false, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&g_queue.overflow_mutex);
+        if (!g_queue.pending) {
+            return false;
+        }
+    }
+
+    if (g_queue.pending) {
+        NotifyOverflow* node = g_queue.pending;
+        g_queue.pending = node->next;
+        batch_add(node->batch_end, &node->notification);
+        free(node);
+        return true;
+    }
+
+    NotifyCell* cell = &g_queue.cells[g_queue.head & (NOTIFY_QUEUE_SIZE - 1)];
+    batch_add(cell->batch_end, &cell->notification);
+    __atomic_store_n(&cell->sequence, g_queue.head + NOTIFY_QUEUE_SIZE, __ATOMIC_RELEASE);
+    g_queue.head++;
+    return true;
+}
+
+/**
+ * Миллисекунды до доставки накопленной пачки (0 - пора, -1 - пачки нет).
+ * Без окна дайджеста пачка уходит по отметке конца, иначе - по окну.
+ */
+static int64_t batch_delay_ms(void) {
+    if (g_queue.batch_count == 0) {
+        return -1;
+    }
+    if (g_queue.batch_count == NOTIFY_QUEUE_SIZE) {
+        return 0;
+    }
+
+    int window = notify_config.digest_window_ms;
+    if (window <= 0) {
+        if (g_queue.batch_closed) {
+            return 0;
+        }
+        window = NOTIFY_BATCH_TIMEOUT_MS;
+    }
+
+    int64_t left = g_queue.batch_started_ms + window - monotonic_ms();
+    return left > 0 ? left : 0;
+}
+
+static void batch_deliver(void) {
+    g_queue.deliver(g_queue.batch, g_queue.batch_count);
+    g_queue.batch_count = 0;
+    g_queue.batch_closed = false;
+}
+
+/**
+ * Поток доставки: разбирает очередь в пачку, доставляет ее, когда она
+ * готова, и засыпает до следующей записи или срока пачки. Флаг sleeping
+ * и проверка очереди после него (как и запись в очередь и проверка флага
+ * у производителя) упорядочены полными барьерами, поэтому запись не может
+ * остаться незамеченной; таймаут - лишь страховка.
+ */
+static void* notify_delivery_thread(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        while (g_queue.batch_count < NOTIFY_QUEUE_SIZE && notify_queue_pop()) {
+            if (batch_delay_ms() == 0) {
+                batch_deliver();
+            }
+        }
+
+        int64_t delay = batch_delay_ms();
+        if (delay == 0) {
+            batch_deliver();
+            continue;
+        }
+
+        pthread_mutex_lock(&g_queue.mutex);
+        __atomic_store_n(&g_queue.sleeping, true, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        bool empty = !g_queue.pending && !ring_ready() &&
+                     !__atomic_load_n(&g_queue.overflow_active, __ATOMIC_SEQ_CST);
+        if (empty && g_queue.stop) {
+            pthread_mutex_unlock(&g_queue.mutex);
+            break;
+        }
+        if (empty) {
+            int64_t wait_ms = delay > 0 && delay < 1000 ? delay : 1000;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += wait_ms / 1000;
+            deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_queue.cond, &g_queue.mutex, &deadline);
+        }
+
+        __atomic_store_n(&g_queue.sleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&g_queue.mutex);
+    }
+
+    // Остаток при остановке уходит без ожидания окна
+    if (g_queue.batch_count > 0) {
+        batch_deliver();
+    }
+    return NULL;
+}
+
+/**
+ * Запуск потока доставки
+ */
+int notify_queue_start(NotifyDeliverCallback deliver) {
+    if (!deliver || g_queue.running) {
+        return -1;
+    }
+
+    g_queue.cells = malloc(sizeof(NotifyCell) * NOTIFY_QUEUE_SIZE);
+    g_queue.batch = malloc(sizeof(TriggerNotification) * NOTIFY_QUEUE_SIZE);
+    if (!g_queue.cells || !g_queue.batch) {
+        free(g_queue.cells);
+        free(g_queue.batch);
+        g_queue.cells = NULL;
+        g_queue.batch = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+        g_queue.cells[i].sequence = i;
+    }
+    g_queue.tail = 0;
+    g_queue.head = 0;
+    g_queue.dropped = 0;
+    g_queue.overflowed = 0;
+    g_queue.overflow_head = NULL;
+    g_queue.overflow_tail = NULL;
+    g_queue.overflow_active = false;
+    g_queue.pending = NULL;
+    g_queue.batch_count = 0;
+    g_queue.batch_closed = false;
+    g_queue.deliver = deliver;
+    g_queue.stop = false;
+
+    if (pthread_create(&g_queue.thread, NULL, notify_delivery_thread, NULL) != 0) {
+        alert_log("ERROR", "Failed to start notification delivery thread");
+        free(g_queue.cells);
+        free(g_queue.batch);
+        g_queue.cells = NULL;
+        g_queue.batch = NULL;
+        return -1;
+    }
+
+    __atomic_store_n(&g_queue.running, true, __ATOMIC_RELEASE);
+    alert_log("INFO", "Notification delivery started");
+    return 0;
+}
+
+/**
+ * Остановка потока доставки; производители к этому моменту должны быть
+ * остановлены, иначе их записи могут остаться недоставленными
+ */
+void notify_queue_stop(void) {
+    if (!g_queue.running) {
+        return;
+    }
+    __atomic_store_n(&g_queue.running, false, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&g_queue.mutex);
+    g_queue.stop = true;
+    pthread_cond_signal(&g_queue.cond);
+    pthread_mutex_unlock(&g_queue.mutex);
+
+    pthread_join(g_queue.thread, NULL);
+    free(g_queue.cells);
+    free(g_queue.batch);
+    g_queue.cells = NULL;
+    g_queue.batch = NULL;
+
+    if (g_queue.overflowed > 0 || g_queue.dropped > 0) {
+        char log_msg[160];
+        snprintf(log_msg, sizeof(log_msg), 
+                 "Notification queue overflowed %llu records, dropped %llu notifications",
+                 (unsigned long long)g_queue.overflowed, (unsigned long long)g_queue.dropped);
+        alert_log("WARNING", log_msg);
+    }
+    alert_log("INFO", "Notification delivery stopped");
+}
+
+/**
+ * Пробуждение спящего потока доставки после публикации
+ */
+static void notify_queue_signal(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_queue.sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_queue.mutex);
+        pthread_cond_signal(&g_queue.cond);
+        pthread_mutex_unlock(&g_queue.mutex);
+    }
+}
+
+/**
+ * Добавление записи в список переполнения; -2 при нехватке памяти
+ */
+static int overflow_append(const TriggerNotification* notification) {
+    NotifyOverflow* node = malloc(sizeof(NotifyOverflow));
+    if (!node) {
+        return -2;
+    }
+    node->next = NULL;
+    node->batch_end = notification == NULL;
+    if (notification) {
+        node->notification = *notification;
+    }
+
+    pthread_mutex_lock(&g_queue.overflow_mutex);
+    if (g_queue.overflow_tail) {
+        g_queue.overflow_tail->next = node;
+    } else {
+        g_queue.overflow_head = node;
+    }
+    g_queue.overflow_tail = node;
+    __atomic_store_n(&g_queue.overflow_active, true, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&g_queue.overflow_mutex);
+
+    if (notification && __atomic_add_fetch(&g_queue.overflowed, 1, __ATOMIC_RELAXED) == 1) {
+        alert_log("WARNING", "Notification queue is full, using overflow list");
+    }
+    notify_queue_signal();
+    return 0;
+}
+
+/**
+ * Занятие ячейки и публикация записи или отметки конца пачки. Без
+ * блокировок и выделений памяти, пока кольцо не переполнено; после
+ * этого записи идут в список переполнения, пока поток доставки его не заберет.
+ */
+static int notify_queue_publish(const TriggerNotification* notification) {
+    if (!__atomic_load_n(&g_queue.running, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    if (__atomic_load_n(&g_queue.overflow_active, __ATOMIC_ACQUIRE)) {
+        return overflow_append(notification);
+    }
+
+    size_t pos = __atomic_load_n(&g_queue.tail, __ATOMIC_RELAXED);
+    NotifyCell* cell;
+    for (;;) {
+        cell = &g_queue.cells[pos & (NOTIFY_QUEUE_SIZE - 1)];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_queue.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Потребитель еще не освободил ячейку круга назад
+            return overflow_append(notification);
+        } else {
+            pos = __atomic_load_n(&g_queue.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->batch_end = notification == NULL;
+    if (notification) {
+        cell->notification = *notification;
+    }
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    notify_queue_signal();
+    return 0;
+}
+
+/**
+ * Постановка записи
+ */
+int notify_queue_push(const TriggerNotification* notification) {
+    if (!notification) {
+        return -1;
+    }
+
+    int result = notify_queue_publish(notification);
+    if (result == -2) {
+        // Каждая потеря считается, в лог - каждая 1024-я
+        uint64_t dropped = __atomic_add_fetch(&g_queue.dropped, 1, __ATOMIC_RELAXED);
+        if ((dropped & 1023) == 1) {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), 
+                     "Failed to allocate overflow notification, %llu dropped so far",
+                     (unsigned long long)dropped);
+            alert_log("ERROR", log_msg);
+        }
+    }
+    return result;
+}
+
+/**
+ * Закрытие пачки; отметка, потерянная при нехватке памяти, лишь задерживает
+ * доставку до NOTIFY_BATCH_TIMEOUT_MS
+ */
+int notify_queue_end_batch(void) {
+    return notify_queue_publish(NULL);
+}
+
+uint64_t notify_queue_dropped(void) {
+    return __atomic_load_n(&g_queue.dropped, __ATOMIC_RELAXED);
+}
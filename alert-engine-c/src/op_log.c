@@ -0,0 +1,678 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/op_log.h"
+#include "../include/alert_engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define OP_LOG_MAGIC 0x474C504Fu    // "OPLG"
+#define OP_LOG_VERSION 1
+#define OP_LOG_MAX_FAILED_RANGES 64 // При переполнении старые диапазоны сливаются
+
+// Заголовок файла сегмента
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t first_seq;
+} OpLogSegmentHeader;
+
+// Заголовок записи; CRC покрывает seq, type и данные
+typedef struct {
+    uint32_t size;
+    uint32_t crc32;
+    uint64_t seq;
+    uint32_t type;
+    uint32_t reserved;
+} OpLogRecordHeader;
+
+static OpLogConfig op_log_config = {
+    .group_commit_ms = OP_LOG_DEFAULT_WINDOW_MS,
+    .segment_size = OP_LOG_DEFAULT_SEGMENT_SIZE
+};
+
+void op_log_set_config(const OpLogConfig* config) {
+    if (config) {
+        op_log_config = *config;
+    }
+}
+
+OpLogConfig* op_log_get_config(void) {
+    return &op_log_config;
+}
+
+/**
+ * CRC-32 (IEEE 802.3) с продолжением; таблица строится при первом вызове
+ */
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    static uint32_t table[256];
+    static int table_ready = 0;
+
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint32_t record_crc(const OpLogRecordHeader* header, const void* payload) {
+    uint32_t crc = crc32_update(0xFFFFFFFFu, &header->seq, sizeof(header->seq));
+    crc = crc32_update(crc, &header->type, sizeof(header->type));
+    crc = crc32_update(crc, payload, header->size);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+#ifdef _WIN32
+// Windows заглушки: операции не журналируются, долговечность только у SQLite
+int op_log_open(const char* dir, uint64_t min_seq) {
+    (void)dir; (void)min_seq;
+    (void)record_crc;
+    return -1;
+}
+
+void op_log_close(uint64_t applied_seq) {
+    (void)applied_seq;
+}
+
+int op_log_replay(OpLogReplayCallback callback, void* ctx) {
+    (void)callback; (void)ctx;
+    return 0;
+}
+
+int op_log_append(uint32_t type, const void* payload, uint32_t size, uint64_t* seq) {
+    (void)type; (void)payload; (void)size;
+    if (seq) {
+        *seq = 0;
+    }
+    return 0;
+}
+
+uint64_t op_log_last_seq(void) {
+    return 0;
+}
+
+int op_log_sync(uint64_t seq) {
+    (void)seq;
+    return 0;
+}
+
+void op_log_truncate(uint64_t seq) {
+    (void)seq;
+}
+#else
+
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Диапазон номеров: закрытый сегмент или пачка, которую не удалось записать
+typedef struct {
+    uint64_t first_seq;
+    uint64_t last_seq;
+} OpLogSegment;
+
+typedef struct {
+    char dir[320];
+    int fd;                         // Активный сегмент
+    uint64_t active_first;
+    size_t active_size;
+    OpLogSegment* sealed;           // По возрастанию номеров
+    int sealed_count;
+    int sealed_capacity;
+
+    // Записи, ожидающие фиксации, и запасной буфер для обмена
+    char* buffer;
+    size_t buffer_size;
+    size_t buffer_capacity;
+    char* spare;
+    size_t spare_capacity;
+
+    uint64_t next_seq;
+    uint64_t durable_seq;           // Пачки до него включительно обработаны
+    OpLogSegment failed[OP_LOG_MAX_FAILED_RANGES];  // Отброшенные пачки, по возрастанию
+    int failed_count;
+    bool sync_requested;
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t durable_cond;
+} OpLog;
+
+static OpLog* g_log = NULL;
+
+static void segment_path(char* path, size_t size, uint64_t first_seq) {
+    snprintf(path, size, "%s/%020llu.oplog", g_log->dir, (unsigned long long)first_seq);
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written <= 0) {
+            return -1;
+        }
+        ptr += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Чтение сегмента: записи проверяются по CRC, чтение останавливается на
+ * первой поврежденной или недописанной записи. Возвращает число записей.
+ */
+static int segment_read(uint64_t first_seq, OpLogReplayCallback callback, void* ctx,
+                        uint64_t* last_seq) {
+    char path[400];
+    segment_path(path, sizeof(path), first_seq);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(OpLogSegmentHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char* data = malloc(size);
+    if (!data || pread(fd, data, size, 0) != (ssize_t)size) {
+        free(data);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    const OpLogSegmentHeader* header = (const OpLogSegmentHeader*)data;
+    if (header->magic != OP_LOG_MAGIC || header->version != OP_LOG_VERSION) {
+        free(data);
+        return -1;
+    }
+
+    int count = 0;
+    size_t offset = sizeof(OpLogSegmentHeader);
+    while (offset + sizeof(OpLogRecordHeader) <= size) {
+        OpLogRecordHeader record;
+        memcpy(&record, data + offset, sizeof(record));
+        const char* payload = data + offset + sizeof(record);
+
+        if (record.size > size - offset - sizeof(record) ||
+            record_crc(&record, payload) != record.crc32) {
+            break;
+        }
+
+        if (callback) {
+            callback(record.seq, record.type, payload, record.size, ctx);
+        }
+        *last_seq = record.seq;
+        count++;
+        offset += sizeof(record) + record.size;
+    }
+
+    free(data);
+    return count;
+}
+
+static int compare_segments(const void* a, const void* b) {
+    uint64_t left = ((const OpLogSegment*)a)->first_seq;
+    uint64_t right = ((const OpLogSegment*)b)->first_seq;
+    return left < right ? -1 : left > right;
+}
+
+static int sealed_add(uint64_t first_seq, uint64_t last_seq) {
+    if (g_log->sealed_count == g_log->sealed_capacity) {
+        int capacity = g_log->sealed_capacity ? g_log->sealed_capacity * 2 : 16;
+        OpLogSegment* grown = realloc(g_log->sealed, sizeof(OpLogSegment) * (size_t)capacity);
+        if (!grown) {
+            return -1;
+        }
+        g_log->sealed = grown;
+        g_log->sealed_capacity = capacity;
+    }
+    g_log->sealed[g_log->sealed_count].first_seq = first_seq;
+    g_log->sealed[g_log->sealed_count].last_seq = last_seq;
+    g_log->sealed_count++;
+    return 0;
+}
+
+/**
+ * Создание активного сегмента, первая запись которого получит номер first_seq
+ */
+static int segment_create(uint64_t first_seq) {
+    char path[400];
+    segment_path(path, sizeof(path), first_seq);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        alert_log("ERROR", "Cannot create operation log segment");
+        return -1;
+    }
+
+    OpLogSegmentHeader header = { OP_LOG_MAGIC, OP_LOG_VERSION, first_seq };
+    if (write_all(fd, &header, sizeof(header)) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    g_log->fd = fd;
+    g_log->active_first = first_seq;
+    g_log->active_size = sizeof(header);
+    return 0;
+}
+
+/**
+ * Запоминание номеров отброшенной пачки; при переполнении два самых старых
+ * диапазона сливаются, и ожидающие между ними получат ошибку с запасом
+ */
+static void failed_add(uint64_t first_seq, uint64_t last_seq) {
+    if (g_log->failed_count == OP_LOG_MAX_FAILED_RANGES) {
+        g_log->failed[1].first_seq = g_log->failed[0].first_seq;
+        memmove(g_log->failed, g_log->failed + 1,
+                sizeof(OpLogSegment) * (OP_LOG_MAX_FAILED_RANGES - 1));
+        g_log->failed_count--;
+    }
+    g_log->failed[g_log->failed_count].first_seq = first_seq;
+    g_log->failed[g_log->failed_count].last_seq = last_seq;
+    g_log->failed_count++;
+}
+
+static bool failed_contains(uint64_t seq) {
+    for (int i = g_log->failed_count - 1; i >= 0; i--) {
+        if (seq >= g_log->failed[i].first_seq && seq <= g_log->failed[i].last_seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Закрытие сегмента после ошибки записи: недописанный хвост отрезается,
+ * сегмент с целыми записями остается для повтора, пустой удаляется
+ */
+static void segment_abandon(uint64_t first_failed) {
+    if (g_log->fd < 0) {
+        return;
+    }
+
+    if (ftruncate(g_log->fd, (off_t)g_log->active_size) != 0) {
+        alert_log("ERROR", "Cannot cut failed records from operation log segment");
+    }
+    close(g_log->fd);
+    g_log->fd = -1;
+
+    if (g_log->active_size > sizeof(OpLogSegmentHeader)) {
+        sealed_add(g_log->active_first, first_failed - 1);
+    } else {
+        char path[400];
+        segment_path(path, sizeof(path), g_log->active_first);
+        unlink(path);
+    }
+}
+
+/**
+ * Поток групповой фиксации: одна запись и один fdatasync на все записи,
+ * накопленные за окно или к моменту запроса ожидающего
+ */
+static void* op_log_flusher_thread(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_log->mutex);
+
+    for (;;) {
+        while (!g_log->stop && g_log->buffer_size == 0) {
+            pthread_cond_wait(&g_log->cond, &g_log->mutex);
+        }
+        if (g_log->buffer_size == 0) {
+            break;
+        }
+
+        if (!g_log->stop && !g_log->sync_requested && op_log_config.group_commit_ms > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            long window_ns = (long)op_log_config.group_commit_ms * 1000000L;
+            deadline.tv_sec += window_ns / 1000000000L;
+            deadline.tv_nsec += window_ns % 1000000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while (!g_log->stop && !g_log->sync_requested &&
+                   pthread_cond_timedwait(&g_log->cond, &g_log->mutex, &deadline) == 0) {
+            }
+        }
+
+        // Сегмент, который не удалось создать после ошибки, создается заново
+        uint64_t first_seq = g_log->durable_seq + 1;
+        if (g_log->fd < 0) {
+            segment_create(first_seq);
+        }
+
+        // Обмен буферов: производители продолжают писать в пустой
+        char* data = g_log->buffer;
+        size_t size = g_log->buffer_size;
+        size_t capacity = g_log->buffer_capacity;
+        uint64_t last_seq = g_log->next_seq - 1;
+        g_log->buffer = g_log->spare;
+        g_log->buffer_capacity = g_log->spare_capacity;
+        g_log->buffer_size = 0;
+        g_log->spare = NULL;
+        g_log->spare_capacity = 0;
+        g_log->sync_requested = false;
+        pthread_mutex_unlock(&g_log->mutex);
+
+        bool failed = g_log->fd < 0 ||
+                      write_all(g_log->fd, data, size) != 0 ||
+                      fdatasync(g_log->fd) != 0;
+        if (failed) {
+            alert_log("ERROR", "Failed to write operation log");
+        }
+
+        pthread_mutex_lock(&g_log->mutex);
+        g_log->spare = data;
+        g_log->spare_capacity = capacity;
+        g_log->durable_seq = last_seq;
+
+        // Ошибка касается только этой пачки: ее номера получат отказ,
+        // а следующие записи пойдут в новый сегмент
+        if (failed) {
+            failed_add(first_seq, last_seq);
+            segment_abandon(first_seq);
+            segment_create(last_seq + 1);
+            pthread_cond_broadcast(&g_log->durable_cond);
+            continue;
+        }
+        g_log->active_size += size;
+        pthread_cond_broadcast(&g_log->durable_cond);
+
+        // Новый сегмент начинается с первой записи, еще не попавшей на диск
+        if (g_log->active_size >= (size_t)op_log_config.segment_size) {
+            close(g_log->fd);
+            g_log->fd = -1;
+            sealed_add(g_log->active_first, last_seq);
+            segment_create(last_seq + 1);
+        }
+    }
+
+    pthread_mutex_unlock(&g_log->mutex);
+    return NULL;
+}
+
+/**
+ * Открытие журнала: учет существующих сегментов и создание нового активного
+ */
+int op_log_open(const char* dir, uint64_t min_seq) {
+    if (g_log || !dir) {
+        return -1;
+    }
+
+    mkdir(dir, 0755);
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        alert_log("ERROR", "Cannot open operation log directory");
+        return -1;
+    }
+
+    g_log = calloc(1, sizeof(OpLog));
+    if (!g_log) {
+        closedir(handle);
+        return -1;
+    }
+    strncpy(g_log->dir, dir, sizeof(g_log->dir) - 1);
+    g_log->fd = -1;
+    pthread_mutex_init(&g_log->mutex, NULL);
+    pthread_cond_init(&g_log->cond, NULL);
+    pthread_cond_init(&g_log->durable_cond, NULL);
+
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        unsigned long long first_seq;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%20llu.%5s", &first_seq, suffix) == 2 &&
+            strcmp(suffix, "oplog") == 0) {
+            sealed_add(first_seq, 0);
+        }
+    }
+    closedir(handle);
+
+    if (g_log->sealed_count > 1) {
+        qsort(g_log->sealed, (size_t)g_log->sealed_count, sizeof(OpLogSegment), compare_segments);
+    }
+
+    // Сегменты без единой целой записи удаляются
+    uint64_t last_seq = 0;
+    int kept = 0;
+    for (int i = 0; i < g_log->sealed_count; i++) {
+        OpLogSegment segment = g_log->sealed[i];
+        if (segment_read(segment.first_seq, NULL, NULL, &segment.last_seq) > 0) {
+            g_log->sealed[kept++] = segment;
+            if (segment.last_seq > last_seq) {
+                last_seq = segment.last_seq;
+            }
+        } else {
+            char path[400];
+            segment_path(path, sizeof(path), segment.first_seq);
+            unlink(path);
+        }
+    }
+    g_log->sealed_count = kept;
+
+    // После удаления всех сегментов номер берется из баз, иначе новые
+    // записи получили бы номера, которые повтор считает уже примененными
+    if (min_seq > last_seq) {
+        last_seq = min_seq;
+    }
+    g_log->next_seq = last_seq + 1;
+    g_log->durable_seq = last_seq;
+
+    if (segment_create(g_log->next_seq) != 0 ||
+        pthread_create(&g_log->thread, NULL, op_log_flusher_thread, NULL) != 0) {
+        if (g_log->fd >= 0) {
+            close(g_log->fd);
+        }
+        free(g_log->sealed);
+        free(g_log);
+        g_log = NULL;
+        alert_log("ERROR", "Failed to open operation log");
+        return -1;
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Operation log opened at seq %llu (%d segments)",
+             (unsigned long long)last_seq, kept);
+    alert_log("INFO", log_msg);
+    return 0;
+}
+
+/**
+ * Закрытие журнала; накопленные записи фиксируются до выхода
+ */
+void op_log_close(uint64_t applied_seq) {
+    if (!g_log) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_log->mutex);
+    g_log->stop = true;
+    pthread_cond_signal(&g_log->cond);
+    pthread_mutex_unlock(&g_log->mutex);
+    pthread_join(g_log->thread, NULL);
+
+    // Примененные записи не нужны: после чистой остановки журнал пуст
+    op_log_truncate(applied_seq);
+
+    if (g_log->fd >= 0) {
+        close(g_log->fd);
+        // Пустой или полностью примененный активный сегмент не нужен
+        if (g_log->active_size == sizeof(OpLogSegmentHeader) ||
+            (applied_seq > 0 && g_log->next_seq - 1 <= applied_seq)) {
+            char path[400];
+            segment_path(path, sizeof(path), g_log->active_first);
+            unlink(path);
+        }
+    }
+
+    pthread_mutex_destroy(&g_log->mutex);
+    pthread_cond_destroy(&g_log->cond);
+    pthread_cond_destroy(&g_log->durable_cond);
+    free(g_log->buffer);
+    free(g_log->spare);
+    free(g_log->sealed);
+    free(g_log);
+    g_log = NULL;
+}
+
+/**
+ * Повтор записей закрытых сегментов; вызывается до первой дозаписи
+ */
+int op_log_replay(OpLogReplayCallback callback, void* ctx) {
+    if (!g_log || !callback) {
+        return -1;
+    }
+
+    int replayed = 0;
+    for (int i = 0; i < g_log->sealed_count; i++) {
+        uint64_t last_seq = 0;
+        int count = segment_read(g_log->sealed[i].first_seq, callback, ctx, &last_seq);
+        if (count > 0) {
+            replayed += count;
+        }
+    }
+    return replayed;
+}
+
+/**
+ * Добавление записи в буфер групповой фиксации
+ */
+int op_log_append(uint32_t type, const void* payload, uint32_t size, uint64_t* seq) {
+    if (!seq || (!payload && size > 0)) {
+        return -1;
+    }
+    *seq = 0;
+    if (!g_log) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_log->mutex);
+
+    size_t needed = g_log->buffer_size + sizeof(OpLogRecordHeader) + size;
+    if (needed > g_log->buffer_capacity) {
+        size_t capacity = g_log->buffer_capacity ? g_log->buffer_capacity : 4096;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char* grown = realloc(g_log->buffer, capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&g_log->mutex);
+            alert_log("ERROR", "Failed to grow operation log buffer");
+            return -1;
+        }
+        g_log->buffer = grown;
+        g_log->buffer_capacity = capacity;
+    }
+
+    OpLogRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = size;
+    header.seq = g_log->next_seq++;
+    header.type = type;
+    header.crc32 = record_crc(&header, payload);
+
+    memcpy(g_log->buffer + g_log->buffer_size, &header, sizeof(header));
+    if (size > 0) {
+        memcpy(g_log->buffer + g_log->buffer_size + sizeof(header), payload, size);
+    }
+
+    // Первая запись в пустом буфере открывает окно групповой фиксации
+    if (g_log->buffer_size == 0) {
+        pthread_cond_signal(&g_log->cond);
+    }
+    g_log->buffer_size = needed;
+
+    pthread_mutex_unlock(&g_log->mutex);
+    *seq = header.seq;
+    return 0;
+}
+
+uint64_t op_log_last_seq(void) {
+    if (!g_log) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_log->mutex);
+    uint64_t seq = g_log->next_seq - 1;
+    pthread_mutex_unlock(&g_log->mutex);
+    return seq;
+}
+
+/**
+ * Ожидание фиксации: запрос сокращает окно, ждущие одновременно
+ * разделяют один fdatasync
+ */
+int op_log_sync(uint64_t seq) {
+    if (!g_log) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_log->mutex);
+    if (seq >= g_log->next_seq) {
+        // Номер не выдавался: ждать нечего
+        pthread_mutex_unlock(&g_log->mutex);
+        return -1;
+    }
+    // Поток фиксации перед выходом записывает весь буфер, поэтому
+    // ожидание выданного номера завершается и при остановке
+    while (g_log->durable_seq < seq) {
+        g_log->sync_requested = true;
+        pthread_cond_signal(&g_log->cond);
+        pthread_cond_wait(&g_log->durable_cond, &g_log->mutex);
+    }
+    int result = failed_contains(seq) ? -1 : 0;
+    pthread_mutex_unlock(&g_log->mutex);
+
+    return result;
+}
+
+/**
+ * Удаление закрытых сегментов, полностью примененных к базе
+ */
+void op_log_truncate(uint64_t seq) {
+    if (!g_log) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_log->mutex);
+
+    int removed = 0;
+    while (removed < g_log->sealed_count && g_log->sealed[removed].last_seq <= seq) {
+        char path[400];
+        segment_path(path, sizeof(path), g_log->sealed[removed].first_seq);
+        unlink(path);
+        removed++;
+    }
+
+    if (removed > 0) {
+        memmove(g_log->sealed, g_log->sealed + removed,
+                sizeof(OpLogSegment) * (size_t)(g_log->sealed_count - removed));
+        g_log->sealed_count -= removed;
+    }
+
+    pthread_mutex_unlock(&g_log->mutex);
+}
+
+#endif
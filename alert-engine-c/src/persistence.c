@@ -0,0 +1,1069 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/persistence.h"
+#include "../include/db_shards.h"
+#include "../include/op_log.h"
+#include <sqlite3.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+typedef enum {
+    PERSIST_SAVE_ALERT = 0,
+    PERSIST_UPDATE_STATUS = 1,
+    PERSIST_UPDATE_TRIGGER_MODE = 2,
+    PERSIST_UPDATE_SCHEDULE = 3,
+    PERSIST_UPSERT_HOLDING = 4,
+    PERSIST_UPDATE_TRIGGER_STATE = 5
+} PersistOpType;
+
+// Операция записи; данные копируются, поток записи не трогает общие структуры
+typedef struct persist_op {
+    struct persist_op* next;
+    PersistOpType type;
+    uint64_t seq;           // Номер в журнале операций, 0 - журнал отключен
+    union {
+        Alert alert;
+        struct {
+            int alert_id;
+            AlertStatus status;
+        } status;
+        struct {
+            int alert_id;
+            AlertTriggerMode mode;
+            double hysteresis;
+        } trigger_mode;
+        struct {
+            int alert_id;
+            AlertStatus status;
+            time_t activate_at;
+            time_t expires_at;
+            time_t check_at;
+        } schedule;
+        struct {
+            char user_id[64];
+            char symbol[MAX_SYMBOL_LEN];
+            double quantity;
+        } holding;
+        struct {
+            TriggerStateRow* rows;
+            int count;
+        } trigger_state;
+    } data;
+} PersistOp;
+
+// Тип записи журнала: операция и шард, к которому она относится
+#define PERSIST_LOG_TYPE(type, shard) ((uint32_t)(type) | ((uint32_t)(shard) << 16))
+#define PERSIST_LOG_OP(log_type) ((PersistOpType)((log_type) & 0xFFFF))
+#define PERSIST_LOG_SHARD(log_type) ((int)((log_type) >> 16))
+
+// Время фиксации строки: снимок догружает строки с updated_at >= времени снимка
+#define PERSIST_NOW "CAST(strftime('%s', 'now') AS INTEGER)"
+
+// Попыток зафиксировать неудачную пачку при остановке; пока движок работает,
+// пачка повторяется каждое окно долговечности
+#define PERSIST_STOP_RETRIES 3
+
+// Подготовленные выражения соединения потока записи
+typedef struct {
+    sqlite3_stmt* insert_alert;
+    sqlite3_stmt* update_status;
+    sqlite3_stmt* update_trigger_mode;
+    sqlite3_stmt* update_schedule;
+    sqlite3_stmt* upsert_holding;
+    sqlite3_stmt* update_trigger_state;
+    sqlite3_stmt* update_applied_seq;
+} StatementCache;
+
+// Очередь MPSC (Вьюков): производители добавляют атомарным обменом head,
+// единственный потребитель забирает с tail без блокировок
+typedef struct {
+    PersistOp* head;
+    PersistOp* tail;
+    PersistOp stub;
+} PersistQueue;
+
+static PersistenceConfig persistence_config = {
+    .durability_window_ms = PERSIST_DEFAULT_WINDOW_MS,
+    .max_batch = PERSIST_DEFAULT_MAX_BATCH
+};
+
+// Поток записи одного шарда: свое соединение, очередь и счетчики
+typedef struct {
+    int shard;
+    sqlite3* db;
+    StatementCache statements;
+    PersistQueue queue;
+    pthread_t thread;
+    bool stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t committed_cond;
+    // Номер журнала и место в очереди назначаются вместе, поэтому шард
+    // применяет операции строго в порядке номеров
+    pthread_mutex_t log_mutex;
+    bool flush_requested;
+    uint64_t enqueued;      // Поставлено в очередь (атомарно)
+    uint64_t committed;     // Применено потоком записи (под mutex)
+    uint64_t applied_seq;   // Последний номер журнала, зафиксированный в базе (атомарно)
+    PersistOp* batch;       // Пачка неудачной транзакции, повторяется первой (только поток записи)
+    PersistOp* batch_tail;
+    bool commit_failed;     // Последняя транзакция не зафиксирована (под mutex)
+    int commit_failures;    // Неудачных транзакций подряд (под mutex)
+    uint64_t commit_attempts;   // Попыток фиксации (под mutex)
+    uint64_t failed_ops;        // Операций, отвергнутых базой (под mutex)
+    uint64_t reported_failed_ops;   // Из них уже возвращено persistence_flush (под mutex)
+    bool abandoned;         // Пачка брошена при остановке, журнал нужен для повтора
+} PersistWriter;
+
+static PersistWriter g_writers[DB_MAX_SHARDS];
+static int g_writer_count = 0;
+static bool g_writer_running = false;
+
+static void* persistence_writer_thread(void* arg);
+
+static void queue_init(PersistQueue* queue) {
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+static void queue_push(PersistQueue* queue, PersistOp* op) {
+    __atomic_store_n(&op->next, NULL, __ATOMIC_RELAXED);
+    PersistOp* prev = __atomic_exchange_n(&queue->head, op, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, op, __ATOMIC_RELEASE);
+}
+
+/**
+ * Извлечение операции (только поток записи)
+ *
+ * NULL означает пустую очередь или производителя посреди вставки:
+ * операция будет получена на следующем проходе.
+ */
+static PersistOp* queue_pop(PersistQueue* queue) {
+    PersistOp* tail = queue->tail;
+    PersistOp* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (!next) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    queue_push(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * Подготовка выражений для записи
+ */
+static int prepare_statements(PersistWriter* writer) {
+    StatementCache* cache = &writer->statements;
+    struct {
+        sqlite3_stmt** stmt;
+        const char* sql;
+    } statements[] = {
+        { &cache->insert_alert,
+          "INSERT INTO alerts (id, user_id, symbol, type, target_value, "
+          "status, created_at, last_triggered, trigger_count, message, "
+          "is_repeatable, cooldown_minutes, required_tier, expression, "
+          "trigger_mode, hysteresis, updated_at) "
+          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, " PERSIST_NOW ")" },
+        { &cache->update_status,
+          "UPDATE alerts SET status = ?, updated_at = " PERSIST_NOW " WHERE id = ?" },
+        { &cache->update_trigger_mode,
+          "UPDATE alerts SET trigger_mode = ?, hysteresis = ?, "
+          "updated_at = " PERSIST_NOW " WHERE id = ?" },
+        { &cache->update_schedule,
+          "UPDATE alerts SET status = ?, activate_at = ?, expires_at = ?, "
+          "check_at = ?, updated_at = " PERSIST_NOW " WHERE id = ?" },
+        { &cache->upsert_holding,
+          "INSERT OR REPLACE INTO portfolio_holdings (user_id, symbol, quantity) "
+          "VALUES (?, ?, ?)" },
+        { &cache->update_trigger_state,
+          "UPDATE alerts SET last_triggered = ?, trigger_count = ?, "
+          "updated_at = " PERSIST_NOW " WHERE id = ?" },
+        { &cache->update_applied_seq,
+          "UPDATE oplog_state SET applied_seq = ? WHERE id = 0" }
+    };
+
+    for (size_t i = 0; i < sizeof(statements) / sizeof(statements[0]); i++) {
+        int rc = sqlite3_prepare_v2(writer->db, statements[i].sql, -1, statements[i].stmt, NULL);
+        if (rc != SQLITE_OK) {
+            alert_log("ERROR", "Failed to prepare statement");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void finalize_statements(PersistWriter* writer) {
+    StatementCache* cache = &writer->statements;
+    sqlite3_finalize(cache->insert_alert);
+    sqlite3_finalize(cache->update_status);
+    sqlite3_finalize(cache->update_trigger_mode);
+    sqlite3_finalize(cache->update_schedule);
+    sqlite3_finalize(cache->upsert_holding);
+    sqlite3_finalize(cache->update_trigger_state);
+    sqlite3_finalize(cache->update_applied_seq);
+    memset(cache, 0, sizeof(StatementCache));
+}
+
+static void writer_close(PersistWriter* writer) {
+    finalize_statements(writer);
+    sqlite3_close(writer->db);
+    writer->db = NULL;
+    pthread_mutex_destroy(&writer->mutex);
+    pthread_mutex_destroy(&writer->log_mutex);
+    pthread_cond_destroy(&writer->cond);
+    pthread_cond_destroy(&writer->committed_cond);
+}
+
+/**
+ * Открытие соединения шарда; поток записи запускается после повтора журнала
+ */
+static int writer_open(PersistWriter* writer, int shard, const char* db_path) {
+    memset(writer, 0, sizeof(PersistWriter));
+    writer->shard = shard;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_mutex_init(&writer->log_mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    pthread_cond_init(&writer->committed_cond, NULL);
+
+    if (sqlite3_open(db_path, &writer->db) != SQLITE_OK) {
+        alert_log("ERROR", "Cannot open database for persistence writer");
+        writer_close(writer);
+        return -1;
+    }
+
+    sqlite3_busy_timeout(writer->db, 5000);
+    sqlite3_exec(writer->db, "PRAGMA journal_mode=WAL", 0, 0, NULL);
+    sqlite3_exec(writer->db, "PRAGMA synchronous=NORMAL", 0, 0, NULL);
+
+    if (prepare_statements(writer) != 0) {
+        writer_close(writer);
+        return -1;
+    }
+
+    // Граница повтора: операции журнала с большим номером в базу не попали
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(writer->db, "SELECT applied_seq FROM oplog_state WHERE id = 0",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            writer->applied_seq = (uint64_t)sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    queue_init(&writer->queue);
+    return 0;
+}
+
+/**
+ * Остановка потока записи; все поставленные операции фиксируются до выхода
+ */
+static void writer_stop(PersistWriter* writer) {
+    pthread_mutex_lock(&writer->mutex);
+    writer->stop = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+    writer_close(writer);
+}
+
+static int persist_op_apply(PersistWriter* writer, PersistOp* op);
+static const void* persist_op_payload(const PersistOp* op, uint32_t* size);
+static void persist_op_free(PersistOp* op);
+
+/**
+ * Применение записи журнала, которой еще нет в базе шарда
+ */
+static void replay_record(uint64_t seq, uint32_t type, const void* payload,
+                          uint32_t size, void* ctx) {
+    int* replayed = ctx;
+    int shard = PERSIST_LOG_SHARD(type);
+    if (shard >= g_writer_count) {
+        alert_log("WARNING", "Operation log record for unknown shard skipped");
+        return;
+    }
+
+    PersistWriter* writer = &g_writers[shard];
+    if (seq <= writer->applied_seq) {
+        return;
+    }
+
+    PersistOp op;
+    memset(&op, 0, sizeof(op));
+    op.type = PERSIST_LOG_OP(type);
+    op.seq = seq;
+
+    if (op.type == PERSIST_UPDATE_TRIGGER_STATE) {
+        op.data.trigger_state.count = (int)(size / sizeof(TriggerStateRow));
+        op.data.trigger_state.rows = malloc(size > 0 ? size : 1);
+        if (!op.data.trigger_state.rows) {
+            return;
+        }
+        memcpy(op.data.trigger_state.rows, payload, size);
+    } else {
+        uint32_t expected = 0;
+        void* data = (void*)persist_op_payload(&op, &expected);
+        if (!data || expected != size) {
+            alert_log("WARNING", "Operation log record has unexpected size, skipped");
+            return;
+        }
+        memcpy(data, payload, size);
+    }
+
+    if (persist_op_apply(writer, &op) > 0) {
+        alert_log("WARNING", "Operation log record rejected by database during replay");
+    }
+    if (op.type == PERSIST_UPDATE_TRIGGER_STATE) {
+        free(op.data.trigger_state.rows);
+    }
+    writer->applied_seq = seq;
+    (*replayed)++;
+}
+
+/**
+ * Повтор журнала операций поверх баз шардов, по транзакции на шард
+ */
+static void persistence_replay(void) {
+    for (int i = 0; i < g_writer_count; i++) {
+        sqlite3_exec(g_writers[i].db, "BEGIN", 0, 0, NULL);
+    }
+
+    int replayed = 0;
+    op_log_replay(replay_record, &replayed);
+
+    for (int i = 0; i < g_writer_count; i++) {
+        PersistWriter* writer = &g_writers[i];
+        sqlite3_stmt* stmt = writer->statements.update_applied_seq;
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)writer->applied_seq);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+
+        if (sqlite3_exec(writer->db, "COMMIT", 0, 0, NULL) != SQLITE_OK) {
+            alert_log("ERROR", "Failed to commit operation log replay");
+            sqlite3_exec(writer->db, "ROLLBACK", 0, 0, NULL);
+        }
+    }
+
+    if (replayed > 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "Replayed %d operations from operation log", replayed);
+        alert_log("INFO", log_msg);
+    }
+}
+
+/**
+ * Запуск потоков записи, по одному на шард базы.
+ * Сначала в базы дописываются операции журнала, не дошедшие до них
+ * до остановки, поэтому последующая загрузка видит полное состояние.
+ */
+int persistence_start(void) {
+    if (g_writer_running || db_shard_count() < 1) {
+        return -1;
+    }
+
+    int count = db_shard_count();
+    uint64_t max_applied = 0;
+    for (int i = 0; i < count; i++) {
+        if (writer_open(&g_writers[i], i, db_shard_path(i)) != 0) {
+            while (--i >= 0) {
+                writer_close(&g_writers[i]);
+            }
+            return -1;
+        }
+        if (g_writers[i].applied_seq > max_applied) {
+            max_applied = g_writers[i].applied_seq;
+        }
+    }
+    g_writer_count = count;
+
+    // Журнал лежит рядом с базой и привязан к числу шардов: записи
+    // адресованы шардам по номеру, чужой журнал повторять нельзя
+    char dir[300];
+    if (count == 1) {
+        snprintf(dir, sizeof(dir), "%s" OP_LOG_SUFFIX, db_shards_get_config()->db_path);
+    } else {
+        snprintf(dir, sizeof(dir), "%s.%d" OP_LOG_SUFFIX, db_shards_get_config()->db_path, count);
+    }
+    if (op_log_open(dir, max_applied) != 0) {
+        alert_log("WARNING", "Operation log disabled, recent writes may be lost on crash");
+    }
+
+    persistence_replay();
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&g_writers[i].thread, NULL, persistence_writer_thread,
+                           &g_writers[i]) != 0) {
+            alert_log("ERROR", "Failed to start persistence writer thread");
+            for (int j = 0; j < count; j++) {
+                if (j < i) {
+                    writer_stop(&g_writers[j]);
+                } else {
+                    writer_close(&g_writers[j]);
+                }
+            }
+            g_writer_count = 0;
+            op_log_close(0);
+            return -1;
+        }
+    }
+
+    g_writer_running = true;
+    alert_log("INFO", "Persistence writer started");
+    return 0;
+}
+
+void persistence_stop(void) {
+    if (!g_writer_running) {
+        return;
+    }
+
+    // Без брошенных пачек все записи журнала уже в базах
+    bool applied = true;
+    for (int i = 0; i < g_writer_count; i++) {
+        writer_stop(&g_writers[i]);
+        applied = applied && !g_writers[i].abandoned;
+    }
+    g_writer_count = 0;
+    g_writer_running = false;
+    op_log_close(applied ? op_log_last_seq() : 0);
+
+    alert_log("INFO", "Persistence writer stopped");
+}
+
+/**
+ * Ожидание записи в журнал операций до номера seq, полученного при постановке
+ */
+int persistence_sync(uint64_t seq) {
+    return op_log_sync(seq);
+}
+
+/**
+ * Удаление сегментов журнала, чьи операции уже зафиксированы во всех шардах.
+ * Шард без очереди применил все, что ему досталось; остальные ограничивают
+ * границу своим последним примененным номером.
+ */
+void persistence_checkpoint(void) {
+    if (!g_writer_running) {
+        return;
+    }
+
+    // Номер берется до проверки шардов: операция с меньшим номером под
+    // log_mutex шарда уже учтена в его счетчике очереди
+    uint64_t safe_seq = op_log_last_seq();
+    for (int i = 0; i < g_writer_count; i++) {
+        PersistWriter* writer = &g_writers[i];
+
+        pthread_mutex_lock(&writer->log_mutex);
+        pthread_mutex_lock(&writer->mutex);
+        bool idle = !writer->commit_failed &&
+                    __atomic_load_n(&writer->enqueued, __ATOMIC_ACQUIRE) == writer->committed;
+        pthread_mutex_unlock(&writer->mutex);
+        pthread_mutex_unlock(&writer->log_mutex);
+
+        uint64_t applied = __atomic_load_n(&writer->applied_seq, __ATOMIC_ACQUIRE);
+        if (!idle && applied < safe_seq) {
+            safe_seq = applied;
+        }
+    }
+
+    op_log_truncate(safe_seq);
+}
+
+/**
+ * Ожидание фиксации всех операций, поставленных до вызова.
+ * -1, если транзакция после вызова не зафиксирована (операции остаются
+ * в очереди и повторяются) или база отвергла операции с прошлого вызова.
+ */
+int persistence_flush(void) {
+    if (!g_writer_running) {
+        return -1;
+    }
+
+    int result = 0;
+    for (int i = 0; i < g_writer_count; i++) {
+        PersistWriter* writer = &g_writers[i];
+        uint64_t target = __atomic_load_n(&writer->enqueued, __ATOMIC_ACQUIRE);
+
+        pthread_mutex_lock(&writer->mutex);
+        uint64_t attempts = writer->commit_attempts;
+        writer->flush_requested = true;
+        pthread_cond_signal(&writer->cond);
+        while (writer->committed < target) {
+            if (writer->commit_failed && writer->commit_attempts > attempts) {
+                result = -1;
+                break;
+            }
+            pthread_cond_wait(&writer->committed_cond, &writer->mutex);
+        }
+        if (writer->failed_ops > writer->reported_failed_ops) {
+            writer->reported_failed_ops = writer->failed_ops;
+            result = -1;
+        }
+        pthread_mutex_unlock(&writer->mutex);
+    }
+
+    return result;
+}
+
+void persistence_set_config(const PersistenceConfig* config) {
+    if (config) {
+        persistence_config = *config;
+    }
+}
+
+PersistenceConfig* persistence_get_config(void) {
+    return &persistence_config;
+}
+
+/**
+ * Постановка операции в очередь шарда; seq (если задан) получает номер
+ * в журнале операций для persistence_sync
+ */
+static int persistence_enqueue_shard(PersistOp* op, int shard, uint64_t* seq) {
+    if (!g_writer_running) {
+        persist_op_free(op);
+        alert_log("ERROR", "Persistence writer is not running");
+        return -1;
+    }
+
+    PersistWriter* writer = &g_writers[shard];
+    uint32_t size = 0;
+    const void* payload = persist_op_payload(op, &size);
+
+    // Операция попадает в журнал раньше, чем в очередь на запись в базу
+    pthread_mutex_lock(&writer->log_mutex);
+    if (op_log_append(PERSIST_LOG_TYPE(op->type, shard), payload, size, &op->seq) != 0) {
+        pthread_mutex_unlock(&writer->log_mutex);
+        persist_op_free(op);
+        alert_log("ERROR", "Failed to append operation to operation log");
+        return -1;
+    }
+    if (seq) {
+        *seq = op->seq;
+    }
+    uint64_t pending = __atomic_add_fetch(&writer->enqueued, 1, __ATOMIC_ACQ_REL);
+    queue_push(&writer->queue, op);
+    pthread_mutex_unlock(&writer->log_mutex);
+
+    // Большая пачка фиксируется, не дожидаясь окна долговечности
+    if (persistence_config.max_batch > 0 &&
+        pending % (uint64_t)persistence_config.max_batch == 0) {
+        pthread_cond_signal(&writer->cond);
+    }
+
+    return 0;
+}
+
+static int persistence_enqueue(PersistOp* op, const char* user_id, uint64_t* seq) {
+    return persistence_enqueue_shard(op, db_shard_for_user(user_id), seq);
+}
+
+static PersistOp* persist_op_new(PersistOpType type) {
+    PersistOp* op = malloc(sizeof(PersistOp));
+    if (!op) {
+        alert_log("ERROR", "Failed to allocate persistence operation");
+        return NULL;
+    }
+    op->type = type;
+    return op;
+}
+
+int persistence_save_alert(const Alert* alert, uint64_t* seq) {
+    if (!alert) {
+        return -1;
+    }
+
+    PersistOp* op = persist_op_new(PERSIST_SAVE_ALERT);
+    if (!op) {
+        return -1;
+    }
+    op->data.alert = *alert;
+    return persistence_enqueue(op, alert->user_id, seq);
+}
+
+int persistence_update_status(const char* user_id, int alert_id, AlertStatus status,
+                              uint64_t* seq) {
+    PersistOp* op = persist_op_new(PERSIST_UPDATE_STATUS);
+    if (!op) {
+        return -1;
+    }
+    op->data.status.alert_id = alert_id;
+    op->data.status.status = status;
+    return persistence_enqueue(op, user_id, seq);
+}
+
+int persistence_update_trigger_mode(const char* user_id, int alert_id,
+                                    AlertTriggerMode mode, double hysteresis, uint64_t* seq) {
+    PersistOp* op = persist_op_new(PERSIST_UPDATE_TRIGGER_MODE);
+    if (!op) {
+        return -1;
+    }
+    op->data.trigger_mode.alert_id = alert_id;
+    op->data.trigger_mode.mode = mode;
+    op->data.trigger_mode.hysteresis = hysteresis;
+    return persistence_enqueue(op, user_id, seq);
+}
+
+int persistence_update_schedule(const char* user_id, int alert_id, AlertStatus status,
+                                time_t activate_at, time_t expires_at, time_t check_at,
+                                uint64_t* seq) {
+    PersistOp* op = persist_op_new(PERSIST_UPDATE_SCHEDULE);
+    if (!op) {
+        return -1;
+    }
+    op->data.schedule.alert_id = alert_id;
+    op->data.schedule.status = status;
+    op->data.schedule.activate_at = activate_at;
+    op->data.schedule.expires_at = expires_at;
+    op->data.schedule.check_at = check_at;
+    return persistence_enqueue(op, user_id, seq);
+}
+
+int persistence_upsert_holding(const char* user_id, const char* symbol, double quantity,
+                               uint64_t* seq) {
+    if (!user_id || !symbol) {
+        return -1;
+    }
+
+    PersistOp* op = persist_op_new(PERSIST_UPSERT_HOLDING);
+    if (!op) {
+        return -1;
+    }
+    memset(&op->data.holding, 0, sizeof(op->data.holding));
+    strncpy(op->data.holding.user_id, user_id, sizeof(op->data.holding.user_id) - 1);
+    strncpy(op->data.holding.symbol, symbol, sizeof(op->data.holding.symbol) - 1);
+    op->data.holding.quantity = quantity;
+    return persistence_enqueue(op, user_id, seq);
+}
+
+/**
+ * Пакет состояний срабатывания: одна операция на шард за тик вместо одной на алерт
+ */
+int persistence_update_trigger_state(const TriggerStateRow* rows, int count) {
+    if (!rows || count <= 0) {
+        return -1;
+    }
+
+    int result = 0;
+    int shards = g_writer_running ? g_writer_count : 1;
+
+    for (int shard = 0; shard < shards; shard++) {
+        int shard_rows = 0;
+        for (int i = 0; i < count; i++) {
+            if (rows[i].shard == shard || shards == 1) {
+                shard_rows++;
+            }
+        }
+        if (shard_rows == 0) {
+            continue;
+        }
+
+        PersistOp* op = persist_op_new(PERSIST_UPDATE_TRIGGER_STATE);
+        if (!op) {
+            return -1;
+        }
+        op->data.trigger_state.rows = malloc(sizeof(TriggerStateRow) * (size_t)shard_rows);
+        if (!op->data.trigger_state.rows) {
+            alert_log("ERROR", "Failed to allocate trigger state batch");
+            free(op);
+            return -1;
+        }
+
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            if (rows[i].shard == shard || shards == 1) {
+                op->data.trigger_state.rows[n++] = rows[i];
+            }
+        }
+        op->data.trigger_state.count = n;
+
+        if (persistence_enqueue_shard(op, shard, NULL) != 0) {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Данные операции для журнала: только поле объединения, относящееся к типу
+ */
+static const void* persist_op_payload(const PersistOp* op, uint32_t* size) {
+    switch (op->type) {
+        case PERSIST_SAVE_ALERT:
+            *size = sizeof(op->data.alert);
+            return &op->data.alert;
+        case PERSIST_UPDATE_STATUS:
+            *size = sizeof(op->data.status);
+            return &op->data.status;
+        case PERSIST_UPDATE_TRIGGER_MODE:
+            *size = sizeof(op->data.trigger_mode);
+            return &op->data.trigger_mode;
+        case PERSIST_UPDATE_SCHEDULE:
+            *size = sizeof(op->data.schedule);
+            return &op->data.schedule;
+        case PERSIST_UPSERT_HOLDING:
+            *size = sizeof(op->data.holding);
+            return &op->data.holding;
+        case PERSIST_UPDATE_TRIGGER_STATE:
+            *size = (uint32_t)(sizeof(TriggerStateRow) * (size_t)op->data.trigger_state.count);
+            return op->data.trigger_state.rows;
+    }
+    *size = 0;
+    return NULL;
+}
+
+/**
+ * Привязка параметров операции к подготовленному выражению
+ */
+static sqlite3_stmt* persist_op_bind(PersistWriter* writer, PersistOp* op) {
+    sqlite3_stmt* stmt = NULL;
+
+    switch (op->type) {
+        case PERSIST_SAVE_ALERT: {
+            Alert* alert = &op->data.alert;
+            stmt = writer->statements.insert_alert;
+            sqlite3_bind_int(stmt, 1, alert->id);
+            sqlite3_bind_text(stmt, 2, alert->user_id, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, alert->symbol, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 4, alert->type);
+            sqlite3_bind_double(stmt, 5, alert->target_value);
+            sqlite3_bind_int(stmt, 6, alert->status);
+            sqlite3_bind_int64(stmt, 7, alert->created_at);
+            sqlite3_bind_int64(stmt, 8, alert->last_triggered);
+            sqlite3_bind_int(stmt, 9, alert->trigger_count);
+            sqlite3_bind_text(stmt, 10, alert->message, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 11, alert->is_repeatable ? 1 : 0);
+            sqlite3_bind_int(stmt, 12, alert->cooldown_minutes);
+            sqlite3_bind_int(stmt, 13, alert->required_tier);
+            if (alert->type == ALERT_COMPOUND) {
+                sqlite3_bind_text(stmt, 14, alert->expression, -1, SQLITE_STATIC);
+            } else {
+                sqlite3_bind_null(stmt, 14);
+            }
+            sqlite3_bind_int(stmt, 15, alert->trigger_mode);
+            sqlite3_bind_double(stmt, 16, alert->hysteresis);
+            break;
+        }
+        case PERSIST_UPDATE_STATUS:
+            stmt = writer->statements.update_status;
+            sqlite3_bind_int(stmt, 1, op->data.status.status);
+            sqlite3_bind_int(stmt, 2, op->data.status.alert_id);
+            break;
+        case PERSIST_UPDATE_TRIGGER_MODE:
+            stmt = writer->statements.update_trigger_mode;
+            sqlite3_bind_int(stmt, 1, op->data.trigger_mode.mode);
+            sqlite3_bind_double(stmt, 2, op->data.trigger_mode.hysteresis);
+            sqlite3_bind_int(stmt, 3, op->data.trigger_mode.alert_id);
+            break;
+        case PERSIST_UPDATE_SCHEDULE:
+            stmt = writer->statements.update_schedule;
+            sqlite3_bind_int(stmt, 1, op->data.schedule.status);
+            sqlite3_bind_int64(stmt, 2, op->data.schedule.activate_at);
+            sqlite3_bind_int64(stmt, 3, op->data.schedule.expires_at);
+            sqlite3_bind_int64(stmt, 4, op->data.schedule.check_at);
+            sqlite3_bind_int(stmt, 5, op->data.schedule.alert_id);
+            break;
+        case PERSIST_UPSERT_HOLDING:
+            stmt = writer->statements.upsert_holding;
+            sqlite3_bind_text(stmt, 1, op->data.holding.user_id, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, op->data.holding.symbol, -1, SQLITE_STATIC);
+            sqlite3_bind_double(stmt, 3, op->data.holding.quantity);
+            break;
+        case PERSIST_UPDATE_TRIGGER_STATE:
+            // Многострочная операция, применяется в persist_op_apply
+            break;
+    }
+
+    return stmt;
+}
+
+static int persist_step(sqlite3_stmt* stmt) {
+    int failed = sqlite3_step(stmt) != SQLITE_DONE;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return failed;
+}
+
+/**
+ * Выполнение операции, возвращает число неудачных строк
+ */
+static int persist_op_apply(PersistWriter* writer, PersistOp* op) {
+    if (op->type == PERSIST_UPDATE_TRIGGER_STATE) {
+        sqlite3_stmt* stmt = writer->statements.update_trigger_state;
+        int failed = 0;
+        for (int i = 0; i < op->data.trigger_state.count; i++) {
+            TriggerStateRow* row = &op->data.trigger_state.rows[i];
+            sqlite3_bind_int64(stmt, 1, row->last_triggered);
+            sqlite3_bind_int(stmt, 2, row->trigger_count);
+            sqlite3_bind_int(stmt, 3, row->alert_id);
+            failed += persist_step(stmt);
+        }
+        return failed;
+    }
+
+    sqlite3_stmt* stmt = persist_op_bind(writer, op);
+    return stmt ? persist_step(stmt) : 0;
+}
+
+static void persist_op_free(PersistOp* op) {
+    if (op->type == PERSIST_UPDATE_TRIGGER_STATE) {
+        free(op->data.trigger_state.rows);
+    }
+    free(op);
+}
+
+/**
+ * Перенос новых операций очереди в пачку. В базу попадают только операции,
+ * уже записанные в журнал: операции отброшенной пачки журнала вызывающий
+ * получил как неудачные и в памяти не применил. Возвращает число отброшенных.
+ */
+static uint64_t persistence_take_queue(PersistWriter* writer) {
+    PersistOp* popped = NULL;
+    PersistOp* popped_tail = NULL;
+    uint64_t last_seq = 0;
+    PersistOp* op;
+    while ((op = queue_pop(&writer->queue)) != NULL) {
+        op->next = NULL;
+        if (popped_tail) {
+            popped_tail->next = op;
+        } else {
+            popped = op;
+        }
+        popped_tail = op;
+        if (op->seq > last_seq) {
+            last_seq = op->seq;
+        }
+    }
+
+    // Одно ожидание на всю пачку, дальше проверки не ждут
+    if (last_seq > 0) {
+        op_log_sync(last_seq);
+    }
+
+    uint64_t dropped = 0;
+    while (popped) {
+        op = popped;
+        popped = op->next;
+        op->next = NULL;
+
+        if (op->seq > 0 && op_log_sync(op->seq) != 0) {
+            persist_op_free(op);
+            dropped++;
+            continue;
+        }
+        if (writer->batch_tail) {
+            writer->batch_tail->next = op;
+        } else {
+            writer->batch = op;
+        }
+        writer->batch_tail = op;
+    }
+
+    if (dropped > 0) {
+        pthread_mutex_lock(&writer->mutex);
+        writer->failed_ops += dropped;
+        pthread_mutex_unlock(&writer->mutex);
+
+        char log_msg[160];
+        snprintf(log_msg, sizeof(log_msg),
+                 "Skipping %llu operations on shard %d not written to operation log",
+                 (unsigned long long)dropped, writer->shard);
+        alert_log("ERROR", log_msg);
+    }
+    return dropped;
+}
+
+/**
+ * Применение всех доступных операций в одной транзакции.
+ * При неудачном COMMIT пачка остается у потока записи и повторяется
+ * вместе с новыми операциями; возвращает число обработанных операций
+ * (зафиксированных и отброшенных до записи в базу).
+ */
+static uint64_t persistence_commit_batch(PersistWriter* writer) {
+    uint64_t dropped = persistence_take_queue(writer);
+    if (!writer->batch) {
+        return dropped;
+    }
+
+    PersistOp* op;
+    uint64_t count = 0;
+    uint64_t max_seq = 0;
+    int failed = 0;
+    char first_error[128] = "";
+
+    sqlite3_exec(writer->db, "BEGIN", 0, 0, NULL);
+
+    for (op = writer->batch; op; op = op->next) {
+        int op_failed = persist_op_apply(writer, op);
+        if (op_failed > 0 && failed == 0) {
+            snprintf(first_error, sizeof(first_error), "%s", sqlite3_errmsg(writer->db));
+        }
+        failed += op_failed;
+        if (op->seq > max_seq) {
+            max_seq = op->seq;
+        }
+        count++;
+    }
+
+    // Номер журнала фиксируется той же транзакцией: повтор не применит операцию дважды
+    if (max_seq > 0) {
+        sqlite3_bind_int64(writer->statements.update_applied_seq, 1, (sqlite3_int64)max_seq);
+        persist_step(writer->statements.update_applied_seq);
+    }
+
+    bool committed = sqlite3_exec(writer->db, "COMMIT", 0, 0, NULL) == SQLITE_OK;
+    if (!committed) {
+        sqlite3_exec(writer->db, "ROLLBACK", 0, 0, NULL);
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->commit_attempts++;
+    writer->commit_failed = !committed;
+    writer->commit_failures = committed ? 0 : writer->commit_failures + 1;
+    if (committed) {
+        writer->failed_ops += (uint64_t)failed;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    char log_msg[256];
+    if (!committed) {
+        snprintf(log_msg, sizeof(log_msg),
+                 "Failed to commit persistence batch of %llu operations on shard %d, will retry",
+                 (unsigned long long)count, writer->shard);
+        alert_log("ERROR", log_msg);
+        return dropped;
+    }
+
+    if (max_seq > 0) {
+        __atomic_store_n(&writer->applied_seq, max_seq, __ATOMIC_RELEASE);
+    }
+    if (failed > 0) {
+        snprintf(log_msg, sizeof(log_msg),
+                 "Persistence batch on shard %d: %d of %llu operations failed: %s",
+                 writer->shard, failed, (unsigned long long)count, first_error);
+        alert_log("ERROR", log_msg);
+    }
+
+    while (writer->batch) {
+        op = writer->batch;
+        writer->batch = op->next;
+        persist_op_free(op);
+    }
+    writer->batch_tail = NULL;
+    return count + dropped;
+}
+
+/**
+ * Отказ от пачки, которую не удалось зафиксировать при остановке; ее операции
+ * остаются в журнале операций и применяются повтором при следующем запуске
+ */
+static uint64_t persistence_abandon_batch(PersistWriter* writer) {
+    uint64_t count = 0;
+    bool logged = true;
+    while (writer->batch) {
+        PersistOp* op = writer->batch;
+        writer->batch = op->next;
+        logged = logged && op->seq > 0;
+        persist_op_free(op);
+        count++;
+    }
+    writer->batch_tail = NULL;
+    writer->abandoned = true;
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->failed_ops += count;
+    pthread_mutex_unlock(&writer->mutex);
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg),
+             "Dropping %llu uncommitted operations on shard %d at shutdown%s",
+             (unsigned long long)count, writer->shard,
+             logged ? ", they remain in the operation log" : "");
+    alert_log("ERROR", log_msg);
+    return count;
+}
+
+/**
+ * Поток записи: ждет окно долговечности (или заполнения пачки), затем
+ * фиксирует все накопленные операции одной транзакцией
+ */
+static void* persistence_writer_thread(void* arg) {
+    PersistWriter* writer = arg;
+
+    pthread_mutex_lock(&writer->mutex);
+
+    for (;;) {
+        uint64_t pending = __atomic_load_n(&writer->enqueued, __ATOMIC_ACQUIRE) - writer->committed;
+
+        if (writer->stop && pending == 0) {
+            break;
+        }
+
+        // После неудачной транзакции повтор не раньше, чем через окно
+        if (writer->commit_failed ||
+            (!writer->stop && !writer->flush_requested &&
+             pending < (uint64_t)persistence_config.max_batch)) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            long window_ns = (long)persistence_config.durability_window_ms * 1000000L;
+            deadline.tv_sec += window_ns / 1000000000L;
+            deadline.tv_nsec += window_ns % 1000000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&writer->cond, &writer->mutex, &deadline);
+        }
+        writer->flush_requested = false;
+        pthread_mutex_unlock(&writer->mutex);
+
+        uint64_t applied = persistence_commit_batch(writer);
+
+        pthread_mutex_lock(&writer->mutex);
+        bool give_up = writer->stop && writer->commit_failures >= PERSIST_STOP_RETRIES;
+        pthread_mutex_unlock(&writer->mutex);
+        if (give_up) {
+            applied = persistence_abandon_batch(writer);
+        }
+
+        if (applied == 0 && pending > 0) {
+            // Производитель еще не связал узел: даем ему завершить вставку
+            sched_yield();
+        }
+
+        pthread_mutex_lock(&writer->mutex);
+        if (give_up) {
+            writer->commit_failed = false;
+            writer->commit_failures = 0;
+        }
+        writer->committed += applied;
+        pthread_cond_broadcast(&writer->committed_cond);
+    }
+
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
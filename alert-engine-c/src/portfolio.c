@@ -0,0 +1,348 @@
+#include "../include/portfolio.h"
+#include "../include/alert_engine.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define PORTFOLIO_USER_INDEX_SIZE 32768
+#define PORTFOLIO_SYMBOL_INDEX_SIZE 1024
+
+// Глобальное хранилище портфелей
+static PortfolioManager* g_portfolio_manager = NULL;
+static pthread_mutex_t g_portfolio_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * FNV-1a хэш строки
+ */
+static unsigned int portfolio_hash(const char* str) {
+    unsigned int hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Поиск портфеля пользователя (создает новый при create = true)
+ */
+static Portfolio* portfolio_find(const char* user_id, bool create) {
+    int mask = g_portfolio_manager->user_index_size - 1;
+    int slot = (int)(portfolio_hash(user_id) & (unsigned int)mask);
+
+    while (g_portfolio_manager->user_index[slot] >= 0) {
+        Portfolio* portfolio = &g_portfolio_manager->portfolios[g_portfolio_manager->user_index[slot]];
+        if (strcmp(portfolio->user_id, user_id) == 0) {
+            return portfolio;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!create || g_portfolio_manager->count >= g_portfolio_manager->capacity) {
+        return NULL;
+    }
+
+    int index = g_portfolio_manager->count;
+    Portfolio* portfolio = &g_portfolio_manager->portfolios[index];
+    memset(portfolio, 0, sizeof(Portfolio));
+    strncpy(portfolio->user_id, user_id, sizeof(portfolio->user_id) - 1);
+
+    g_portfolio_manager->user_index[slot] = index;
+    g_portfolio_manager->count++;
+
+    return portfolio;
+}
+
+/**
+ * Поиск записи индекса символа (создает новую при create = true)
+ */
+static PortfolioSymbolEntry* portfolio_find_symbol(const char* symbol, bool create) {
+    int mask = g_portfolio_manager->symbol_index_size - 1;
+    int slot = (int)(portfolio_hash(symbol) & (unsigned int)mask);
+
+    for (int probe = 0; probe < g_portfolio_manager->symbol_index_size; probe++) {
+        PortfolioSymbolEntry* entry = &g_portfolio_manager->symbol_index[slot];
+
+        if (entry->symbol[0] == '\0') {
+            if (!create) {
+                return NULL;
+            }
+            strncpy(entry->symbol, symbol, sizeof(entry->symbol) - 1);
+            return entry;
+        }
+
+        if (strcmp(entry->symbol, symbol) == 0) {
+            return entry;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/**
+ * Полный пересчет стоимости портфеля (сбрасывает накопленную погрешность)
+ */
+static void portfolio_resum(Portfolio* portfolio) {
+    double total = 0.0;
+    for (int i = 0; i < portfolio->holding_count; i++) {
+        total += portfolio->holdings[i].quantity * portfolio->holdings[i].last_price;
+    }
+    portfolio->total_value = total;
+    portfolio->updates_since_resum = 0;
+}
+
+/**
+ * Инициализация хранилища портфелей
+ */
+int portfolio_init(void) {
+    if (g_portfolio_manager) {
+        return 0;
+    }
+
+    g_portfolio_manager = calloc(1, sizeof(PortfolioManager));
+    if (!g_portfolio_manager) {
+        alert_log("ERROR", "Failed to allocate PortfolioManager");
+        return -1;
+    }
+
+    g_portfolio_manager->portfolios = calloc(MAX_PORTFOLIOS, sizeof(Portfolio));
+    g_portfolio_manager->user_index = malloc(sizeof(int) * PORTFOLIO_USER_INDEX_SIZE);
+    g_portfolio_manager->symbol_index = calloc(PORTFOLIO_SYMBOL_INDEX_SIZE, sizeof(PortfolioSymbolEntry));
+
+    if (!g_portfolio_manager->portfolios || !g_portfolio_manager->user_index ||
+        !g_portfolio_manager->symbol_index) {
+        alert_log("ERROR", "Failed to allocate portfolio indexes");
+        portfolio_cleanup();
+        return -1;
+    }
+
+    for (int i = 0; i < PORTFOLIO_USER_INDEX_SIZE; i++) {
+        g_portfolio_manager->user_index[i] = -1;
+    }
+
+    g_portfolio_manager->capacity = MAX_PORTFOLIOS;
+    g_portfolio_manager->user_index_size = PORTFOLIO_USER_INDEX_SIZE;
+    g_portfolio_manager->symbol_index_size = PORTFOLIO_SYMBOL_INDEX_SIZE;
+
+    alert_log("INFO", "Portfolio store initialized");
+    return 0;
+}
+
+/**
+ * Завершение работы хранилища портфелей
+ */
+void portfolio_cleanup(void) {
+    if (!g_portfolio_manager) {
+        return;
+    }
+
+    if (g_portfolio_manager->portfolios) {
+        for (int i = 0; i < g_portfolio_manager->count; i++) {
+            free(g_portfolio_manager->portfolios[i].holdings);
+        }
+        free(g_portfolio_manager->portfolios);
+    }
+
+    if (g_portfolio_manager->symbol_index) {
+        for (int i = 0; i < g_portfolio_manager->symbol_index_size; i++) {
+            free(g_portfolio_manager->symbol_index[i].refs);
+        }
+        free(g_portfolio_manager->symbol_index);
+    }
+
+    free(g_portfolio_manager->user_index);
+    free(g_portfolio_manager);
+    g_portfolio_manager = NULL;
+}
+
+/**
+ * Поиск позиции пользователя с созданием пустой (вызывается под g_portfolio_mutex)
+ *
+ * Позиция с нулевым количеством остается в индексе, чтобы не
+ * перестраивать ссылки; она просто не влияет на стоимость.
+ */
+static int portfolio_holding_slot(const char* user_id, const char* symbol,
+                                  Portfolio** out_portfolio, PortfolioHolding** out_holding) {
+    Portfolio* portfolio = portfolio_find(user_id, true);
+    PortfolioSymbolEntry* entry = portfolio_find_symbol(symbol, true);
+    if (!portfolio || !entry) {
+        alert_log("ERROR", "Portfolio store capacity exceeded");
+        return -2;
+    }
+
+    // Поиск существующей позиции
+    PortfolioHolding* holding = NULL;
+    for (int i = 0; i < portfolio->holding_count; i++) {
+        if (strcmp(portfolio->holdings[i].symbol, symbol) == 0) {
+            holding = &portfolio->holdings[i];
+            break;
+        }
+    }
+
+    if (!holding) {
+        if (portfolio->holding_count >= portfolio->holding_capacity) {
+            int new_capacity = portfolio->holding_capacity ? portfolio->holding_capacity * 2
+                                                           : PORTFOLIO_INITIAL_HOLDINGS;
+            PortfolioHolding* holdings = realloc(portfolio->holdings, sizeof(PortfolioHolding) * new_capacity);
+            if (!holdings) {
+                return -3;
+            }
+            portfolio->holdings = holdings;
+            portfolio->holding_capacity = new_capacity;
+        }
+
+        if (entry->count >= entry->capacity) {
+            int new_capacity = entry->capacity ? entry->capacity * 2 : PORTFOLIO_INITIAL_HOLDINGS;
+            PortfolioRef* refs = realloc(entry->refs, sizeof(PortfolioRef) * new_capacity);
+            if (!refs) {
+                return -3;
+            }
+            entry->refs = refs;
+            entry->capacity = new_capacity;
+        }
+
+        int holding_index = portfolio->holding_count++;
+        holding = &portfolio->holdings[holding_index];
+        memset(holding, 0, sizeof(PortfolioHolding));
+        strncpy(holding->symbol, symbol, sizeof(holding->symbol) - 1);
+        holding->last_price = entry->last_price;
+
+        entry->refs[entry->count].portfolio_index = (int)(portfolio - g_portfolio_manager->portfolios);
+        entry->refs[entry->count].holding_index = holding_index;
+        entry->count++;
+    }
+
+    *out_portfolio = portfolio;
+    *out_holding = holding;
+    return 0;
+}
+
+/**
+ * Подготовка позиции без изменения количества: после нее
+ * portfolio_set_holding для той же пары не может завершиться ошибкой
+ */
+int portfolio_reserve_holding(const char* user_id, const char* symbol) {
+    if (!user_id || !symbol || !g_portfolio_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_portfolio_mutex);
+
+    Portfolio* portfolio;
+    PortfolioHolding* holding;
+    int result = portfolio_holding_slot(user_id, symbol, &portfolio, &holding);
+
+    pthread_mutex_unlock(&g_portfolio_mutex);
+    return result;
+}
+
+/**
+ * Установка количества актива в портфеле пользователя
+ */
+int portfolio_set_holding(const char* user_id, const char* symbol, double quantity) {
+    if (!user_id || !symbol || !g_portfolio_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_portfolio_mutex);
+
+    Portfolio* portfolio;
+    PortfolioHolding* holding;
+    int result = portfolio_holding_slot(user_id, symbol, &portfolio, &holding);
+    if (result != 0) {
+        pthread_mutex_unlock(&g_portfolio_mutex);
+        return result;
+    }
+
+    // Инкрементальная корректировка стоимости
+    portfolio->total_value += (quantity - holding->quantity) * holding->last_price;
+    holding->quantity = quantity;
+    portfolio->last_valued = time(NULL);
+
+    pthread_mutex_unlock(&g_portfolio_mutex);
+    return 0;
+}
+
+/**
+ * Получение позиций портфеля пользователя
+ */
+int portfolio_get_holdings(const char* user_id, PortfolioHolding* holdings, int max_count) {
+    if (!user_id || !holdings || !g_portfolio_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_portfolio_mutex);
+
+    int count = 0;
+    Portfolio* portfolio = portfolio_find(user_id, false);
+    if (portfolio) {
+        for (int i = 0; i < portfolio->holding_count && count < max_count; i++) {
+            holdings[count++] = portfolio->holdings[i];
+        }
+    }
+
+    pthread_mutex_unlock(&g_portfolio_mutex);
+    return count;
+}
+
+/**
+ * Обновление стоимости портфелей при изменении цены одного символа
+ *
+ * Затрагиваются только портфели, содержащие символ: каждый получает
+ * дельту quantity * (new - old) вместо полного пересчета.
+ */
+int portfolio_on_price_update(const char* symbol, double price) {
+    if (!symbol || !g_portfolio_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_portfolio_mutex);
+
+    PortfolioSymbolEntry* entry = portfolio_find_symbol(symbol, true);
+    if (!entry) {
+        pthread_mutex_unlock(&g_portfolio_mutex);
+        return -1;
+    }
+
+    entry->last_price = price;
+
+    time_t now = time(NULL);
+    for (int i = 0; i < entry->count; i++) {
+        Portfolio* portfolio = &g_portfolio_manager->portfolios[entry->refs[i].portfolio_index];
+        PortfolioHolding* holding = &portfolio->holdings[entry->refs[i].holding_index];
+
+        portfolio->total_value += holding->quantity * (price - holding->last_price);
+        holding->last_price = price;
+        portfolio->last_valued = now;
+
+        if (++portfolio->updates_since_resum >= PORTFOLIO_RESUM_INTERVAL) {
+            portfolio_resum(portfolio);
+        }
+    }
+
+    int updated = entry->count;
+    pthread_mutex_unlock(&g_portfolio_mutex);
+
+    return updated;
+}
+
+/**
+ * Текущая стоимость портфеля пользователя
+ */
+bool portfolio_get_value(const char* user_id, double* value) {
+    if (!user_id || !value || !g_portfolio_manager) {
+        return false;
+    }
+
+    pthread_mutex_lock(&g_portfolio_mutex);
+
+    Portfolio* portfolio = portfolio_find(user_id, false);
+    if (portfolio) {
+        *value = portfolio->total_value;
+    }
+
+    pthread_mutex_unlock(&g_portfolio_mutex);
+    return portfolio != NULL;
+}
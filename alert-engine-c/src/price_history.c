@@ -0,0 +1,526 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/price_history.h"
+#include "../include/alert_engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+// Windows заглушки: история требует mmap
+int price_history_open(const char* dir) {
+    (void)dir;
+    alert_log("WARNING", "Price history is not supported on Windows");
+    return -1;
+}
+
+void price_history_close(void) {
+}
+
+int price_history_append(const char* symbol, time_t timestamp, double price) {
+    (void)symbol; (void)timestamp; (void)price;
+    return -1;
+}
+
+int price_history_read(const char* symbol, time_t from, time_t to,
+                       PricePoint* points, int max_points) {
+    (void)symbol; (void)from; (void)to; (void)points; (void)max_points;
+    return 0;
+}
+#else
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_MAGIC 0x53544850u  // "PHTS"
+#define HISTORY_VERSION 1
+#define HISTORY_FILE_HEADER_SIZE 64
+#define HISTORY_BLOCK_HEADER_SIZE 32
+#define HISTORY_PAYLOAD_BITS ((PRICE_HISTORY_BLOCK_SIZE - HISTORY_BLOCK_HEADER_SIZE) * 8)
+#define HISTORY_MAX_POINT_BITS 113  // 4 + 32 на время, 2 + 5 + 6 + 64 на цену
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint8_t reserved[HISTORY_FILE_HEADER_SIZE - 12];
+} HistoryFileHeader;
+
+// Заголовок блока; первая точка хранится в нем без сжатия
+typedef struct {
+    int64_t first_ts;
+    int64_t last_ts;
+    double first_value;
+    uint32_t count;
+    uint32_t bit_len;
+} HistoryBlockHeader;
+
+typedef char history_block_header_check[sizeof(HistoryBlockHeader) == HISTORY_BLOCK_HEADER_SIZE ? 1 : -1];
+
+// Состояние кодера/декодера внутри блока
+typedef struct {
+    int64_t prev_ts;
+    int64_t prev_delta;
+    uint64_t prev_bits;
+    int prev_leading;       // -1 пока окно значащих бит не задано
+    int prev_trailing;
+} HistoryCodec;
+
+typedef struct {
+    char symbol[MAX_SYMBOL_LEN];
+    int fd;
+    uint32_t block_count;           // Последний блок - активный
+    unsigned char block[PRICE_HISTORY_BLOCK_SIZE];
+    HistoryCodec codec;
+} HistorySeries;
+
+typedef struct {
+    char dir[320];
+    HistorySeries* series[PRICE_HISTORY_MAX_SERIES];
+    int series_count;
+} PriceHistoryStore;
+
+static PriceHistoryStore* g_history = NULL;
+static pthread_mutex_t g_history_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void put_bits(unsigned char* buf, uint32_t* pos, uint64_t value, int nbits) {
+    for (int i = nbits - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            buf[*pos >> 3] |= (unsigned char)(0x80 >> (*pos & 7));
+        }
+        (*pos)++;
+    }
+}
+
+static uint64_t get_bits(const unsigned char* buf, uint32_t* pos, int nbits) {
+    uint64_t value = 0;
+    for (int i = 0; i < nbits; i++) {
+        value = (value << 1) | ((buf[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+        (*pos)++;
+    }
+    return value;
+}
+
+static int64_t sign_extend(uint64_t value, int nbits) {
+    uint64_t sign = (uint64_t)1 << (nbits - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+static uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void codec_init(HistoryCodec* codec, const HistoryBlockHeader* header) {
+    codec->prev_ts = header->first_ts;
+    codec->prev_delta = 0;
+    codec->prev_bits = double_bits(header->first_value);
+    codec->prev_leading = -1;
+    codec->prev_trailing = 0;
+}
+
+/**
+ * Кодирование точки после первой (заголовок блока обновляет вызывающий)
+ */
+static void codec_encode(HistoryCodec* codec, unsigned char* payload, uint32_t* pos,
+                         int64_t ts, double value) {
+    int64_t delta = ts - codec->prev_ts;
+    int64_t dod = delta - codec->prev_delta;
+
+    if (dod == 0) {
+        put_bits(payload, pos, 0x0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        put_bits(payload, pos, 0x2, 2);
+        put_bits(payload, pos, (uint64_t)dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        put_bits(payload, pos, 0x6, 3);
+        put_bits(payload, pos, (uint64_t)dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        put_bits(payload, pos, 0xE, 4);
+        put_bits(payload, pos, (uint64_t)dod, 12);
+    } else {
+        put_bits(payload, pos, 0xF, 4);
+        put_bits(payload, pos, (uint64_t)dod, 32);
+    }
+    codec->prev_delta = delta;
+    codec->prev_ts = ts;
+
+    uint64_t bits = double_bits(value);
+    uint64_t xor = bits ^ codec->prev_bits;
+    codec->prev_bits = bits;
+
+    if (xor == 0) {
+        put_bits(payload, pos, 0x0, 1);
+        return;
+    }
+    put_bits(payload, pos, 0x1, 1);
+
+    int leading = __builtin_clzll(xor);
+    int trailing = __builtin_ctzll(xor);
+    if (leading > 31) {
+        leading = 31;
+    }
+
+    if (codec->prev_leading >= 0 &&
+        leading >= codec->prev_leading && trailing >= codec->prev_trailing) {
+        // Значащие биты укладываются в предыдущее окно
+        int meaningful = 64 - codec->prev_leading - codec->prev_trailing;
+        put_bits(payload, pos, 0x0, 1);
+        put_bits(payload, pos, xor >> codec->prev_trailing, meaningful);
+    } else {
+        int meaningful = 64 - leading - trailing;
+        put_bits(payload, pos, 0x1, 1);
+        put_bits(payload, pos, (uint64_t)leading, 5);
+        put_bits(payload, pos, (uint64_t)(meaningful & 63), 6);
+        put_bits(payload, pos, xor >> trailing, meaningful);
+        codec->prev_leading = leading;
+        codec->prev_trailing = trailing;
+    }
+}
+
+static void codec_decode(HistoryCodec* codec, const unsigned char* payload, uint32_t* pos,
+                         PricePoint* point) {
+    int64_t dod;
+    if (get_bits(payload, pos, 1) == 0) {
+        dod = 0;
+    } else if (get_bits(payload, pos, 1) == 0) {
+        dod = sign_extend(get_bits(payload, pos, 7), 7);
+    } else if (get_bits(payload, pos, 1) == 0) {
+        dod = sign_extend(get_bits(payload, pos, 9), 9);
+    } else if (get_bits(payload, pos, 1) == 0) {
+        dod = sign_extend(get_bits(payload, pos, 12), 12);
+    } else {
+        dod = sign_extend(get_bits(payload, pos, 32), 32);
+    }
+    codec->prev_delta += dod;
+    codec->prev_ts += codec->prev_delta;
+
+    if (get_bits(payload, pos, 1) == 1) {
+        uint64_t xor;
+        if (get_bits(payload, pos, 1) == 0) {
+            int meaningful = 64 - codec->prev_leading - codec->prev_trailing;
+            xor = get_bits(payload, pos, meaningful) << codec->prev_trailing;
+        } else {
+            int leading = (int)get_bits(payload, pos, 5);
+            int meaningful = (int)get_bits(payload, pos, 6);
+            if (meaningful == 0) {
+                meaningful = 64;
+            }
+            int trailing = 64 - leading - meaningful;
+            xor = get_bits(payload, pos, meaningful) << trailing;
+            codec->prev_leading = leading;
+            codec->prev_trailing = trailing;
+        }
+        codec->prev_bits ^= xor;
+    }
+
+    point->timestamp = codec->prev_ts;
+    point->price = bits_double(codec->prev_bits);
+}
+
+static HistoryBlockHeader* block_header(unsigned char* block) {
+    return (HistoryBlockHeader*)block;
+}
+
+static off_t block_offset(uint32_t index) {
+    return (off_t)HISTORY_FILE_HEADER_SIZE + (off_t)index * PRICE_HISTORY_BLOCK_SIZE;
+}
+
+/**
+ * Восстановление состояния кодера по активному блоку
+ */
+static void series_restore_codec(HistorySeries* series) {
+    HistoryBlockHeader* header = block_header(series->block);
+    const unsigned char* payload = series->block + HISTORY_BLOCK_HEADER_SIZE;
+    uint32_t pos = 0;
+    PricePoint point;
+
+    codec_init(&series->codec, header);
+    for (uint32_t i = 1; i < header->count; i++) {
+        codec_decode(&series->codec, payload, &pos, &point);
+    }
+}
+
+static void series_file_path(char* path, size_t size, const char* symbol) {
+    char name[MAX_SYMBOL_LEN];
+    size_t i = 0;
+    for (; symbol[i] && i < sizeof(name) - 1; i++) {
+        char c = symbol[i];
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9') || c == '-' || c == '_';
+        name[i] = safe ? c : '_';
+    }
+    name[i] = '\0';
+    snprintf(path, size, "%s/%s.ts", g_history->dir, name);
+}
+
+/**
+ * Поиск ряда символа (открывает или создает файл при необходимости)
+ */
+static HistorySeries* series_find(const char* symbol, bool create) {
+    for (int i = 0; i < g_history->series_count; i++) {
+        if (strcmp(g_history->series[i]->symbol, symbol) == 0) {
+            return g_history->series[i];
+        }
+    }
+
+    if (g_history->series_count >= PRICE_HISTORY_MAX_SERIES) {
+        return NULL;
+    }
+
+    char path[400];
+    series_file_path(path, sizeof(path), symbol);
+
+    int fd = open(path, create ? (O_RDWR | O_CREAT) : O_RDWR, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    HistorySeries* series = calloc(1, sizeof(HistorySeries));
+    if (!series) {
+        close(fd);
+        return NULL;
+    }
+    strncpy(series->symbol, symbol, sizeof(series->symbol) - 1);
+    series->fd = fd;
+
+    struct stat st;
+    HistoryFileHeader file_header;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)HISTORY_FILE_HEADER_SIZE &&
+        pread(fd, &file_header, sizeof(file_header), 0) == (ssize_t)sizeof(file_header) &&
+        file_header.magic == HISTORY_MAGIC && file_header.version == HISTORY_VERSION &&
+        file_header.block_size == PRICE_HISTORY_BLOCK_SIZE) {
+        series->block_count = (uint32_t)((st.st_size - HISTORY_FILE_HEADER_SIZE) / PRICE_HISTORY_BLOCK_SIZE);
+        if (series->block_count > 0 &&
+            pread(fd, series->block, PRICE_HISTORY_BLOCK_SIZE,
+                  block_offset(series->block_count - 1)) == PRICE_HISTORY_BLOCK_SIZE) {
+            series_restore_codec(series);
+        } else {
+            series->block_count = 0;
+        }
+    } else {
+        // Новый или несовместимый файл начинается заново
+        memset(&file_header, 0, sizeof(file_header));
+        file_header.magic = HISTORY_MAGIC;
+        file_header.version = HISTORY_VERSION;
+        file_header.block_size = PRICE_HISTORY_BLOCK_SIZE;
+        if (ftruncate(fd, 0) != 0 ||
+            pwrite(fd, &file_header, sizeof(file_header), 0) != (ssize_t)sizeof(file_header)) {
+            close(fd);
+            free(series);
+            return NULL;
+        }
+    }
+
+    g_history->series[g_history->series_count++] = series;
+    return series;
+}
+
+int price_history_open(const char* dir) {
+    if (g_history || !dir) {
+        return -1;
+    }
+
+    mkdir(dir, 0755);
+
+    g_history = calloc(1, sizeof(PriceHistoryStore));
+    if (!g_history) {
+        return -1;
+    }
+    strncpy(g_history->dir, dir, sizeof(g_history->dir) - 1);
+
+    alert_log("INFO", "Price history store opened");
+    return 0;
+}
+
+void price_history_close(void) {
+    pthread_mutex_lock(&g_history_mutex);
+
+    if (g_history) {
+        for (int i = 0; i < g_history->series_count; i++) {
+            close(g_history->series[i]->fd);
+            free(g_history->series[i]);
+        }
+        free(g_history);
+        g_history = NULL;
+    }
+
+    pthread_mutex_unlock(&g_history_mutex);
+}
+
+/**
+ * Начало нового блока с первой точкой
+ */
+static int series_start_block(HistorySeries* series, int64_t ts, double value) {
+    memset(series->block, 0, sizeof(series->block));
+    HistoryBlockHeader* header = block_header(series->block);
+    header->first_ts = ts;
+    header->last_ts = ts;
+    header->first_value = value;
+    header->count = 1;
+    header->bit_len = 0;
+    codec_init(&series->codec, header);
+
+    off_t offset = block_offset(series->block_count);
+    if (ftruncate(series->fd, offset + PRICE_HISTORY_BLOCK_SIZE) != 0 ||
+        pwrite(series->fd, series->block, PRICE_HISTORY_BLOCK_SIZE, offset) != PRICE_HISTORY_BLOCK_SIZE) {
+        return -1;
+    }
+    series->block_count++;
+    return 0;
+}
+
+/**
+ * Добавление точки; точки не новее последней игнорируются
+ */
+int price_history_append(const char* symbol, time_t timestamp, double price) {
+    if (!symbol) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_history_mutex);
+
+    HistorySeries* series = g_history ? series_find(symbol, true) : NULL;
+    if (!series) {
+        pthread_mutex_unlock(&g_history_mutex);
+        return -1;
+    }
+
+    int64_t ts = (int64_t)timestamp;
+    HistoryBlockHeader* header = block_header(series->block);
+    int result = 0;
+
+    if (series->block_count > 0 && ts <= header->last_ts) {
+        pthread_mutex_unlock(&g_history_mutex);
+        return 0;
+    }
+
+    if (series->block_count == 0 ||
+        header->bit_len + HISTORY_MAX_POINT_BITS > HISTORY_PAYLOAD_BITS) {
+        result = series_start_block(series, ts, price);
+    } else {
+        unsigned char* payload = series->block + HISTORY_BLOCK_HEADER_SIZE;
+        uint32_t start_byte = header->bit_len >> 3;
+
+        codec_encode(&series->codec, payload, &header->bit_len, ts, price);
+        header->last_ts = ts;
+        header->count++;
+
+        // На диск пишутся только заголовок блока и затронутые байты
+        off_t offset = block_offset(series->block_count - 1);
+        uint32_t end_byte = (header->bit_len + 7) >> 3;
+        if (pwrite(series->fd, header, HISTORY_BLOCK_HEADER_SIZE, offset) != HISTORY_BLOCK_HEADER_SIZE ||
+            pwrite(series->fd, payload + start_byte, end_byte - start_byte,
+                   offset + HISTORY_BLOCK_HEADER_SIZE + start_byte) != (ssize_t)(end_byte - start_byte)) {
+            result = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&g_history_mutex);
+    return result;
+}
+
+/**
+ * Чтение истории через mmap файла ряда
+ *
+ * Блоки просматриваются с конца, пока не наберется max_points точек,
+ * затем нужные блоки декодируются по порядку; хранятся последние max_points.
+ */
+int price_history_read(const char* symbol, time_t from, time_t to,
+                       PricePoint* points, int max_points) {
+    if (!symbol || !points || max_points <= 0 || from > to) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_history_mutex);
+
+    HistorySeries* series = g_history ? series_find(symbol, false) : NULL;
+    if (!series || series->block_count == 0) {
+        pthread_mutex_unlock(&g_history_mutex);
+        return 0;
+    }
+
+    size_t map_size = (size_t)block_offset(series->block_count);
+    unsigned char* map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, series->fd, 0);
+    if (map == MAP_FAILED) {
+        pthread_mutex_unlock(&g_history_mutex);
+        return 0;
+    }
+
+    // Первый блок, с которого нужно декодировать
+    uint32_t first_block = series->block_count;
+    uint32_t available = 0;
+    while (first_block > 0 && available < (uint32_t)max_points) {
+        const HistoryBlockHeader* header =
+            (const HistoryBlockHeader*)(map + block_offset(first_block - 1));
+        if (header->last_ts < (int64_t)from) {
+            break;
+        }
+        first_block--;
+        if (header->first_ts <= (int64_t)to) {
+            available += header->count;
+        }
+    }
+
+    // Кольцевой буфер последних max_points точек интервала
+    int found = 0;
+    int head = 0;
+    for (uint32_t b = first_block; b < series->block_count; b++) {
+        const unsigned char* block = map + block_offset(b);
+        const HistoryBlockHeader* header = (const HistoryBlockHeader*)block;
+        if (header->first_ts > (int64_t)to) {
+            break;
+        }
+
+        HistoryCodec codec;
+        codec_init(&codec, header);
+        uint32_t pos = 0;
+        PricePoint point = { header->first_ts, header->first_value };
+
+        for (uint32_t i = 0; i < header->count; i++) {
+            if (i > 0) {
+                codec_decode(&codec, block + HISTORY_BLOCK_HEADER_SIZE, &pos, &point);
+            }
+            if (point.timestamp < (int64_t)from) {
+                continue;
+            }
+            if (point.timestamp > (int64_t)to) {
+                break;
+            }
+            points[head] = point;
+            head = (head + 1) % max_points;
+            if (found < max_points) {
+                found++;
+            }
+        }
+    }
+
+    munmap(map, map_size);
+    pthread_mutex_unlock(&g_history_mutex);
+
+    // Разворот кольца в порядок возрастания времени
+    if (found == max_points && head != 0) {
+        PricePoint* ordered = malloc(sizeof(PricePoint) * (size_t)found);
+        if (!ordered) {
+            return 0;
+        }
+        for (int i = 0; i < found; i++) {
+            ordered[i] = points[(head + i) % max_points];
+        }
+        memcpy(points, ordered, sizeof(PricePoint) * (size_t)found);
+        free(ordered);
+    }
+
+    return found;
+}
+
+#endif
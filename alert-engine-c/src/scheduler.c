@@ -0,0 +1,108 @@
+#include "../include/scheduler.h"
+#include <stdlib.h>
+
+/**
+ * Инициализация планировщика
+ */
+int scheduler_init(Scheduler* scheduler) {
+    scheduler->heap = malloc(sizeof(ScheduledEvent) * SCHEDULER_INITIAL_CAPACITY);
+    if (!scheduler->heap) {
+        return -1;
+    }
+    scheduler->count = 0;
+    scheduler->capacity = SCHEDULER_INITIAL_CAPACITY;
+    return 0;
+}
+
+/**
+ * Освобождение планировщика
+ */
+void scheduler_free(Scheduler* scheduler) {
+    free(scheduler->heap);
+    scheduler->heap = NULL;
+    scheduler->count = 0;
+    scheduler->capacity = 0;
+}
+
+static void heap_swap(ScheduledEvent* a, ScheduledEvent* b) {
+    ScheduledEvent tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/**
+ * Добавление события, O(log n)
+ *
+ * Отмена событий не поддерживается: владелец проверяет актуальность
+ * события при извлечении (ленивое удаление).
+ */
+int scheduler_push(Scheduler* scheduler, time_t deadline, ScheduledEventType type, int alert_id) {
+    if (scheduler->count >= scheduler->capacity) {
+        int new_capacity = scheduler->capacity * 2;
+        ScheduledEvent* heap = realloc(scheduler->heap, sizeof(ScheduledEvent) * new_capacity);
+        if (!heap) {
+            return -1;
+        }
+        scheduler->heap = heap;
+        scheduler->capacity = new_capacity;
+    }
+
+    int i = scheduler->count++;
+    scheduler->heap[i].deadline = deadline;
+    scheduler->heap[i].type = type;
+    scheduler->heap[i].alert_id = alert_id;
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (scheduler->heap[parent].deadline <= scheduler->heap[i].deadline) {
+            break;
+        }
+        heap_swap(&scheduler->heap[parent], &scheduler->heap[i]);
+        i = parent;
+    }
+
+    return 0;
+}
+
+/**
+ * Извлечение ближайшего события, если его deadline наступил
+ */
+bool scheduler_pop_due(Scheduler* scheduler, time_t now, ScheduledEvent* event) {
+    if (scheduler->count == 0 || scheduler->heap[0].deadline > now) {
+        return false;
+    }
+
+    *event = scheduler->heap[0];
+    scheduler->heap[0] = scheduler->heap[--scheduler->count];
+
+    int i = 0;
+    for (;;) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int smallest = i;
+
+        if (left < scheduler->count &&
+            scheduler->heap[left].deadline < scheduler->heap[smallest].deadline) {
+            smallest = left;
+        }
+        if (right < scheduler->count &&
+            scheduler->heap[right].deadline < scheduler->heap[smallest].deadline) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+
+        heap_swap(&scheduler->heap[smallest], &scheduler->heap[i]);
+        i = smallest;
+    }
+
+    return true;
+}
+
+/**
+ * Ближайший deadline или 0, если событий нет
+ */
+time_t scheduler_next_deadline(const Scheduler* scheduler) {
+    return scheduler->count > 0 ? scheduler->heap[0].deadline : 0;
+}
@@ -0,0 +1,154 @@
+#include "../include/timer_wheel.h"
+
+/**
+ * Инициализация колеса таймеров
+ */
+void timer_wheel_init(TimerWheel* wheel, time_t now) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            TimerNode* head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+            head->expires = 0;
+        }
+    }
+    wheel->current = now;
+    wheel->pending_count = 0;
+}
+
+/**
+ * Инициализация узла (не стоит ни в одном слоте)
+ */
+void timer_node_init(TimerNode* node) {
+    node->next = NULL;
+    node->prev = NULL;
+    node->expires = 0;
+}
+
+bool timer_node_pending(const TimerNode* node) {
+    return node->next != NULL;
+}
+
+/**
+ * Размещение узла в слоте в зависимости от оставшегося времени
+ *
+ * earliest - ближайшая секунда, слот которой еще не обработан.
+ */
+static void timer_wheel_place(TimerWheel* wheel, TimerNode* node, time_t earliest) {
+    time_t expires = node->expires;
+    if (expires < earliest) {
+        expires = earliest;
+    }
+
+    time_t delta = expires - wheel->current;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= ((time_t)1 << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    // Слишком дальние таймеры ставятся на максимальную дистанцию последнего уровня
+    time_t max_delta = ((time_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    if (delta > max_delta) {
+        expires = wheel->current + max_delta;
+    }
+
+    int slot = (int)((expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    TimerNode* head = &wheel->slots[level][slot];
+
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+/**
+ * Постановка таймера (повторная постановка переносит его)
+ */
+void timer_wheel_add(TimerWheel* wheel, TimerNode* node, time_t expires) {
+    if (timer_node_pending(node)) {
+        timer_wheel_remove(wheel, node);
+    }
+
+    node->expires = expires;
+    timer_wheel_place(wheel, node, wheel->current + 1);
+    wheel->pending_count++;
+}
+
+/**
+ * Снятие таймера, O(1)
+ */
+void timer_wheel_remove(TimerWheel* wheel, TimerNode* node) {
+    if (!timer_node_pending(node)) {
+        return;
+    }
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+    wheel->pending_count--;
+}
+
+/**
+ * Перекладывание слота верхнего уровня на нижние уровни
+ */
+static void timer_wheel_cascade(TimerWheel* wheel, int level, int slot) {
+    TimerNode* head = &wheel->slots[level][slot];
+    TimerNode* node = head->next;
+
+    head->next = head;
+    head->prev = head;
+
+    while (node != head) {
+        TimerNode* next = node->next;
+        // Слот текущей секунды обрабатывается сразу после перекладывания
+        timer_wheel_place(wheel, node, wheel->current);
+        node = next;
+    }
+}
+
+/**
+ * Продвижение времени колеса до now с вызовом callback для истекших таймеров
+ *
+ * Callback получает уже снятый узел и может поставить его снова.
+ */
+int timer_wheel_advance(TimerWheel* wheel, time_t now, TimerCallback callback, void* ctx) {
+    int expired = 0;
+
+    while (wheel->current < now) {
+        // Пустое колесо можно перемотать сразу
+        if (wheel->pending_count == 0) {
+            wheel->current = now;
+            break;
+        }
+
+        time_t tick = ++wheel->current;
+        int index = (int)(tick & TIMER_WHEEL_MASK);
+
+        // При обороте нижнего уровня перекладываем соответствующие слоты верхних
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && index == 0; level++) {
+            index = (int)((tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+            timer_wheel_cascade(wheel, level, index);
+        }
+
+        TimerNode* head = &wheel->slots[0][tick & TIMER_WHEEL_MASK];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            timer_wheel_remove(wheel, node);
+
+            if (node->expires > tick) {
+                // Таймер дальше горизонта колеса: ставим заново
+                timer_wheel_add(wheel, node, node->expires);
+                continue;
+            }
+
+            expired++;
+            if (callback) {
+                callback(node, ctx);
+            }
+        }
+    }
+
+    return expired;
+}
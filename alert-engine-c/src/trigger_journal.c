@@ -0,0 +1,705 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/trigger_journal.h"
+#include "../include/alert_engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * FNV-1a хэш строки
+ */
+static uint32_t journal_hash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#ifdef _WIN32
+// Windows заглушки: журнал требует mmap
+int trigger_journal_open(const char* dir) {
+    (void)dir;
+    alert_log("WARNING", "Trigger journal is not supported on Windows");
+    return -1;
+}
+
+void trigger_journal_close(void) {
+}
+
+int trigger_journal_append(int alert_id, const char* symbol, const char* user_id,
+                           uint32_t flags, double price, time_t timestamp) {
+    (void)alert_id; (void)symbol; (void)user_id; (void)flags; (void)price; (void)timestamp;
+    return -1;
+}
+
+int trigger_journal_scan(time_t from, time_t to, const char* user_id,
+                         TriggerRecord* records, int max_records) {
+    (void)from; (void)to; (void)user_id; (void)records; (void)max_records;
+    return 0;
+}
+
+int trigger_journal_symbol(uint32_t symbol_id, char* symbol, size_t size) {
+    (void)symbol_id;
+    if (symbol && size > 0) {
+        symbol[0] = '\0';
+    }
+    return -1;
+}
+#else
+
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC 0x4E524A54u   // "TJRN"
+#define JOURNAL_VERSION 2           // 2: точный id пользователя из словаря вместо хэша
+#define JOURNAL_HEADER_SIZE 256
+#define JOURNAL_BLOOM_WORDS 16
+#define JOURNAL_USER_LEN 64         // Как Alert.user_id
+
+// Заголовок сегмента, занимает первые 256 байт файла
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t count;
+    int64_t first_ts;
+    int64_t last_ts;
+    uint32_t sealed;
+    uint32_t record_size;
+    uint64_t user_bloom[JOURNAL_BLOOM_WORDS];   // Пользователи, встречающиеся в сегменте
+    uint8_t reserved[JOURNAL_HEADER_SIZE - 40 - JOURNAL_BLOOM_WORDS * 8];
+} JournalHeader;
+
+typedef char journal_header_size_check[sizeof(JournalHeader) == JOURNAL_HEADER_SIZE ? 1 : -1];
+typedef char journal_record_size_check[sizeof(TriggerRecord) == 32 ? 1 : -1];
+
+typedef struct {
+    uint32_t seq;
+    JournalHeader* header;
+    TriggerRecord* records;
+    size_t map_size;
+    int fd;                 // Только у активного сегмента, иначе -1
+} JournalSegment;
+
+// Словарь строк: файл из записей по entry_len байт, id - номер записи.
+// Записи только добавляются, поэтому id в сегментах не устаревают.
+typedef struct {
+    char* entries;          // capacity * entry_len байт
+    int* index;             // Открытая адресация, capacity * 2 слотов
+    int count;
+    int capacity;
+    size_t entry_len;
+    int fd;
+} JournalDict;
+
+typedef struct {
+    char dir[320];
+    JournalSegment segments[TRIGGER_JOURNAL_MAX_SEGMENTS + 1];
+    int segment_count;      // Последний сегмент - активный
+    JournalDict symbols;
+    JournalDict users;
+} TriggerJournal;
+
+static TriggerJournal* g_journal = NULL;
+static pthread_rwlock_t g_journal_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void bloom_bits(uint32_t user_id, int* bit1, int* bit2) {
+    *bit1 = (int)(user_id & 1023u);
+    *bit2 = (int)((user_id * 2654435761u) >> 22);
+}
+
+static void bloom_add(JournalHeader* header, uint32_t user_id) {
+    int bit1, bit2;
+    bloom_bits(user_id, &bit1, &bit2);
+    header->user_bloom[bit1 >> 6] |= (uint64_t)1 << (bit1 & 63);
+    header->user_bloom[bit2 >> 6] |= (uint64_t)1 << (bit2 & 63);
+}
+
+static bool bloom_may_contain(const JournalHeader* header, uint32_t user_id) {
+    int bit1, bit2;
+    bloom_bits(user_id, &bit1, &bit2);
+    return (header->user_bloom[bit1 >> 6] & ((uint64_t)1 << (bit1 & 63))) &&
+           (header->user_bloom[bit2 >> 6] & ((uint64_t)1 << (bit2 & 63)));
+}
+
+static void segment_path(char* path, size_t size, uint32_t seq) {
+    snprintf(path, size, "%s/%010u.tj", g_journal->dir, seq);
+}
+
+static size_t segment_capacity_size(void) {
+    return JOURNAL_HEADER_SIZE + sizeof(TriggerRecord) * TRIGGER_JOURNAL_SEGMENT_RECORDS;
+}
+
+/**
+ * Отображение сегмента в память (активный - на запись во всю емкость)
+ */
+static int segment_map(JournalSegment* segment, uint32_t seq, bool create) {
+    char path[400];
+    segment_path(path, sizeof(path), seq);
+
+    int fd = open(path, create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    bool writable = create;
+    size_t size = (size_t)st.st_size;
+
+    if (!create) {
+        if (size < JOURNAL_HEADER_SIZE) {
+            close(fd);
+            return -1;
+        }
+        JournalHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            header.magic != JOURNAL_MAGIC || header.record_size != sizeof(TriggerRecord)) {
+            close(fd);
+            return -1;
+        }
+        if (header.version != JOURNAL_VERSION) {
+            close(fd);
+            return -2;
+        }
+        writable = !header.sealed;
+    }
+
+    if (writable && size < segment_capacity_size()) {
+        if (ftruncate(fd, (off_t)segment_capacity_size()) != 0) {
+            close(fd);
+            return -1;
+        }
+        size = segment_capacity_size();
+    }
+
+    void* base = mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    segment->seq = seq;
+    segment->header = (JournalHeader*)base;
+    segment->records = (TriggerRecord*)((char*)base + JOURNAL_HEADER_SIZE);
+    segment->map_size = size;
+
+    if (create) {
+        memset(segment->header, 0, sizeof(JournalHeader));
+        segment->header->magic = JOURNAL_MAGIC;
+        segment->header->version = JOURNAL_VERSION;
+        segment->header->seq = seq;
+        segment->header->record_size = sizeof(TriggerRecord);
+    }
+
+    if (writable) {
+        segment->fd = fd;
+    } else {
+        segment->fd = -1;
+        close(fd);
+    }
+    return 0;
+}
+
+/**
+ * Закрытие активного сегмента: файл обрезается до занятого размера
+ */
+static void segment_seal(JournalSegment* segment) {
+    if (segment->fd < 0) {
+        return;
+    }
+
+    uint32_t count = segment->header->count;
+    segment->header->sealed = 1;
+    msync(segment->header, segment->map_size, MS_ASYNC);
+    munmap(segment->header, segment->map_size);
+
+    size_t used = JOURNAL_HEADER_SIZE + sizeof(TriggerRecord) * count;
+    if (ftruncate(segment->fd, (off_t)used) != 0) {
+        used = segment->map_size;
+    }
+
+    void* base = mmap(NULL, used, PROT_READ, MAP_SHARED, segment->fd, 0);
+    close(segment->fd);
+    segment->fd = -1;
+
+    if (base == MAP_FAILED) {
+        segment->header = NULL;
+        segment->records = NULL;
+        segment->map_size = 0;
+        return;
+    }
+    segment->header = (JournalHeader*)base;
+    segment->records = (TriggerRecord*)((char*)base + JOURNAL_HEADER_SIZE);
+    segment->map_size = used;
+}
+
+static void segment_unmap(JournalSegment* segment) {
+    if (segment->header) {
+        munmap(segment->header, segment->map_size);
+    }
+    if (segment->fd >= 0) {
+        close(segment->fd);
+    }
+    segment->header = NULL;
+    segment->records = NULL;
+    segment->fd = -1;
+}
+
+/**
+ * Удаление самого старого сегмента сверх лимита хранения
+ */
+static void journal_drop_oldest(void) {
+    char path[400];
+    JournalSegment* oldest = &g_journal->segments[0];
+
+    segment_path(path, sizeof(path), oldest->seq);
+    segment_unmap(oldest);
+    unlink(path);
+
+    memmove(&g_journal->segments[0], &g_journal->segments[1],
+            sizeof(JournalSegment) * (size_t)(g_journal->segment_count - 1));
+    g_journal->segment_count--;
+}
+
+/**
+ * Новый активный сегмент (предыдущий закрывается)
+ */
+static int journal_rotate(void) {
+    uint32_t seq = 1;
+    if (g_journal->segment_count > 0) {
+        JournalSegment* active = &g_journal->segments[g_journal->segment_count - 1];
+        segment_seal(active);
+        seq = active->seq + 1;
+    }
+
+    if (g_journal->segment_count == TRIGGER_JOURNAL_MAX_SEGMENTS + 1) {
+        journal_drop_oldest();
+    }
+
+    JournalSegment* segment = &g_journal->segments[g_journal->segment_count];
+    if (segment_map(segment, seq, true) != 0) {
+        alert_log("ERROR", "Failed to create trigger journal segment");
+        return -1;
+    }
+    g_journal->segment_count++;
+
+    while (g_journal->segment_count > TRIGGER_JOURNAL_MAX_SEGMENTS) {
+        journal_drop_oldest();
+    }
+    return 0;
+}
+
+static int compare_seq(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int dict_init(JournalDict* dict, int capacity, size_t entry_len) {
+    dict->entries = calloc((size_t)capacity, entry_len);
+    dict->index = malloc(sizeof(int) * (size_t)capacity * 2);
+    if (!dict->entries || !dict->index) {
+        return -1;
+    }
+    for (int i = 0; i < capacity * 2; i++) {
+        dict->index[i] = -1;
+    }
+    dict->capacity = capacity;
+    dict->entry_len = entry_len;
+    dict->fd = -1;
+    return 0;
+}
+
+static void dict_free(JournalDict* dict) {
+    if (dict->fd >= 0) {
+        close(dict->fd);
+    }
+    free(dict->entries);
+    free(dict->index);
+}
+
+/**
+ * Удвоение словаря: записи копируются, индекс строится заново.
+ * id не меняются, поэтому сегменты остаются действительными.
+ */
+static int dict_grow(JournalDict* dict) {
+    int capacity = dict->capacity * 2;
+    char* entries = realloc(dict->entries, (size_t)capacity * dict->entry_len);
+    if (!entries) {
+        return -1;
+    }
+    dict->entries = entries;
+
+    int* index = malloc(sizeof(int) * (size_t)capacity * 2);
+    if (!index) {
+        return -1;
+    }
+    int mask = capacity * 2 - 1;
+    for (int i = 0; i < capacity * 2; i++) {
+        index[i] = -1;
+    }
+    for (int id = 0; id < dict->count; id++) {
+        int slot = (int)(journal_hash(dict->entries + (size_t)id * dict->entry_len) & (uint32_t)mask);
+        while (index[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot] = id;
+    }
+
+    free(dict->index);
+    dict->index = index;
+    dict->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Поиск строки в словаре; с create - добавление отсутствующей с дозаписью в файл
+ */
+static int dict_find(JournalDict* dict, const char* value, bool create) {
+    if (!dict->index) {
+        return -1;
+    }
+
+    int mask = dict->capacity * 2 - 1;
+    int slot = (int)(journal_hash(value) & (uint32_t)mask);
+
+    while (dict->index[slot] >= 0) {
+        int id = dict->index[slot];
+        if (strncmp(dict->entries + (size_t)id * dict->entry_len, value, dict->entry_len - 1) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!create) {
+        return -1;
+    }
+    if (dict->count >= dict->capacity) {
+        if (dict_grow(dict) != 0) {
+            return -1;
+        }
+        mask = dict->capacity * 2 - 1;
+        slot = (int)(journal_hash(value) & (uint32_t)mask);
+        while (dict->index[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    int id = dict->count;
+    char* entry = dict->entries + (size_t)id * dict->entry_len;
+    memset(entry, 0, dict->entry_len);
+    strncpy(entry, value, dict->entry_len - 1);
+
+    if (dict->fd >= 0 &&
+        pwrite(dict->fd, entry, dict->entry_len, (off_t)id * (off_t)dict->entry_len) !=
+            (ssize_t)dict->entry_len) {
+        return -1;
+    }
+
+    dict->index[slot] = id;
+    dict->count++;
+    return id;
+}
+
+static void dict_load(JournalDict* dict, const char* name) {
+    char path[400];
+    snprintf(path, sizeof(path), "%s/%s", g_journal->dir, name);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        alert_log("WARNING", "Cannot open trigger journal dictionary");
+        return;
+    }
+
+    // Загрузка без дозаписи в файл
+    char entry[JOURNAL_USER_LEN];
+    off_t offset = 0;
+    while (pread(fd, entry, dict->entry_len, offset) == (ssize_t)dict->entry_len) {
+        entry[dict->entry_len - 1] = '\0';
+        if (dict_find(dict, entry, true) < 0) {
+            break;
+        }
+        offset += (off_t)dict->entry_len;
+    }
+
+    dict->fd = fd;
+}
+
+/**
+ * Открытие журнала: загрузка словаря и отображение существующих сегментов
+ */
+int trigger_journal_open(const char* dir) {
+    if (g_journal || !dir) {
+        return -1;
+    }
+
+    mkdir(dir, 0755);
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        alert_log("ERROR", "Cannot open trigger journal directory");
+        return -1;
+    }
+
+    g_journal = calloc(1, sizeof(TriggerJournal));
+    if (!g_journal) {
+        closedir(handle);
+        return -1;
+    }
+    strncpy(g_journal->dir, dir, sizeof(g_journal->dir) - 1);
+    g_journal->symbols.fd = -1;
+    g_journal->users.fd = -1;
+    if (dict_init(&g_journal->symbols, TRIGGER_JOURNAL_INITIAL_SYMBOLS, MAX_SYMBOL_LEN) != 0 ||
+        dict_init(&g_journal->users, TRIGGER_JOURNAL_INITIAL_USERS, JOURNAL_USER_LEN) != 0) {
+        closedir(handle);
+        dict_free(&g_journal->symbols);
+        dict_free(&g_journal->users);
+        free(g_journal);
+        g_journal = NULL;
+        return -1;
+    }
+
+    // Номера сегментов по именам файлов
+    uint32_t seqs[TRIGGER_JOURNAL_MAX_SEGMENTS * 2];
+    int seq_count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        unsigned int seq;
+        char suffix[4];
+        if (sscanf(entry->d_name, "%10u.%3s", &seq, suffix) == 2 &&
+            strcmp(suffix, "tj") == 0 &&
+            seq_count < TRIGGER_JOURNAL_MAX_SEGMENTS * 2) {
+            seqs[seq_count++] = seq;
+        }
+    }
+    closedir(handle);
+    qsort(seqs, (size_t)seq_count, sizeof(uint32_t), compare_seq);
+
+    // Старейшие сегменты сверх лимита удаляются
+    int first = seq_count > TRIGGER_JOURNAL_MAX_SEGMENTS ? seq_count - TRIGGER_JOURNAL_MAX_SEGMENTS : 0;
+    for (int i = 0; i < seq_count; i++) {
+        if (i < first) {
+            char path[400];
+            segment_path(path, sizeof(path), seqs[i]);
+            unlink(path);
+            continue;
+        }
+        JournalSegment* segment = &g_journal->segments[g_journal->segment_count];
+        int rc = segment_map(segment, seqs[i], false);
+        if (rc == 0) {
+            g_journal->segment_count++;
+        } else if (rc == -2) {
+            // Записи прежнего формата нельзя надежно отнести к пользователю
+            char path[400];
+            segment_path(path, sizeof(path), seqs[i]);
+            unlink(path);
+            alert_log("WARNING", "Discarding trigger journal segment in old format");
+        } else {
+            alert_log("WARNING", "Skipping corrupted trigger journal segment");
+        }
+    }
+
+    // Дозапись возможна только в последний сегмент
+    for (int i = 0; i + 1 < g_journal->segment_count; i++) {
+        segment_seal(&g_journal->segments[i]);
+    }
+
+    dict_load(&g_journal->symbols, "symbols.dat");
+    dict_load(&g_journal->users, "users.dat");
+
+    JournalSegment* active = g_journal->segment_count > 0 ?
+        &g_journal->segments[g_journal->segment_count - 1] : NULL;
+    if ((!active || active->fd < 0) && journal_rotate() != 0) {
+        trigger_journal_close();
+        return -1;
+    }
+
+    alert_log("INFO", "Trigger journal opened");
+    return 0;
+}
+
+void trigger_journal_close(void) {
+    pthread_rwlock_wrlock(&g_journal_lock);
+
+    if (g_journal) {
+        for (int i = 0; i < g_journal->segment_count; i++) {
+            JournalSegment* segment = &g_journal->segments[i];
+            if (segment->fd >= 0 && segment->header) {
+                msync(segment->header, segment->map_size, MS_SYNC);
+            }
+            segment_unmap(segment);
+        }
+        dict_free(&g_journal->symbols);
+        dict_free(&g_journal->users);
+        free(g_journal);
+        g_journal = NULL;
+    }
+
+    pthread_rwlock_unlock(&g_journal_lock);
+}
+
+/**
+ * Добавление записи о срабатывании
+ *
+ * Время в сегменте не убывает (при переводе часов назад берется время
+ * предыдущей записи), поэтому поиск по интервалу - двоичный.
+ */
+int trigger_journal_append(int alert_id, const char* symbol, const char* user_id,
+                           uint32_t flags, double price, time_t timestamp) {
+    if (!symbol || !user_id) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&g_journal_lock);
+
+    if (!g_journal || g_journal->segment_count == 0) {
+        pthread_rwlock_unlock(&g_journal_lock);
+        return -1;
+    }
+
+    JournalSegment* active = &g_journal->segments[g_journal->segment_count - 1];
+    JournalHeader* header = active->header;
+
+    if (active->fd < 0 || header->count >= TRIGGER_JOURNAL_SEGMENT_RECORDS ||
+        (header->count > 0 && timestamp - header->first_ts >= TRIGGER_JOURNAL_ROTATE_SECONDS)) {
+        if (journal_rotate() != 0) {
+            pthread_rwlock_unlock(&g_journal_lock);
+            return -1;
+        }
+        active = &g_journal->segments[g_journal->segment_count - 1];
+        header = active->header;
+    }
+
+    int symbol_id = dict_find(&g_journal->symbols, symbol, true);
+    int user = dict_find(&g_journal->users, user_id, true);
+    if (symbol_id < 0 || user < 0) {
+        pthread_rwlock_unlock(&g_journal_lock);
+        alert_log("ERROR", symbol_id < 0 ? "Failed to add symbol to trigger journal dictionary"
+                                         : "Failed to add user to trigger journal dictionary");
+        return -1;
+    }
+
+    int64_t ts = (int64_t)timestamp;
+    if (header->count > 0 && ts < header->last_ts) {
+        ts = header->last_ts;
+    }
+
+    TriggerRecord* record = &active->records[header->count];
+    record->timestamp = ts;
+    record->price = price;
+    record->alert_id = alert_id;
+    record->symbol_id = (uint32_t)symbol_id;
+    record->user_id = (uint32_t)user;
+    record->flags = flags;
+
+    if (header->count == 0) {
+        header->first_ts = ts;
+    }
+    header->last_ts = ts;
+    bloom_add(header, record->user_id);
+    header->count++;
+
+    pthread_rwlock_unlock(&g_journal_lock);
+    return 0;
+}
+
+/**
+ * Первая запись сегмента со временем больше ts
+ */
+static uint32_t segment_upper_bound(const JournalSegment* segment, int64_t ts) {
+    uint32_t lo = 0;
+    uint32_t hi = segment->header->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (segment->records[mid].timestamp <= ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Поиск срабатываний в интервале времени, от новых к старым
+ */
+int trigger_journal_scan(time_t from, time_t to, const char* user_id,
+                         TriggerRecord* records, int max_records) {
+    if (!records || max_records <= 0) {
+        return 0;
+    }
+
+    int found = 0;
+
+    pthread_rwlock_rdlock(&g_journal_lock);
+
+    // Пользователь без записей в словаре ни разу не срабатывал
+    int user = user_id && g_journal ? dict_find(&g_journal->users, user_id, false) : -1;
+    if (user_id && user < 0) {
+        pthread_rwlock_unlock(&g_journal_lock);
+        return 0;
+    }
+
+    for (int s = g_journal ? g_journal->segment_count - 1 : -1; s >= 0 && found < max_records; s--) {
+        const JournalSegment* segment = &g_journal->segments[s];
+        const JournalHeader* header = segment->header;
+
+        if (!header || header->count == 0 ||
+            header->first_ts > (int64_t)to || header->last_ts < (int64_t)from) {
+            continue;
+        }
+        if (user_id && !bloom_may_contain(header, (uint32_t)user)) {
+            continue;
+        }
+
+        uint32_t i = segment_upper_bound(segment, (int64_t)to);
+        while (i > 0 && found < max_records) {
+            const TriggerRecord* record = &segment->records[--i];
+            if (record->timestamp < (int64_t)from) {
+                break;
+            }
+            if (user_id && record->user_id != (uint32_t)user) {
+                continue;
+            }
+            records[found++] = *record;
+        }
+    }
+
+    pthread_rwlock_unlock(&g_journal_lock);
+    return found;
+}
+
+/**
+ * Символ по id из записи журнала, копируется в буфер вызывающего
+ */
+int trigger_journal_symbol(uint32_t symbol_id, char* symbol, size_t size) {
+    if (!symbol || size == 0) {
+        return -1;
+    }
+
+    int result = -1;
+    symbol[0] = '\0';
+
+    pthread_rwlock_rdlock(&g_journal_lock);
+    if (g_journal && symbol_id < (uint32_t)g_journal->symbols.count) {
+        snprintf(symbol, size, "%s",
+                 g_journal->symbols.entries + (size_t)symbol_id * g_journal->symbols.entry_len);
+        result = 0;
+    }
+    pthread_rwlock_unlock(&g_journal_lock);
+
+    return result;
+}
+
+#endif
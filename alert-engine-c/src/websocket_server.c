@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "../include/websocket_server.h"
 #include "../include/alert_engine.h"
+#include "../include/msgpack_writer.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -68,300 +71,2030 @@ static WSManager* g_ws_manager = NULL;
 static bool g_ws_initialized = false;
 
 /**
- * Инициализация WebSocket сервера
+ * Кадр с копией данных и одной ссылкой у создателя
  */
-int ws_server_init(int port) {
-    if (g_ws_initialized) {
-        return 0;
-    }
-
-    g_ws_manager = malloc(sizeof(WSManager));
-    if (!g_ws_manager) {
-        alert_log("ERROR", "Failed to allocate WebSocket manager");
-        return -1;
+WSFrame* ws_frame_create(const void* payload, size_t length, WSEncoding encoding) {
+    WSFrame* frame = malloc(sizeof(WSFrame) + LWS_PRE + length);
+    if (!frame) {
+        return NULL;
     }
+    frame->refcount = 1;
+    frame->encoding = encoding;
+    frame->topic = -1;
+    frame->length = length;
+    memcpy(frame->buffer + LWS_PRE, payload, length);
+    return frame;
+}
 
-    g_ws_manager->connections = NULL;
-    g_ws_manager->connection_count = 0;
-    g_ws_manager->context = NULL;
-    g_ws_manager->is_running = false;
-
-    // Здесь должна быть инициализация libwebsockets
-    // Пока используем заглушку
-    alert_log("INFO", "WebSocket server initialized (stub mode)");
-    g_ws_initialized = true;
-    
-    return 0;
+static void frame_retain(WSFrame* frame) {
+    __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
 }
 
 /**
- * Завершение работы WebSocket сервера
+ * Ссылки отпускают и поток обслуживания, и отправители
  */
-void ws_server_cleanup(void) {
-    if (!g_ws_initialized || !g_ws_manager) {
-        return;
+void ws_frame_release(WSFrame* frame) {
+    if (frame && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(frame);
     }
+}
 
-    // Освобождение соединений
-    WSConnection* conn = g_ws_manager->connections;
-    while (conn) {
-        WSConnection* next = conn->next;
-        free(conn);
-        conn = next;
+/**
+ * Освобождение соединения вместе с неотправленными кадрами
+ */
+static void connection_free(WSConnection* conn) {
+    while (conn->send_count > 0) {
+        ws_frame_release(conn->send_queue[conn->send_head]);
+        conn->send_head = (conn->send_head + 1) % WS_SEND_QUEUE_SIZE;
+        conn->send_count--;
     }
+    free(conn);
+}
 
-    free(g_ws_manager);
-    g_ws_manager = NULL;
-    g_ws_initialized = false;
-    
-    alert_log("INFO", "WebSocket server cleanup complete");
+static void manager_free(WSManager* manager) {
+    if (manager->user_index) {
+        for (int i = 0; i < WS_USER_INDEX_SIZE; i++) {
+            free(manager->user_index[i].connections);
+        }
+    }
+    if (manager->topic_index) {
+        for (int i = 0; i < WS_TOPIC_INDEX_SIZE; i++) {
+            free(manager->topic_index[i].subscribers);
+        }
+    }
+    free(manager->user_index);
+    free(manager->topic_index);
+    free(manager->connections);
+    free(manager->pending_writes);
+    free(manager->batch_buffer);
+    pthread_mutex_destroy(&manager->mutex);
+    free(manager);
 }
 
-/**
- * Создание сообщения о статусе
- */
-WSMessage* ws_create_status_message(const char* status) {
-    if (!status) {
+static WSManager* manager_create(void) {
+    WSManager* manager = calloc(1, sizeof(WSManager));
+    if (!manager) {
         return NULL;
     }
+    pthread_mutex_init(&manager->mutex, NULL);
 
-    WSMessage* msg = malloc(sizeof(WSMessage));
-    if (!msg) {
+    manager->connections = malloc(sizeof(WSConnection*) * MAX_WS_CONNECTIONS);
+    manager->pending_writes = malloc(sizeof(WSConnection*) * MAX_WS_CONNECTIONS);
+    manager->user_index = calloc(WS_USER_INDEX_SIZE, sizeof(WSUserEntry));
+    manager->topic_index = calloc(WS_TOPIC_INDEX_SIZE, sizeof(WSTopicEntry));
+    manager->batch_buffer = malloc(LWS_PRE + WS_COALESCE_MAX_SIZE);
+    if (!manager->connections || !manager->pending_writes || !manager->user_index ||
+        !manager->topic_index || !manager->batch_buffer) {
+        manager_free(manager);
         return NULL;
     }
+    return manager;
+}
 
-    msg->type = WS_MSG_CONNECTION_STATUS;
-    msg->user_id = NULL;
-    msg->data = cJSON_CreateObject();
-    msg->timestamp = time(NULL);
-
-    if (msg->data) {
-        cJSON_AddStringToObject(msg->data, "status", status);
-        cJSON_AddNumberToObject(msg->data, "timestamp", msg->timestamp);
+/**
+ * FNV-1a хэш строки
+ */
+static unsigned int ws_hash(const char* str) {
+    unsigned int hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
     }
-
-    return msg;
+    return hash;
 }
 
 /**
- * Создание сообщения о триггере алерта
+ * Поиск слота пользователя (занимает свободный при create = true)
  */
-WSMessage* ws_create_alert_triggered_message(Alert* alert, CryptoPrice* price) {
-    if (!alert || !price) {
-        return NULL;
-    }
+static WSUserEntry* user_entry_find(const char* user_id, bool create) {
+    int mask = WS_USER_INDEX_SIZE - 1;
+    int slot = (int)(ws_hash(user_id) & (unsigned int)mask);
 
-    WSMessage* msg = malloc(sizeof(WSMessage));
-    if (!msg) {
-        return NULL;
-    }
+    for (int probe = 0; probe < WS_USER_INDEX_SIZE; probe++) {
+        WSUserEntry* entry = &g_ws_manager->user_index[slot];
 
-    msg->type = WS_MSG_ALERT_TRIGGERED;
-    msg->user_id = strdup(alert->user_id);
-    msg->data = cJSON_CreateObject();
-    msg->timestamp = time(NULL);
+        if (entry->user_id[0] == '\0') {
+            if (!create) {
+                return NULL;
+            }
+            strncpy(entry->user_id, user_id, sizeof(entry->user_id) - 1);
+            return entry;
+        }
 
-    if (msg->data) {
-        cJSON* alert_obj = cJSON_CreateObject();
-        cJSON_AddNumberToObject(alert_obj, "id", alert->id);
-        cJSON_AddStringToObject(alert_obj, "symbol", alert->symbol);
-        cJSON_AddNumberToObject(alert_obj, "type", alert->type);
-        cJSON_AddNumberToObject(alert_obj, "target_value", alert->target_value);
-        cJSON_AddStringToObject(alert_obj, "message", alert->message);
-        
-        cJSON* price_obj = cJSON_CreateObject();
-        cJSON_AddStringToObject(price_obj, "symbol", price->symbol);
-        cJSON_AddNumberToObject(price_obj, "current_price", price->current_price);
-        cJSON_AddNumberToObject(price_obj, "price_change_24h", price->price_change_24h);
-        cJSON_AddNumberToObject(price_obj, "price_change_percent_24h", price->price_change_percent_24h);
-        
-        cJSON_AddItemToObject(msg->data, "alert", alert_obj);
-        cJSON_AddItemToObject(msg->data, "price", price_obj);
-        cJSON_AddNumberToObject(msg->data, "timestamp", msg->timestamp);
+        if (strcmp(entry->user_id, user_id) == 0) {
+            return entry;
+        }
+
+        slot = (slot + 1) & mask;
     }
 
-    return msg;
+    return NULL;
 }
 
 /**
- * Создание сообщения об обновлении рынка
+ * Освобождение слота пользователя. Последующие записи цепочки сдвигаются
+ * назад, чтобы поиск не останавливался на образовавшейся дыре.
  */
-WSMessage* ws_create_market_update_message(CryptoPrice* prices, int count) {
-    if (!prices || count <= 0) {
-        return NULL;
+static void user_entry_release(WSUserEntry* entry) {
+    int mask = WS_USER_INDEX_SIZE - 1;
+    int hole = (int)(entry - g_ws_manager->user_index);
+
+    free(entry->connections);
+    memset(entry, 0, sizeof(WSUserEntry));
+
+    int slot = hole;
+    for (;;) {
+        slot = (slot + 1) & mask;
+        WSUserEntry* next = &g_ws_manager->user_index[slot];
+        if (next->user_id[0] == '\0') {
+            break;
+        }
+
+        // Запись остается, если ее исходный слот лежит между дырой и ней
+        int home = (int)(ws_hash(next->user_id) & (unsigned int)mask);
+        bool reachable = hole <= slot ? (hole < home && home <= slot)
+                                      : (hole < home || home <= slot);
+        if (reachable) {
+            continue;
+        }
+
+        g_ws_manager->user_index[hole] = *next;
+        memset(next, 0, sizeof(WSUserEntry));
+        hole = slot;
     }
+}
 
-    WSMessage* msg = malloc(sizeof(WSMessage));
-    if (!msg) {
-        return NULL;
+static int user_entry_add(WSUserEntry* entry, WSConnection* conn) {
+    if (entry->count == entry->capacity) {
+        int capacity = entry->capacity ? entry->capacity * 2 : 4;
+        WSConnection** grown = realloc(entry->connections, sizeof(WSConnection*) * (size_t)capacity);
+        if (!grown) {
+            return -1;
+        }
+        entry->connections = grown;
+        entry->capacity = capacity;
     }
 
-    msg->type = WS_MSG_MARKET_UPDATE;
-    msg->user_id = NULL;
-    msg->data = cJSON_CreateObject();
-    msg->timestamp = time(NULL);
+    conn->user_index = entry->count;
+    entry->connections[entry->count++] = conn;
+    return 0;
+}
 
-    if (msg->data) {
-        cJSON* prices_array = cJSON_CreateArray();
-        
-        for (int i = 0; i < count && i < 10; i++) { // Ограничиваем количество для производительности
-            cJSON* price_obj = cJSON_CreateObject();
-            cJSON_AddStringToObject(price_obj, "symbol", prices[i].symbol);
-            cJSON_AddNumberToObject(price_obj, "current_price", prices[i].current_price);
-            cJSON_AddNumberToObject(price_obj, "price_change_24h", prices[i].price_change_24h);
-            cJSON_AddNumberToObject(price_obj, "price_change_percent_24h", prices[i].price_change_percent_24h);
-            cJSON_AddNumberToObject(price_obj, "volume_24h", prices[i].volume_24h);
-            cJSON_AddBoolToObject(price_obj, "is_valid", prices[i].is_valid);
-            
-            cJSON_AddItemToArray(prices_array, price_obj);
-        }
-        
-        cJSON_AddItemToObject(msg->data, "prices", prices_array);
-        cJSON_AddNumberToObject(msg->data, "count", count);
-        cJSON_AddNumberToObject(msg->data, "timestamp", msg->timestamp);
+static void user_entry_remove(WSConnection* conn) {
+    WSUserEntry* entry = user_entry_find(conn->user_id, false);
+    if (!entry) {
+        return;
     }
 
-    return msg;
+    WSConnection* last = entry->connections[--entry->count];
+    entry->connections[conn->user_index] = last;
+    last->user_index = conn->user_index;
+
+    if (entry->count == 0) {
+        user_entry_release(entry);
+    }
 }
 
 /**
- * Отправка сообщения пользователю
+ * Поиск темы символа (занимает свободный слот при create = true)
  */
-int ws_send_to_user(const char* user_id, WSMessage* message) {
-    if (!user_id || !message) {
-        return -1;
-    }
+static WSTopicEntry* topic_find(const char* symbol, bool create) {
+    int mask = WS_TOPIC_INDEX_SIZE - 1;
+    int slot = (int)(ws_hash(symbol) & (unsigned int)mask);
 
-    // В реальной реализации здесь был бы поиск соединения пользователя
-    // и отправка через WebSocket
-    
-    char* json_string = NULL;
-    if (message->data) {
-        json_string = cJSON_Print(message->data);
+    for (int probe = 0; probe < WS_TOPIC_INDEX_SIZE; probe++) {
+        WSTopicEntry* topic = &g_ws_manager->topic_index[slot];
+
+        if (topic->symbol[0] == '\0') {
+            if (!create) {
+                return NULL;
+            }
+            strncpy(topic->symbol, symbol, sizeof(topic->symbol) - 1);
+            return topic;
+        }
+
+        if (strcmp(topic->symbol, symbol) == 0) {
+            return topic;
+        }
+
+        slot = (slot + 1) & mask;
     }
-    
-    char log_msg[512];
-    snprintf(log_msg, sizeof(log_msg), 
-             "WebSocket message to user %s: %s", 
-             user_id, 
-             json_string ? json_string : "null");
-    alert_log("DEBUG", log_msg);
-    
-    if (json_string) {
-        free(json_string);
+
+    return NULL;
+}
+
+static int connection_find_subscription(WSConnection* conn, int topic) {
+    for (int i = 0; i < conn->subscription_count; i++) {
+        if (conn->subscriptions[i].topic == topic) {
+            return i;
+        }
     }
-    
-    return 0;
+    return -1;
 }
 
 /**
- * Широковещательная отправка сообщения
+ * Удаление i-й подписки соединения; на освободившееся место в списке
+ * подписчиков темы переносится последний подписчик
  */
-int ws_broadcast_message(WSMessage* message) {
-    if (!message) {
-        return -1;
+static void connection_drop_subscription(WSConnection* conn, int i) {
+    WSSubscription* sub = &conn->subscriptions[i];
+    WSTopicEntry* topic = &g_ws_manager->topic_index[sub->topic];
+
+    WSSubscriber last_subscriber = topic->subscribers[--topic->count];
+    WSConnection* last = last_subscriber.conn;
+    topic->subscribers[sub->position] = last_subscriber;
+    if (last != conn) {
+        int moved = connection_find_subscription(last, sub->topic);
+        last->subscriptions[moved].position = sub->position;
     }
 
-    // В реальной реализации здесь была бы отправка всем подключенным клиентам
-    
-    char* json_string = NULL;
-    if (message->data) {
-        json_string = cJSON_Print(message->data);
+    conn->subscriptions[i] = conn->subscriptions[--conn->subscription_count];
+}
+
+#ifdef _WIN32
+int ws_server_init(int port) {
+    if (g_ws_initialized) {
+        return 0;
     }
-    
-    char log_msg[512];
-    snprintf(log_msg, sizeof(log_msg), 
-             "WebSocket broadcast: %s", 
-             json_string ? json_string : "null");
-    alert_log("DEBUG", log_msg);
-    
-    if (json_string) {
-        free(json_string);
+
+    g_ws_manager = manager_create();
+    if (!g_ws_manager) {
+        alert_log("ERROR", "Failed to allocate WebSocket manager");
+        return -1;
     }
-    
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "WebSocket server initialized on port %d (Windows stub)", port);
+    alert_log("INFO", log_msg);
+    g_ws_initialized = true;
+
+    return 0;
+}
+
+int ws_server_start(void) {
+    return 0;
+}
+
+void ws_server_stop(void) {
+}
+
+void ws_server_run(void) {
+}
+
+int ws_callback_alerts(struct lws *wsi, enum lws_callback_reasons reason,
+                      void *user, void *in, size_t len) {
+    (void)wsi; (void)reason; (void)user; (void)in; (void)len;
     return 0;
 }
 
+static void ws_wakeup(void) {
+}
+#else
+
+static struct lws_protocols g_ws_protocols[] = {
+    // Первый протокол получает и клиентов без Sec-WebSocket-Protocol;
+    // id протокола - кодировка исходящих сообщений
+    {
+        .name = WS_PROTOCOL_ALERTS,
+        .callback = ws_callback_alerts,
+        .per_session_data_size = sizeof(WSConnection*),
+        .rx_buffer_size = WS_BUFFER_SIZE,
+        .id = WS_ENCODING_JSON
+    },
+    {
+        .name = WS_PROTOCOL_ALERTS_MSGPACK,
+        .callback = ws_callback_alerts,
+        .per_session_data_size = sizeof(WSConnection*),
+        .rx_buffer_size = WS_BUFFER_SIZE,
+        .id = WS_ENCODING_MSGPACK
+    },
+    { 0 }
+};
+
+#ifndef LWS_WITHOUT_EXTENSIONS
+// permessage-deflate, если клиент его предлагает; без контекста между
+// сообщениями со стороны клиента, чтобы не держать его окно на сервере
+static const struct lws_extension g_ws_extensions[] = {
+    {
+        "permessage-deflate",
+        lws_extension_callback_pm_deflate,
+        "permessage-deflate; client_no_context_takeover; client_max_window_bits"
+    },
+    { NULL, NULL, NULL }
+};
+#endif
+
 /**
- * Освобождение памяти сообщения
+ * Пробуждение потока обслуживания; lws_cancel_service можно вызывать из любого
+ * потока, остальные функции libwebsockets - только из потока обслуживания
  */
-void ws_free_message(WSMessage* message) {
-    if (!message) {
-        return;
-    }
-
-    if (message->user_id) {
-        free(message->user_id);
-    }
-    
-    if (message->data) {
-        cJSON_Delete(message->data);
+static void ws_wakeup(void) {
+    if (g_ws_manager && g_ws_manager->context) {
+        lws_cancel_service(g_ws_manager->context);
     }
-    
-    free(message);
 }
 
 /**
- * Добавление нового соединения
+ * Инициализация WebSocket сервера
  */
-int ws_add_connection(struct lws* wsi, const char* user_id) {
-    if (!wsi || !user_id || !g_ws_manager) {
-        return -1;
+int ws_server_init(int port) {
+    if (g_ws_initialized) {
+        return 0;
     }
 
-    WSConnection* conn = malloc(sizeof(WSConnection));
-    if (!conn) {
+    g_ws_manager = manager_create();
+    if (!g_ws_manager) {
+        alert_log("ERROR", "Failed to allocate WebSocket manager");
         return -1;
     }
 
-    conn->wsi = wsi;
-    strncpy(conn->user_id, user_id, sizeof(conn->user_id) - 1);
-    conn->user_id[sizeof(conn->user_id) - 1] = '\0';
-    conn->is_authenticated = true;
-    conn->connected_at = time(NULL);
-    conn->message_count = 0;
-    conn->next = g_ws_manager->connections;
+    lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = port;
+    info.protocols = g_ws_protocols;
+#ifndef LWS_WITHOUT_EXTENSIONS
+    info.extensions = g_ws_extensions;
+#endif
+    info.gid = -1;
+    info.uid = -1;
 
-    g_ws_manager->connections = conn;
-    g_ws_manager->connection_count++;
+    g_ws_manager->context = lws_create_context(&info);
+    if (!g_ws_manager->context) {
+        alert_log("ERROR", "Failed to create WebSocket context");
+        manager_free(g_ws_manager);
+        g_ws_manager = NULL;
+        return -1;
+    }
 
     char log_msg[128];
-    snprintf(log_msg, sizeof(log_msg), "WebSocket connection added for user: %s", user_id);
+    snprintf(log_msg, sizeof(log_msg), "WebSocket server initialized on port %d", port);
     alert_log("INFO", log_msg);
+    g_ws_initialized = true;
 
     return 0;
 }
 
+static void* ws_service_thread(void* arg) {
+    (void)arg;
+    ws_server_run();
+    return NULL;
+}
+
 /**
- * Удаление соединения
+ * Запуск потока обслуживания WebSocket
  */
-int ws_remove_connection(struct lws* wsi) {
-    if (!wsi || !g_ws_manager) {
+int ws_server_start(void) {
+    if (!g_ws_initialized || g_ws_manager->is_running) {
+        return g_ws_initialized ? 0 : -1;
+    }
+
+    __atomic_store_n(&g_ws_manager->is_running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&g_ws_manager->service_thread, NULL, ws_service_thread, NULL) != 0) {
+        g_ws_manager->is_running = false;
+        alert_log("ERROR", "Failed to create WebSocket service thread");
         return -1;
     }
 
-    WSConnection* prev = NULL;
-    WSConnection* current = g_ws_manager->connections;
+    alert_log("INFO", "WebSocket service thread started");
+    return 0;
+}
 
-    while (current) {
-        if (current->wsi == wsi) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                g_ws_manager->connections = current->next;
-            }
+/**
+ * Остановка потока обслуживания
+ */
+void ws_server_stop(void) {
+    if (!g_ws_initialized || !g_ws_manager->is_running) {
+        return;
+    }
+
+    __atomic_store_n(&g_ws_manager->is_running, false, __ATOMIC_RELEASE);
+    ws_wakeup();
+    pthread_join(g_ws_manager->service_thread, NULL);
+
+    alert_log("INFO", "WebSocket service thread stopped");
+}
+
+static void connection_request_close(WSConnection* conn, const char* reason);
 
-            char log_msg[128];
-            snprintf(log_msg, sizeof(log_msg), "WebSocket connection removed for user: %s", current->user_id);
-            alert_log("INFO", log_msg);
+/**
+ * Закрытие клиентов, которые дольше WS_SLOW_CONSUMER_TIMEOUT не могут
+ * разобрать очередь; проверяется не чаще раза в секунду
+ */
+static void close_slow_consumers(time_t now) {
+    bool closing = false;
 
-            free(current);
-            g_ws_manager->connection_count--;
-            return 0;
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    for (int i = 0; i < g_ws_manager->connection_count; i++) {
+        WSConnection* conn = g_ws_manager->connections[i];
+        if (conn->congested && !conn->close_requested &&
+            now - conn->congested_since >= WS_SLOW_CONSUMER_TIMEOUT) {
+            connection_request_close(conn, "did not drain its send queue in time");
+            closing = true;
         }
-        prev = current;
-        current = current->next;
     }
+    pthread_mutex_unlock(&g_ws_manager->mutex);
 
-    return -1;
-}
\ No newline at end of file
+    if (closing) {
+        ws_wakeup();
+    }
+}
+
+/**
+ * Цикл обслуживания: все события сокетов и запись идут в этом потоке
+ */
+void ws_server_run(void) {
+    time_t last_sweep = time(NULL);
+
+    while (__atomic_load_n(&g_ws_manager->is_running, __ATOMIC_ACQUIRE)) {
+        if (lws_service(g_ws_manager->context, 0) < 0) {
+            alert_log("ERROR", "WebSocket service loop failed");
+            break;
+        }
+
+        time_t now = time(NULL);
+        if (now != last_sweep) {
+            last_sweep = now;
+            close_slow_consumers(now);
+        }
+    }
+}
+
+/**
+ * Запрос записи для соединений, получивших кадры из других потоков.
+ * Соединения, помеченные к закрытию, закрываются без ожидания записи:
+ * застрявший клиент может никогда не стать доступным для нее.
+ */
+static void request_pending_writes(void) {
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    for (int i = 0; i < g_ws_manager->pending_count; i++) {
+        WSConnection* conn = g_ws_manager->pending_writes[i];
+        conn->write_requested = false;
+        if (conn->close_requested) {
+            lws_set_timeout(conn->wsi, PENDING_TIMEOUT_CLOSE_SEND, LWS_TO_KILL_ASYNC);
+        } else {
+            lws_callback_on_writable(conn->wsi);
+        }
+    }
+    g_ws_manager->pending_count = 0;
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+}
+
+/**
+ * Сборка нескольких сообщений в batch_buffer: JSON-массив конвертов или
+ * массив MessagePack. Возвращает длину без LWS_PRE.
+ */
+static size_t coalesce_frames(WSFrame** frames, int count, WSEncoding encoding) {
+    unsigned char* out = g_ws_manager->batch_buffer + LWS_PRE;
+    size_t length = 0;
+
+    if (encoding == WS_ENCODING_MSGPACK) {
+        if (count < 16) {
+            out[length++] = (unsigned char)(0x90 | count);
+        } else {
+            out[length++] = 0xdc;
+            out[length++] = (unsigned char)(count >> 8);
+            out[length++] = (unsigned char)count;
+        }
+    } else {
+        out[length++] = '[';
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (encoding == WS_ENCODING_JSON && i > 0) {
+            out[length++] = ',';
+        }
+        memcpy(out + length, frames[i]->buffer + LWS_PRE, frames[i]->length);
+        length += frames[i]->length;
+    }
+
+    if (encoding == WS_ENCODING_JSON) {
+        out[length++] = ']';
+    }
+    return length;
+}
+
+/**
+ * Отправка очереди соединения. Все накопленные сообщения, которые помещаются
+ * в WS_COALESCE_MAX_SIZE, уходят одним кадром (одно сообщение - без обертки).
+ * Остаток ждет следующего события записи, чтобы не держать цикл на медленном клиенте.
+ */
+static bool enqueue_snapshot(WSTopicEntry* topic, WSSubscriber* subscriber);
+
+/**
+ * Выход из перегрузки после спада очереди ниже нижней отметки: отложенные
+ * подписки (seq == 0) получают снимок текущей версии, то есть только
+ * последнее состояние каждого символа
+ */
+static void connection_recover(WSConnection* conn) {
+    conn->congested = false;
+    for (int i = 0; i < conn->subscription_count; i++) {
+        WSTopicEntry* topic = &g_ws_manager->topic_index[conn->subscriptions[i].topic];
+        WSSubscriber* subscriber = &topic->subscribers[conn->subscriptions[i].position];
+        if (subscriber->seq == 0) {
+            enqueue_snapshot(topic, subscriber);
+        }
+    }
+}
+
+static int write_pending_frames(struct lws* wsi) {
+    WSFrame* frames[WS_SEND_QUEUE_SIZE];
+    int count = 0;
+    size_t total = 3;               // Заголовок массива MessagePack или скобки JSON
+    WSEncoding encoding = WS_ENCODING_JSON;
+    bool more = false;
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    WSConnection* conn = ws_find_connection(wsi);
+    if (conn) {
+        encoding = conn->encoding;
+        while (conn->send_count > 0) {
+            WSFrame* frame = conn->send_queue[conn->send_head];
+            if (count > 0 && total + frame->length + 1 > WS_COALESCE_MAX_SIZE) {
+                break;
+            }
+            total += frame->length + 1;
+            frames[count++] = frame;
+            conn->send_queue[conn->send_head] = NULL;
+            conn->send_head = (conn->send_head + 1) % WS_SEND_QUEUE_SIZE;
+            conn->send_count--;
+            conn->queued_bytes -= frame->length;
+        }
+        if (conn->congested && !conn->close_requested && conn->queued_bytes <= WS_SEND_LOW_WATERMARK) {
+            connection_recover(conn);
+        }
+        more = conn->send_count > 0;
+    }
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    // Снимки, поставленные при выходе из перегрузки, требуют новой записи,
+    // даже если в этот раз отправлять было нечего
+    if (count == 0) {
+        if (more) {
+            lws_callback_on_writable(wsi);
+        }
+        return 0;
+    }
+
+    enum lws_write_protocol protocol = encoding == WS_ENCODING_MSGPACK ? LWS_WRITE_BINARY : LWS_WRITE_TEXT;
+    int written;
+    if (count == 1) {
+        // lws_write пишет заголовок в область LWS_PRE общего кадра; это безопасно,
+        // так как все записи идут последовательно в потоке обслуживания
+        written = lws_write(wsi, frames[0]->buffer + LWS_PRE, frames[0]->length, protocol);
+    } else {
+        size_t length = coalesce_frames(frames, count, encoding);
+        written = lws_write(wsi, g_ws_manager->batch_buffer + LWS_PRE, length, protocol);
+    }
+
+    for (int i = 0; i < count; i++) {
+        ws_frame_release(frames[i]);
+    }
+    if (written < 0) {
+        return -1;
+    }
+
+    if (more) {
+        lws_callback_on_writable(wsi);
+    }
+    return 0;
+}
+
+static void send_error(struct lws* wsi, const char* error_msg) {
+    WSMessage* msg = ws_create_error_message(error_msg);
+    ws_send_to_connection(ws_find_connection(wsi), msg);
+    ws_free_message(msg);
+}
+
+/**
+ * Запрос клиента: {"type": "subscribe" | "unsubscribe" | "resync", "symbols": [...]}
+ */
+static void handle_client_message(struct lws* wsi, const char* data, size_t len) {
+    cJSON* root = cJSON_ParseWithLength(data, len);
+    if (!root) {
+        send_error(wsi, "Invalid JSON");
+        return;
+    }
+
+    const char* type = cJSON_GetStringValue(cJSON_GetObjectItem(root, "type"));
+    cJSON* symbols = cJSON_GetObjectItem(root, "symbols");
+
+    int (*action)(struct lws*, const char*) = NULL;
+    if (type && strcmp(type, "subscribe") == 0) {
+        action = ws_subscribe;
+    } else if (type && strcmp(type, "unsubscribe") == 0) {
+        action = ws_unsubscribe;
+    } else if (type && strcmp(type, "resync") == 0) {
+        action = ws_resync;
+    }
+
+    if (!action || !cJSON_IsArray(symbols)) {
+        send_error(wsi, "Unknown request");
+        cJSON_Delete(root);
+        return;
+    }
+
+    cJSON* symbol;
+    cJSON_ArrayForEach(symbol, symbols) {
+        const char* name = cJSON_GetStringValue(symbol);
+        if (!name || !name[0] || strlen(name) >= MAX_SYMBOL_LEN) {
+            continue;
+        }
+
+        int result = action(wsi, name);
+        if (result == -2) {
+            send_error(wsi, "Subscription limit reached");
+            break;
+        }
+        if (result == -3) {
+            send_error(wsi, "Unknown symbol");
+        }
+    }
+
+    cJSON_Delete(root);
+}
+
+/**
+ * Callback протокола alerts-protocol
+ *
+ * Пользователь передается в строке запроса: ws://host:8081/?user_id=...
+ * Соединения без user_id получают только широковещательные сообщения.
+ * Цены приходят только по символам, на которые клиент подписался.
+ */
+int ws_callback_alerts(struct lws *wsi, enum lws_callback_reasons reason,
+                      void *user, void *in, size_t len) {
+    (void)user;
+
+    switch (reason) {
+        case LWS_CALLBACK_ESTABLISHED: {
+            char query[96];
+            const char* user_id = lws_get_urlarg_by_name(wsi, "user_id=", query, sizeof(query));
+            const struct lws_protocols* protocol = lws_get_protocol(wsi);
+            WSEncoding encoding = protocol ? (WSEncoding)protocol->id : WS_ENCODING_JSON;
+            if (ws_add_connection(wsi, user_id ? user_id : "", encoding) != 0) {
+                return -1;
+            }
+            break;
+        }
+
+        case LWS_CALLBACK_RECEIVE:
+            // Запросы короткие; фрагментированные сообщения не принимаются
+            if (!lws_is_first_fragment(wsi) || !lws_is_final_fragment(wsi)) {
+                send_error(wsi, "Message too large");
+                break;
+            }
+            handle_client_message(wsi, in, len);
+            break;
+
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            return write_pending_frames(wsi);
+
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+            request_pending_writes();
+            break;
+
+        case LWS_CALLBACK_CLOSED:
+            ws_remove_connection(wsi);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+#endif
+
+/**
+ * Завершение работы WebSocket сервера
+ */
+void ws_server_cleanup(void) {
+    if (!g_ws_initialized || !g_ws_manager) {
+        return;
+    }
+
+    ws_server_stop();
+
+#ifndef _WIN32
+    // Закрытие сокетов; LWS_CALLBACK_CLOSED удаляет соединения из списка
+    if (g_ws_manager->context) {
+        lws_context_destroy(g_ws_manager->context);
+        g_ws_manager->context = NULL;
+    }
+#endif
+
+    // Освобождение соединений
+    for (int i = 0; i < g_ws_manager->connection_count; i++) {
+        connection_free(g_ws_manager->connections[i]);
+    }
+
+    manager_free(g_ws_manager);
+    g_ws_manager = NULL;
+    g_ws_initialized = false;
+    
+    alert_log("INFO", "WebSocket server cleanup complete");
+}
+
+/**
+ * Создание сообщения о статусе
+ */
+WSMessage* ws_create_status_message(const char* status) {
+    if (!status) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_CONNECTION_STATUS;
+    msg->user_id = NULL;
+    msg->data = cJSON_CreateObject();
+    msg->timestamp = time(NULL);
+
+    if (msg->data) {
+        cJSON_AddStringToObject(msg->data, "status", status);
+        cJSON_AddNumberToObject(msg->data, "timestamp", msg->timestamp);
+    }
+
+    return msg;
+}
+
+/**
+ * Создание сообщения об ошибке запроса клиента
+ */
+WSMessage* ws_create_error_message(const char* error_msg) {
+    if (!error_msg) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_ERROR;
+    msg->user_id = NULL;
+    msg->data = cJSON_CreateObject();
+    msg->timestamp = time(NULL);
+
+    if (msg->data) {
+        cJSON_AddStringToObject(msg->data, "error", error_msg);
+    }
+
+    return msg;
+}
+
+/**
+ * Срабатывание: {"alert": {...}, "price": {...}, "timestamp": ...};
+ * timestamp - время срабатывания, а не доставки
+ */
+static cJSON* alert_trigger_to_json(const TriggerNotification* notification) {
+    cJSON* trigger = cJSON_CreateObject();
+    if (!trigger) {
+        return NULL;
+    }
+
+    cJSON* alert_obj = cJSON_CreateObject();
+    cJSON_AddNumberToObject(alert_obj, "id", notification->alert_id);
+    cJSON_AddStringToObject(alert_obj, "symbol", notification->symbol);
+    cJSON_AddNumberToObject(alert_obj, "type", notification->type);
+    cJSON_AddNumberToObject(alert_obj, "target_value", notification->target_value);
+    cJSON_AddStringToObject(alert_obj, "message", notification->message);
+
+    const CryptoPrice* price = &notification->price;
+    cJSON* price_obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(price_obj, "symbol", price->symbol);
+    cJSON_AddNumberToObject(price_obj, "current_price", price->current_price);
+    cJSON_AddNumberToObject(price_obj, "price_change_24h", price->price_change_24h);
+    cJSON_AddNumberToObject(price_obj, "price_change_percent_24h", price->price_change_percent_24h);
+
+    cJSON_AddItemToObject(trigger, "alert", alert_obj);
+    cJSON_AddItemToObject(trigger, "price", price_obj);
+    cJSON_AddNumberToObject(trigger, "timestamp", (double)notification->triggered_at);
+    return trigger;
+}
+
+/**
+ * Создание сообщения о триггере алерта
+ */
+WSMessage* ws_create_alert_triggered_message(const TriggerNotification* notification) {
+    if (!notification) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_ALERT_TRIGGERED;
+    msg->user_id = strdup(notification->user_id);
+    msg->timestamp = time(NULL);
+    msg->data = alert_trigger_to_json(notification);
+
+    return msg;
+}
+
+/**
+ * Создание пустого дайджеста срабатываний пользователя
+ */
+WSMessage* ws_create_alert_digest_message(const char* user_id) {
+    if (!user_id) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_ALERT_DIGEST;
+    msg->user_id = strdup(user_id);
+    msg->data = cJSON_CreateArray();
+    msg->timestamp = time(NULL);
+
+    return msg;
+}
+
+/**
+ * Добавление срабатывания в дайджест
+ */
+int ws_alert_digest_add(WSMessage* digest, const TriggerNotification* notification) {
+    if (!digest || !digest->data || !notification) {
+        return -1;
+    }
+
+    cJSON* trigger = alert_trigger_to_json(notification);
+    if (!trigger) {
+        return -1;
+    }
+    cJSON_AddItemToArray(digest->data, trigger);
+    return 0;
+}
+
+/**
+ * Создание сообщения об обновлении рынка
+ */
+WSMessage* ws_create_market_update_message(CryptoPrice* prices, int count) {
+    if (!prices || count <= 0) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_MARKET_UPDATE;
+    msg->user_id = NULL;
+    msg->data = cJSON_CreateObject();
+    msg->timestamp = time(NULL);
+
+    if (msg->data) {
+        cJSON* prices_array = cJSON_CreateArray();
+        
+        for (int i = 0; i < count; i++) {
+            cJSON* price_obj = cJSON_CreateObject();
+            cJSON_AddStringToObject(price_obj, "symbol", prices[i].symbol);
+            cJSON_AddNumberToObject(price_obj, "current_price", prices[i].current_price);
+            cJSON_AddNumberToObject(price_obj, "price_change_24h", prices[i].price_change_24h);
+            cJSON_AddNumberToObject(price_obj, "price_change_percent_24h", prices[i].price_change_percent_24h);
+            cJSON_AddNumberToObject(price_obj, "volume_24h", prices[i].volume_24h);
+            cJSON_AddBoolToObject(price_obj, "is_valid", prices[i].is_valid);
+            
+            cJSON_AddItemToArray(prices_array, price_obj);
+        }
+        
+        cJSON_AddItemToObject(msg->data, "prices", prices_array);
+        cJSON_AddNumberToObject(msg->data, "count", count);
+        cJSON_AddNumberToObject(msg->data, "timestamp", msg->timestamp);
+    }
+
+    return msg;
+}
+
+/**
+ * Полное состояние символа версии seq
+ */
+WSMessage* ws_create_market_snapshot_message(const CryptoPrice* price, uint64_t seq) {
+    if (!price) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_MARKET_SNAPSHOT;
+    msg->user_id = NULL;
+    msg->data = cJSON_CreateObject();
+    msg->timestamp = time(NULL);
+
+    if (msg->data) {
+        cJSON_AddStringToObject(msg->data, "symbol", price->symbol);
+        cJSON_AddNumberToObject(msg->data, "seq", (double)seq);
+        cJSON_AddNumberToObject(msg->data, "current_price", price->current_price);
+        cJSON_AddNumberToObject(msg->data, "price_change_24h", price->price_change_24h);
+        cJSON_AddNumberToObject(msg->data, "price_change_percent_24h", price->price_change_percent_24h);
+        cJSON_AddNumberToObject(msg->data, "volume_24h", price->volume_24h);
+        cJSON_AddBoolToObject(msg->data, "is_valid", price->is_valid);
+    }
+
+    return msg;
+}
+
+/**
+ * Изменения символа между версиями seq - 1 и seq: только отличающиеся поля
+ */
+WSMessage* ws_create_market_delta_message(const CryptoPrice* prev, const CryptoPrice* price, uint64_t seq) {
+    if (!prev || !price) {
+        return NULL;
+    }
+
+    WSMessage* msg = malloc(sizeof(WSMessage));
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->type = WS_MSG_MARKET_DELTA;
+    msg->user_id = NULL;
+    msg->data = cJSON_CreateObject();
+    msg->timestamp = time(NULL);
+
+    if (msg->data) {
+        cJSON_AddStringToObject(msg->data, "symbol", price->symbol);
+        cJSON_AddNumberToObject(msg->data, "seq", (double)seq);
+        cJSON_AddNumberToObject(msg->data, "base", (double)(seq - 1));
+        if (price->current_price != prev->current_price) {
+            cJSON_AddNumberToObject(msg->data, "current_price", price->current_price);
+        }
+        if (price->price_change_24h != prev->price_change_24h) {
+            cJSON_AddNumberToObject(msg->data, "price_change_24h", price->price_change_24h);
+        }
+        if (price->price_change_percent_24h != prev->price_change_percent_24h) {
+            cJSON_AddNumberToObject(msg->data, "price_change_percent_24h", price->price_change_percent_24h);
+        }
+        if (price->volume_24h != prev->volume_24h) {
+            cJSON_AddNumberToObject(msg->data, "volume_24h", price->volume_24h);
+        }
+        if (price->is_valid != prev->is_valid) {
+            cJSON_AddBoolToObject(msg->data, "is_valid", price->is_valid);
+        }
+    }
+
+    return msg;
+}
+
+/**
+ * Имя типа сообщения в поле "type"
+ */
+static const char* ws_message_type_name(WebSocketMessageType type) {
+    switch (type) {
+        case WS_MSG_ALERT_TRIGGERED: return "alert_triggered";
+        case WS_MSG_MARKET_UPDATE: return "market_update";
+        case WS_MSG_ALERT_CREATED: return "alert_created";
+        case WS_MSG_ALERT_DELETED: return "alert_deleted";
+        case WS_MSG_CONNECTION_STATUS: return "connection_status";
+        case WS_MSG_ERROR: return "error";
+        case WS_MSG_MARKET_SNAPSHOT: return "market_snapshot";
+        case WS_MSG_MARKET_DELTA: return "market_delta";
+        case WS_MSG_ALERT_DIGEST: return "alert_digest";
+    }
+    return "unknown";
+}
+
+/**
+ * Конверт сообщения: {"type": ..., "timestamp": ..., "data": {...}}
+ *
+ * data добавляется ссылкой и остается во владении сообщения.
+ */
+cJSON* ws_message_to_json(WSMessage* message) {
+    if (!message) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    return NULL;
+#else
+    cJSON* json = cJSON_CreateObject();
+    if (!json) {
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(json, "type", ws_message_type_name(message->type));
+    cJSON_AddNumberToObject(json, "timestamp", (double)message->timestamp);
+    if (message->data) {
+        cJSON_AddItemReferenceToObject(json, "data", message->data);
+    }
+    return json;
+#endif
+}
+
+/**
+ * Сериализация сообщения в компактный JSON (освобождается через free)
+ */
+char* ws_serialize_message(WSMessage* message) {
+    if (!message) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    (void)ws_message_type_name;
+    return message->data ? cJSON_Print(message->data) : NULL;
+#else
+    cJSON* json = ws_message_to_json(message);
+    if (!json) {
+        return NULL;
+    }
+    char* text = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    return text;
+#endif
+}
+
+/**
+ * Удаление из очереди соединения кадров, для которых keep возвращает false,
+ * с сохранением порядка остальных
+ */
+static void connection_purge(WSConnection* conn, bool (*keep)(const WSFrame*)) {
+    int kept = 0;
+    for (int i = 0; i < conn->send_count; i++) {
+        WSFrame* frame = conn->send_queue[(conn->send_head + i) % WS_SEND_QUEUE_SIZE];
+        if (keep && keep(frame)) {
+            conn->send_queue[(conn->send_head + kept++) % WS_SEND_QUEUE_SIZE] = frame;
+        } else {
+            conn->queued_bytes -= frame->length;
+            ws_frame_release(frame);
+        }
+    }
+    for (int i = kept; i < conn->send_count; i++) {
+        conn->send_queue[(conn->send_head + i) % WS_SEND_QUEUE_SIZE] = NULL;
+    }
+    conn->send_count = kept;
+}
+
+static bool frame_is_notification(const WSFrame* frame) {
+    return frame->topic < 0;
+}
+
+/**
+ * Постановка соединения в очередь запросов записи (под мьютексом менеджера)
+ */
+static void connection_request_write(WSConnection* conn) {
+    if (!conn->write_requested) {
+        conn->write_requested = true;
+        conn->pending_index = g_ws_manager->pending_count;
+        g_ws_manager->pending_writes[g_ws_manager->pending_count++] = conn;
+    }
+}
+
+/**
+ * Пометка соединения к закрытию (под мьютексом менеджера); очередь
+ * освобождается сразу, само закрытие выполняет поток обслуживания
+ */
+static void connection_request_close(WSConnection* conn, const char* reason) {
+    if (conn->close_requested) {
+        return;
+    }
+    conn->close_requested = true;
+    connection_purge(conn, NULL);
+    connection_request_write(conn);
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg), "Closing slow WebSocket client %s: %s",
+             conn->user_id[0] ? conn->user_id : "(anonymous)", reason);
+    alert_log("WARNING", log_msg);
+}
+
+/**
+ * Переход в перегрузку: обновления рынка из очереди выбрасываются (их
+ * заменят снимки после восстановления), уведомления остаются
+ */
+static void connection_congest(WSConnection* conn) {
+    conn->congested = true;
+    conn->congested_since = time(NULL);
+    connection_purge(conn, frame_is_notification);
+
+    for (int i = 0; i < conn->subscription_count; i++) {
+        WSSubscription* sub = &conn->subscriptions[i];
+        g_ws_manager->topic_index[sub->topic].subscribers[sub->position].seq = 0;
+    }
+
+    if (conn->dropped_count++ == 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "WebSocket client %s is too slow, deferring market updates",
+                 conn->user_id[0] ? conn->user_id : "(anonymous)");
+        alert_log("WARNING", log_msg);
+    }
+}
+
+/**
+ * Постановка кадра в очередь соединения (под мьютексом менеджера).
+ * Движок никогда не ждет клиента. Выше WS_SEND_HIGH_WATERMARK обновления
+ * рынка откладываются до спада очереди, тогда возвращается true и подписка
+ * потом получит снимок. Уведомления не теряются: если для них не осталось
+ * места, соединение закрывается.
+ */
+static bool connection_enqueue(WSConnection* conn, WSFrame* frame) {
+    if (conn->close_requested) {
+        return true;
+    }
+
+    bool market = frame->topic >= 0;
+    if (!conn->congested && conn->queued_bytes + frame->length > WS_SEND_HIGH_WATERMARK) {
+        connection_congest(conn);
+    }
+    if (conn->congested && market) {
+        return true;
+    }
+
+    if (conn->send_count == WS_SEND_QUEUE_SIZE) {
+        if (!conn->congested) {
+            connection_congest(conn);
+        }
+        if (conn->send_count == WS_SEND_QUEUE_SIZE) {
+            connection_request_close(conn, "send queue is full of notifications");
+            return true;
+        }
+    }
+
+    frame_retain(frame);
+    int tail = (conn->send_head + conn->send_count) % WS_SEND_QUEUE_SIZE;
+    conn->send_queue[tail] = frame;
+    conn->send_count++;
+    conn->queued_bytes += frame->length;
+    conn->message_count++;
+
+    connection_request_write(conn);
+    return false;
+}
+
+static bool encoding_in_use(WSEncoding encoding) {
+    return __atomic_load_n(&g_ws_manager->encoding_counts[encoding], __ATOMIC_RELAXED) > 0;
+}
+
+static void frame_set_release(WSFrameSet* set) {
+    for (int i = 0; i < WS_ENCODING_COUNT; i++) {
+        ws_frame_release(set->frames[i]);
+        set->frames[i] = NULL;
+    }
+}
+
+/**
+ * Постановка кадра кодировки соединения; true, если соединение
+ * что-то потеряло (кадр вытеснен или нужной кодировки нет). Кадры
+ * обновлений рынка собираются только для используемых кодировок,
+ * пропуск восстанавливается следующим снимком.
+ */
+static bool connection_enqueue_set(WSConnection* conn, const WSFrameSet* set) {
+    WSFrame* frame = set->frames[conn->encoding];
+    if (!frame) {
+        return true;
+    }
+    return connection_enqueue(conn, frame);
+}
+
+/**
+ * Постановка кадров в очереди соединений пользователя (или всех при
+ * user_id == NULL). Возвращает число получателей; стоимость пропорциональна
+ * числу получателей, данные кадров не копируются.
+ */
+int ws_send_frames(const char* user_id, const WSFrameSet* set) {
+    if (!set || !g_ws_manager) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+
+    WSConnection** targets = g_ws_manager->connections;
+    int target_count = g_ws_manager->connection_count;
+    if (user_id) {
+        targets = ws_find_user_connections(user_id, &target_count);
+    }
+
+    for (int i = 0; i < target_count; i++) {
+        connection_enqueue_set(targets[i], set);
+    }
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    if (target_count > 0) {
+        ws_wakeup();
+    }
+    return target_count;
+}
+
+#ifndef _WIN32
+/**
+ * Значение cJSON в MessagePack; целые числа записываются целыми.
+ * cJSON не различает целые и дробные поля, поэтому сообщения с полями
+ * double (цены, срабатывания) пишутся прямо из структур.
+ */
+static void msgpack_write_cjson(MsgPackWriter* writer, const cJSON* item) {
+    if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+        uint32_t count = (uint32_t)cJSON_GetArraySize(item);
+        if (cJSON_IsObject(item)) {
+            msgpack_write_map(writer, count);
+        } else {
+            msgpack_write_array(writer, count);
+        }
+
+        const cJSON* child;
+        cJSON_ArrayForEach(child, item) {
+            if (cJSON_IsObject(item)) {
+                msgpack_write_str(writer, child->string);
+            }
+            msgpack_write_cjson(writer, child);
+        }
+    } else if (cJSON_IsString(item)) {
+        msgpack_write_str(writer, item->valuestring);
+    } else if (cJSON_IsNumber(item)) {
+        // Диапазон проверяется до приведения: NaN, бесконечность и числа
+        // вне int64 привести нельзя
+        double value = item->valuedouble;
+        if (value > -9007199254740992.0 && value < 9007199254740992.0 && value == (double)(int64_t)value) {
+            msgpack_write_int(writer, (int64_t)value);
+        } else {
+            msgpack_write_double(writer, value);
+        }
+    } else if (cJSON_IsBool(item)) {
+        msgpack_write_bool(writer, cJSON_IsTrue(item));
+    } else {
+        msgpack_write_nil(writer);
+    }
+}
+#endif
+
+/**
+ * Начало сообщения MessagePack: тот же конверт, что и в JSON;
+ * следом вызывающий пишет значение "data"
+ */
+static void msgpack_write_envelope(MsgPackWriter* writer, WebSocketMessageType type, time_t timestamp) {
+    msgpack_write_map(writer, 3);
+    msgpack_write_str(writer, "type");
+    msgpack_write_str(writer, ws_message_type_name(type));
+    msgpack_write_str(writer, "timestamp");
+    msgpack_write_int(writer, (int64_t)timestamp);
+    msgpack_write_str(writer, "data");
+}
+
+static WSFrame* frame_from_writer(MsgPackWriter* writer) {
+    size_t size = 0;
+    unsigned char* data = msgpack_writer_detach(writer, &size);
+    if (!data) {
+        return NULL;
+    }
+    WSFrame* frame = ws_frame_create(data, size, WS_ENCODING_MSGPACK);
+    free(data);
+    return frame;
+}
+
+/**
+ * Статус и ошибка в MessagePack прямо из полей сообщения; false для
+ * остальных типов
+ */
+static bool msgpack_write_known_message(MsgPackWriter* writer, const WSMessage* message) {
+    const char* field;
+    switch (message->type) {
+        case WS_MSG_CONNECTION_STATUS: field = "status"; break;
+        case WS_MSG_ERROR:             field = "error"; break;
+        default:                       return false;
+    }
+
+    const char* value = cJSON_GetStringValue(cJSON_GetObjectItem(message->data, field));
+    if (!value) {
+        return false;
+    }
+
+    msgpack_write_envelope(writer, message->type, message->timestamp);
+    if (message->type == WS_MSG_CONNECTION_STATUS) {
+        msgpack_write_map(writer, 2);
+        msgpack_write_str(writer, field);
+        msgpack_write_str(writer, value);
+        msgpack_write_str(writer, "timestamp");
+        msgpack_write_int(writer, (int64_t)message->timestamp);
+    } else {
+        msgpack_write_map(writer, 1);
+        msgpack_write_str(writer, field);
+        msgpack_write_str(writer, value);
+    }
+    return true;
+}
+
+/**
+ * Кадр сообщения в заданной кодировке
+ */
+static WSFrame* ws_frame_from_message(WSMessage* message, WSEncoding encoding) {
+    if (encoding == WS_ENCODING_MSGPACK) {
+        MsgPackWriter writer;
+        if (msgpack_writer_init(&writer, 256) != 0) {
+            return NULL;
+        }
+        if (msgpack_write_known_message(&writer, message)) {
+            return frame_from_writer(&writer);
+        }
+#ifdef _WIN32
+        msgpack_writer_free(&writer);
+        return NULL;
+#else
+        msgpack_write_envelope(&writer, message->type, message->timestamp);
+        if (message->data) {
+            msgpack_write_cjson(&writer, message->data);
+        } else {
+            msgpack_write_nil(&writer);
+        }
+        return frame_from_writer(&writer);
+#endif
+    }
+
+    char* text = ws_serialize_message(message);
+    if (!text) {
+        return NULL;
+    }
+    WSFrame* frame = ws_frame_create(text, strlen(text), WS_ENCODING_JSON);
+    free(text);
+    return frame;
+}
+
+/**
+ * Кадры сообщения: одна сериализация на кодировку. Собираются все
+ * кодировки, а не только используемые: клиент, подключившийся между
+ * сборкой и постановкой, иначе потерял бы сообщение. Ошибка - только
+ * если нет кадра кодировки, в которой есть клиенты.
+ */
+static int frame_set_from_message(WSMessage* message, WSFrameSet* set) {
+    memset(set, 0, sizeof(WSFrameSet));
+    for (int i = 0; i < WS_ENCODING_COUNT; i++) {
+        set->frames[i] = ws_frame_from_message(message, (WSEncoding)i);
+        if (!set->frames[i] && encoding_in_use((WSEncoding)i)) {
+            frame_set_release(set);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Отправка сообщения пользователю
+ */
+int ws_send_to_user(const char* user_id, WSMessage* message) {
+    if (!user_id || !message) {
+        return -1;
+    }
+    if (!g_ws_manager) {
+        return 0;
+    }
+
+    WSFrameSet set;
+    if (frame_set_from_message(message, &set) != 0) {
+        return -1;
+    }
+    ws_send_frames(user_id, &set);
+    frame_set_release(&set);
+    return 0;
+}
+
+/**
+ * Отправка сообщения в одно соединение; conn должен быть получен
+ * в потоке обслуживания (соединение живет до LWS_CALLBACK_CLOSED)
+ */
+int ws_send_to_connection(WSConnection* conn, WSMessage* message) {
+    if (!conn || !message || !g_ws_manager) {
+        return -1;
+    }
+
+    WSFrame* frame = ws_frame_from_message(message, conn->encoding);
+    if (!frame) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    connection_enqueue(conn, frame);
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    ws_frame_release(frame);
+    ws_wakeup();
+    return 0;
+}
+
+/**
+ * Широковещательная отправка сообщения
+ */
+int ws_broadcast_message(WSMessage* message) {
+    if (!message) {
+        return -1;
+    }
+    if (!g_ws_manager) {
+        return 0;
+    }
+
+    WSFrameSet set;
+    if (frame_set_from_message(message, &set) != 0) {
+        return -1;
+    }
+    ws_send_frames(NULL, &set);
+    frame_set_release(&set);
+    return 0;
+}
+
+/**
+ * Срабатывание в MessagePack прямо из записи очереди: те же поля, что
+ * в alert_trigger_to_json, поля double всегда пишутся как float64
+ */
+static void msgpack_write_trigger(MsgPackWriter* writer, const TriggerNotification* notification) {
+    msgpack_write_map(writer, 3);
+
+    msgpack_write_str(writer, "alert");
+    msgpack_write_map(writer, 5);
+    msgpack_write_str(writer, "id");
+    msgpack_write_int(writer, notification->alert_id);
+    msgpack_write_str(writer, "symbol");
+    msgpack_write_str(writer, notification->symbol);
+    msgpack_write_str(writer, "type");
+    msgpack_write_int(writer, notification->type);
+    msgpack_write_str(writer, "target_value");
+    msgpack_write_double(writer, notification->target_value);
+    msgpack_write_str(writer, "message");
+    msgpack_write_str(writer, notification->message);
+
+    const CryptoPrice* price = &notification->price;
+    msgpack_write_str(writer, "price");
+    msgpack_write_map(writer, 4);
+    msgpack_write_str(writer, "symbol");
+    msgpack_write_str(writer, price->symbol);
+    msgpack_write_str(writer, "current_price");
+    msgpack_write_double(writer, price->current_price);
+    msgpack_write_str(writer, "price_change_24h");
+    msgpack_write_double(writer, price->price_change_24h);
+    msgpack_write_str(writer, "price_change_percent_24h");
+    msgpack_write_double(writer, price->price_change_percent_24h);
+
+    msgpack_write_str(writer, "timestamp");
+    msgpack_write_int(writer, (int64_t)notification->triggered_at);
+}
+
+/**
+ * Кадр срабатываний пользователя: alert_triggered для одного,
+ * alert_digest для нескольких; MessagePack пишется прямо из записей
+ */
+static WSFrame* alert_notifications_frame(const TriggerNotification* const* notifications, int count,
+                                          time_t timestamp, WSEncoding encoding) {
+    if (encoding == WS_ENCODING_JSON) {
+        WSMessage* msg;
+        if (count == 1) {
+            msg = ws_create_alert_triggered_message(notifications[0]);
+        } else {
+            msg = ws_create_alert_digest_message(notifications[0]->user_id);
+            for (int i = 0; msg && i < count; i++) {
+                ws_alert_digest_add(msg, notifications[i]);
+            }
+        }
+        WSFrame* frame = msg ? ws_frame_from_message(msg, encoding) : NULL;
+        ws_free_message(msg);
+        return frame;
+    }
+
+    MsgPackWriter writer;
+    if (msgpack_writer_init(&writer, 256 * (size_t)count) != 0) {
+        return NULL;
+    }
+    if (count == 1) {
+        msgpack_write_envelope(&writer, WS_MSG_ALERT_TRIGGERED, timestamp);
+        msgpack_write_trigger(&writer, notifications[0]);
+    } else {
+        msgpack_write_envelope(&writer, WS_MSG_ALERT_DIGEST, timestamp);
+        msgpack_write_array(&writer, (uint32_t)count);
+        for (int i = 0; i < count; i++) {
+            msgpack_write_trigger(&writer, notifications[i]);
+        }
+    }
+    return frame_from_writer(&writer);
+}
+
+/**
+ * Отправка срабатываний пользователю одним сообщением
+ */
+int ws_send_alert_notifications(const char* user_id, const TriggerNotification* const* notifications,
+                                int count) {
+    if (!user_id || !notifications || count <= 0) {
+        return -1;
+    }
+    if (!g_ws_manager) {
+        return 0;
+    }
+
+    // Все кодировки, как в frame_set_from_message: срабатывание не
+    // восстанавливается снимком, как обновление рынка
+    time_t timestamp = time(NULL);
+    WSFrameSet set = { { NULL } };
+    for (int e = 0; e < WS_ENCODING_COUNT; e++) {
+        set.frames[e] = alert_notifications_frame(notifications, count, timestamp, (WSEncoding)e);
+        if (!set.frames[e] && encoding_in_use((WSEncoding)e)) {
+            frame_set_release(&set);
+            return -1;
+        }
+    }
+    ws_send_frames(user_id, &set);
+    frame_set_release(&set);
+    return 0;
+}
+
+/**
+ * Освобождение памяти сообщения
+ */
+void ws_free_message(WSMessage* message) {
+    if (!message) {
+        return;
+    }
+
+    if (message->user_id) {
+        free(message->user_id);
+    }
+    
+    if (message->data) {
+        cJSON_Delete(message->data);
+    }
+    
+    free(message);
+}
+
+/**
+ * Добавление нового соединения
+ */
+int ws_add_connection(struct lws* wsi, const char* user_id, WSEncoding encoding) {
+    if (!wsi || !user_id || !g_ws_manager) {
+        return -1;
+    }
+
+    WSConnection* conn = calloc(1, sizeof(WSConnection));
+    if (!conn) {
+        return -1;
+    }
+
+    conn->wsi = wsi;
+    strncpy(conn->user_id, user_id, sizeof(conn->user_id) - 1);
+    conn->user_id[sizeof(conn->user_id) - 1] = '\0';
+    conn->is_authenticated = conn->user_id[0] != '\0';
+    conn->connected_at = time(NULL);
+    conn->message_count = 0;
+    conn->encoding = encoding == WS_ENCODING_MSGPACK ? WS_ENCODING_MSGPACK : WS_ENCODING_JSON;
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    if (g_ws_manager->connection_count >= MAX_WS_CONNECTIONS) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        free(conn);
+        alert_log("WARNING", "WebSocket connection limit reached");
+        return -1;
+    }
+
+    // Анонимные соединения получают только широковещательные сообщения
+    if (conn->is_authenticated) {
+        WSUserEntry* entry = user_entry_find(conn->user_id, true);
+        if (!entry || user_entry_add(entry, conn) != 0) {
+            if (entry && entry->count == 0) {
+                user_entry_release(entry);
+            }
+            pthread_mutex_unlock(&g_ws_manager->mutex);
+            free(conn);
+            return -1;
+        }
+    }
+
+    conn->index = g_ws_manager->connection_count;
+    g_ws_manager->connections[g_ws_manager->connection_count++] = conn;
+    __atomic_add_fetch(&g_ws_manager->encoding_counts[conn->encoding], 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+#ifndef _WIN32
+    // Соединение по wsi находится через данные сессии без поиска
+    *(WSConnection**)lws_wsi_user(wsi) = conn;
+#endif
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "WebSocket connection added for user: %s", user_id);
+    alert_log("INFO", log_msg);
+
+    return 0;
+}
+
+/**
+ * Удаление соединения
+ */
+int ws_remove_connection(struct lws* wsi) {
+    if (!wsi || !g_ws_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+
+    WSConnection* conn = ws_find_connection(wsi);
+    if (!conn) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        return -1;
+    }
+
+    WSConnection* last = g_ws_manager->connections[--g_ws_manager->connection_count];
+    g_ws_manager->connections[conn->index] = last;
+    last->index = conn->index;
+    __atomic_sub_fetch(&g_ws_manager->encoding_counts[conn->encoding], 1, __ATOMIC_RELAXED);
+
+    if (conn->write_requested) {
+        WSConnection* last_pending = g_ws_manager->pending_writes[--g_ws_manager->pending_count];
+        g_ws_manager->pending_writes[conn->pending_index] = last_pending;
+        last_pending->pending_index = conn->pending_index;
+    }
+
+    if (conn->is_authenticated) {
+        user_entry_remove(conn);
+    }
+    while (conn->subscription_count > 0) {
+        connection_drop_subscription(conn, conn->subscription_count - 1);
+    }
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+#ifndef _WIN32
+    *(WSConnection**)lws_wsi_user(wsi) = NULL;
+#endif
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "WebSocket connection removed for user: %s", conn->user_id);
+    alert_log("INFO", log_msg);
+
+    connection_free(conn);
+    return 0;
+}
+
+/**
+ * Поиск соединения по wsi через данные сессии libwebsockets
+ */
+WSConnection* ws_find_connection(struct lws* wsi) {
+    if (!wsi || !g_ws_manager) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    return NULL;
+#else
+    WSConnection** slot = lws_wsi_user(wsi);
+    return slot ? *slot : NULL;
+#endif
+}
+
+/**
+ * Соединения пользователя; вызывающий держит мьютекс менеджера
+ */
+WSConnection** ws_find_user_connections(const char* user_id, int* count) {
+    *count = 0;
+    if (!user_id || !user_id[0] || !g_ws_manager) {
+        return NULL;
+    }
+
+    WSUserEntry* entry = user_entry_find(user_id, false);
+    if (!entry) {
+        return NULL;
+    }
+
+    *count = entry->count;
+    return entry->connections;
+}
+
+/**
+ * Снимок символа; MessagePack пишется прямо из структуры
+ */
+static WSFrame* market_snapshot_frame(const CryptoPrice* price, uint64_t seq, WSEncoding encoding) {
+    if (encoding == WS_ENCODING_JSON) {
+        WSMessage* msg = ws_create_market_snapshot_message(price, seq);
+        WSFrame* frame = msg ? ws_frame_from_message(msg, encoding) : NULL;
+        ws_free_message(msg);
+        return frame;
+    }
+
+    MsgPackWriter writer;
+    if (msgpack_writer_init(&writer, 192) != 0) {
+        return NULL;
+    }
+    msgpack_write_envelope(&writer, WS_MSG_MARKET_SNAPSHOT, time(NULL));
+    msgpack_write_map(&writer, 7);
+    msgpack_write_str(&writer, "symbol");
+    msgpack_write_str(&writer, price->symbol);
+    msgpack_write_str(&writer, "seq");
+    msgpack_write_int(&writer, (int64_t)seq);
+    msgpack_write_str(&writer, "current_price");
+    msgpack_write_double(&writer, price->current_price);
+    msgpack_write_str(&writer, "price_change_24h");
+    msgpack_write_double(&writer, price->price_change_24h);
+    msgpack_write_str(&writer, "price_change_percent_24h");
+    msgpack_write_double(&writer, price->price_change_percent_24h);
+    msgpack_write_str(&writer, "volume_24h");
+    msgpack_write_double(&writer, price->volume_24h);
+    msgpack_write_str(&writer, "is_valid");
+    msgpack_write_bool(&writer, price->is_valid);
+    return frame_from_writer(&writer);
+}
+
+/**
+ * Дельта символа к версии seq - 1; MessagePack пишется прямо из структур
+ */
+static WSFrame* market_delta_frame(const CryptoPrice* prev, const CryptoPrice* price,
+                                   uint64_t seq, WSEncoding encoding) {
+    if (encoding == WS_ENCODING_JSON) {
+        WSMessage* msg = ws_create_market_delta_message(prev, price, seq);
+        WSFrame* frame = msg ? ws_frame_from_message(msg, encoding) : NULL;
+        ws_free_message(msg);
+        return frame;
+    }
+
+    bool price_diff = price->current_price != prev->current_price;
+    bool change_diff = price->price_change_24h != prev->price_change_24h;
+    bool percent_diff = price->price_change_percent_24h != prev->price_change_percent_24h;
+    bool volume_diff = price->volume_24h != prev->volume_24h;
+    bool valid_diff = price->is_valid != prev->is_valid;
+
+    MsgPackWriter writer;
+    if (msgpack_writer_init(&writer, 128) != 0) {
+        return NULL;
+    }
+    msgpack_write_envelope(&writer, WS_MSG_MARKET_DELTA, time(NULL));
+    msgpack_write_map(&writer, 3u + price_diff + change_diff + percent_diff + volume_diff + valid_diff);
+    msgpack_write_str(&writer, "symbol");
+    msgpack_write_str(&writer, price->symbol);
+    msgpack_write_str(&writer, "seq");
+    msgpack_write_int(&writer, (int64_t)seq);
+    msgpack_write_str(&writer, "base");
+    msgpack_write_int(&writer, (int64_t)(seq - 1));
+    if (price_diff) {
+        msgpack_write_str(&writer, "current_price");
+        msgpack_write_double(&writer, price->current_price);
+    }
+    if (change_diff) {
+        msgpack_write_str(&writer, "price_change_24h");
+        msgpack_write_double(&writer, price->price_change_24h);
+    }
+    if (percent_diff) {
+        msgpack_write_str(&writer, "price_change_percent_24h");
+        msgpack_write_double(&writer, price->price_change_percent_24h);
+    }
+    if (volume_diff) {
+        msgpack_write_str(&writer, "volume_24h");
+        msgpack_write_double(&writer, price->volume_24h);
+    }
+    if (valid_diff) {
+        msgpack_write_str(&writer, "is_valid");
+        msgpack_write_bool(&writer, price->is_valid);
+    }
+    return frame_from_writer(&writer);
+}
+
+/**
+ * Пометка кадров рынка темой: при перегрузке клиента они вытесняются первыми
+ */
+static WSFrame* market_frame_for_topic(WSFrame* frame, int topic) {
+    if (frame) {
+        frame->topic = topic;
+    }
+    return frame;
+}
+
+/**
+ * Снимок текущей версии темы в очередь подписчика (под мьютексом менеджера;
+ * снимок собирается под ним, чтобы изменение из тика не обогнало его)
+ */
+static bool enqueue_snapshot(WSTopicEntry* topic, WSSubscriber* subscriber) {
+    if (!topic->has_last) {
+        return false;
+    }
+
+    WSFrame* frame = market_frame_for_topic(
+        market_snapshot_frame(&topic->last_sent, topic->seq, subscriber->conn->encoding),
+        (int)(topic - g_ws_manager->topic_index));
+    if (!frame) {
+        subscriber->seq = 0;
+        return false;
+    }
+
+    bool dropped = connection_enqueue(subscriber->conn, frame);
+    subscriber->seq = dropped ? 0 : topic->seq;
+    ws_frame_release(frame);
+    return true;
+}
+
+/**
+ * Подписка соединения на символ. Темы создаются тиками рынка, поэтому
+ * подписаться можно только на известный символ (-3 для неизвестного,
+ * -2 при превышении лимита). Клиент сразу получает последнюю цену.
+ */
+int ws_subscribe(struct lws* wsi, const char* symbol) {
+    if (!wsi || !symbol || !g_ws_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+
+    WSConnection* conn = ws_find_connection(wsi);
+    if (!conn) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        return -1;
+    }
+
+    WSTopicEntry* topic = topic_find(symbol, false);
+    if (!topic) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        return -3;
+    }
+
+    int topic_slot = (int)(topic - g_ws_manager->topic_index);
+    if (connection_find_subscription(conn, topic_slot) >= 0) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        return 0;
+    }
+
+    if (conn->subscription_count >= WS_MAX_SUBSCRIPTIONS) {
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+        return -2;
+    }
+
+    if (topic->count == topic->capacity) {
+        int capacity = topic->capacity ? topic->capacity * 2 : 8;
+        WSSubscriber* grown = realloc(topic->subscribers, sizeof(WSSubscriber) * (size_t)capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&g_ws_manager->mutex);
+            return -1;
+        }
+        topic->subscribers = grown;
+        topic->capacity = capacity;
+    }
+
+    WSSubscription* sub = &conn->subscriptions[conn->subscription_count++];
+    sub->topic = topic_slot;
+    sub->position = topic->count;
+    topic->subscribers[topic->count].conn = conn;
+    topic->subscribers[topic->count].seq = 0;
+    topic->count++;
+
+    bool queued = enqueue_snapshot(topic, &topic->subscribers[sub->position]);
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    if (queued) {
+        ws_wakeup();
+    }
+    return 0;
+}
+
+/**
+ * Повторная отправка снимка по запросу клиента, обнаружившего пропуск версии
+ */
+int ws_resync(struct lws* wsi, const char* symbol) {
+    if (!wsi || !symbol || !g_ws_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+
+    WSConnection* conn = ws_find_connection(wsi);
+    WSTopicEntry* topic = conn ? topic_find(symbol, false) : NULL;
+    int i = topic ? connection_find_subscription(conn, (int)(topic - g_ws_manager->topic_index)) : -1;
+    bool queued = false;
+    if (i >= 0) {
+        queued = enqueue_snapshot(topic, &topic->subscribers[conn->subscriptions[i].position]);
+    }
+
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    if (queued) {
+        ws_wakeup();
+    }
+    return i >= 0 ? 0 : -1;
+}
+
+/**
+ * Отписка соединения от символа
+ */
+int ws_unsubscribe(struct lws* wsi, const char* symbol) {
+    if (!wsi || !symbol || !g_ws_manager) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+
+    WSConnection* conn = ws_find_connection(wsi);
+    WSTopicEntry* topic = conn ? topic_find(symbol, false) : NULL;
+    int i = topic ? connection_find_subscription(conn, (int)(topic - g_ws_manager->topic_index)) : -1;
+    if (i >= 0) {
+        connection_drop_subscription(conn, i);
+    }
+
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+    return i >= 0 ? 0 : -1;
+}
+
+static bool price_changed(const CryptoPrice* a, const CryptoPrice* b) {
+    return a->current_price != b->current_price ||
+           a->price_change_24h != b->price_change_24h ||
+           a->price_change_percent_24h != b->price_change_percent_24h ||
+           a->volume_24h != b->volume_24h ||
+           a->is_valid != b->is_valid;
+}
+
+// Изменение темы за тик: предыдущее состояние нужно для дельты
+typedef struct {
+    int index;
+    int topic;
+    CryptoPrice prev;
+    bool had_prev;
+    uint64_t seq;
+} MarketChange;
+
+/**
+ * Рассылка обновлений рынка по темам
+ *
+ * Каждый символ тика получает тему, каждое изменение - новую версию.
+ * Для изменившегося символа с подписчиками собираются общие кадры дельты
+ * к предыдущей версии и полного снимка в каждой используемой кодировке. Подписчик, получивший
+ * предыдущую версию, получает дельту, остальные (новые или вышедшие
+ * из перегрузки) - снимок. Перегруженным клиентам кадры не ставятся. Символы без подписчиков
+ * не сериализуются.
+ */
+void ws_on_market_data_updated(CryptoPrice* prices, int count) {
+    if (!prices || count <= 0 || !g_ws_manager) {
+        return;
+    }
+
+    MarketChange* changes = malloc(sizeof(MarketChange) * (size_t)count);
+    if (!changes) {
+        return;
+    }
+    int change_count = 0;
+
+    pthread_mutex_lock(&g_ws_manager->mutex);
+    for (int i = 0; i < count; i++) {
+        WSTopicEntry* topic = topic_find(prices[i].symbol, true);
+        if (!topic) {
+            continue;
+        }
+        if (topic->has_last && !price_changed(&topic->last_sent, &prices[i])) {
+            continue;
+        }
+
+        MarketChange* change = &changes[change_count];
+        change->index = i;
+        change->topic = (int)(topic - g_ws_manager->topic_index);
+        change->prev = topic->last_sent;
+        change->had_prev = topic->has_last;
+        change->seq = ++topic->seq;
+
+        topic->last_sent = prices[i];
+        topic->has_last = true;
+        if (topic->count > 0) {
+            change_count++;
+        }
+    }
+    pthread_mutex_unlock(&g_ws_manager->mutex);
+
+    int queued = 0;
+    for (int i = 0; i < change_count; i++) {
+        MarketChange* change = &changes[i];
+        CryptoPrice* price = &prices[change->index];
+
+        WSFrameSet snapshot = { { NULL } };
+        WSFrameSet delta = { { NULL } };
+        for (int e = 0; e < WS_ENCODING_COUNT; e++) {
+            if (!encoding_in_use((WSEncoding)e)) {
+                continue;
+            }
+            snapshot.frames[e] = market_frame_for_topic(
+                market_snapshot_frame(price, change->seq, (WSEncoding)e), change->topic);
+            if (change->had_prev) {
+                delta.frames[e] = market_frame_for_topic(
+                    market_delta_frame(&change->prev, price, change->seq, (WSEncoding)e), change->topic);
+            }
+        }
+
+        pthread_mutex_lock(&g_ws_manager->mutex);
+        WSTopicEntry* topic = &g_ws_manager->topic_index[change->topic];
+        for (int k = 0; k < topic->count; k++) {
+            WSSubscriber* subscriber = &topic->subscribers[k];
+            if (subscriber->seq >= change->seq) {
+                continue;       // Уже получил снимок этой версии при подписке
+            }
+
+            // Без кадра нужной кодировки seq сбрасывается: следующим будет снимок
+            WSEncoding encoding = subscriber->conn->encoding;
+            bool in_sync = delta.frames[encoding] && subscriber->seq == change->seq - 1;
+            bool dropped = connection_enqueue_set(subscriber->conn, in_sync ? &delta : &snapshot);
+            subscriber->seq = dropped ? 0 : change->seq;
+            queued++;
+        }
+        pthread_mutex_unlock(&g_ws_manager->mutex);
+
+        frame_set_release(&snapshot);
+        frame_set_release(&delta);
+    }
+
+    free(changes);
+    if (queued > 0) {
+        ws_wakeup();
+    }
+}